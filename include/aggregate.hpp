@@ -0,0 +1,81 @@
+#pragma once
+
+#include <concepts>
+#include <functional>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+
+namespace rb
+{
+    // Subtree aggregate policy for rb::Tree: a monoid over values lifted from
+    // the keys. Every node caches combine (left, lift (key), right) of its
+    // subtree, kept up to date by the same code paths as subtree_size_.
+    //
+    //   struct MyAggregate
+    //   {
+    //       using value_type = ...;
+    //       static value_type identity();
+    //       static value_type lift (const Key& key);
+    //       static value_type combine (const value_type& lhs, const value_type& rhs);
+    //   };
+    //
+    // combine must be associative; it need not be commutative, operands are
+    // always passed in key order.
+    template<typename A, typename T>
+    concept Aggregate = requires (const T& key, const typename A::value_type& value)
+    {
+        { A::identity() } -> std::convertible_to<typename A::value_type>;
+        { A::lift (key) } -> std::convertible_to<typename A::value_type>;
+        { A::combine (value, value) } -> std::convertible_to<typename A::value_type>;
+    };
+
+    // Default policy: nothing but subtree_size_ is maintained, and nodes
+    // carry no extra bytes
+    struct NoAggregate {};
+
+    template<typename A>
+    constexpr bool has_aggregate_v = !std::is_same_v<A, NoAggregate>;
+
+    struct NoAggregateValue {};
+
+    template<typename A>
+    struct aggregate_value { using type = typename A::value_type; };
+
+    template<>
+    struct aggregate_value<NoAggregate> { using type = NoAggregateValue; };
+
+    template<typename A>
+    using aggregate_value_t = typename aggregate_value<A>::type;
+
+    template<typename T, typename Proj = std::identity>
+    struct SumAggregate
+    {
+        using value_type = std::remove_cvref_t<std::invoke_result_t<Proj, const T&>>;
+
+        static value_type identity() { return value_type {}; }
+        static value_type lift (const T& key) { return Proj {}(key); }
+        static value_type combine (const value_type& lhs, const value_type& rhs) { return lhs + rhs; }
+    };
+
+    template<typename T, typename Proj = std::identity>
+    struct MinAggregate
+    {
+        using value_type = std::remove_cvref_t<std::invoke_result_t<Proj, const T&>>;
+
+        static value_type identity() { return std::numeric_limits<value_type>::max(); }
+        static value_type lift (const T& key) { return Proj {}(key); }
+        static value_type combine (const value_type& lhs, const value_type& rhs) { return std::min (lhs, rhs); }
+    };
+
+    template<typename T, typename Proj = std::identity>
+    struct MaxAggregate
+    {
+        using value_type = std::remove_cvref_t<std::invoke_result_t<Proj, const T&>>;
+
+        static value_type identity() { return std::numeric_limits<value_type>::lowest(); }
+        static value_type lift (const T& key) { return Proj {}(key); }
+        static value_type combine (const value_type& lhs, const value_type& rhs) { return std::max (lhs, rhs); }
+    };
+
+} // namespace rb
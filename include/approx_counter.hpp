@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace rb
+{
+    // Approximate range counts over the keys of one unique-key tree, from
+    // a histogram that never looks at the tree when answering:
+    //
+    //   rb::ApproxCounter<rb::Tree<int>> approx (0.01);
+    //   approx.rebuild (tree);
+    //   tree.insert (key);      // when key was not there yet
+    //   approx.add (tree, key);
+    //   approx.range_queries_solve (low, high);
+    //
+    // Bucket boundaries are keys of the tree and every bucket knows its
+    // exact count, so only the two buckets cut by [low, high] are
+    // estimated, by interpolation for integral keys. A bucket that grows
+    // past error * size / 2 keys is split at its median, found by rank in
+    // the tree, and the histogram is rebuilt whenever the tree has doubled,
+    // which keeps |estimate - exact| <= max (error * size, 2). A rebuild
+    // leaves about 4 / error buckets; each split needs about error * size
+    // / 4 new keys, so fewer than 8 / error exist before the next rebuild.
+    // A query is two binary searches over the boundaries and two Fenwick
+    // prefix sums.
+    template<typename TreeT>
+        requires (!TreeT::is_multiset)
+    class ApproxCounter
+    {
+    private:
+        using key_type = typename TreeT::value_type;
+
+        double error_;
+        std::vector<key_type> splits_;      // bucket i > 0 starts at splits_[i - 1]
+        std::vector<size_t> counts_;        // exact keys per bucket
+        std::vector<size_t> fenwick_;       // prefix sums of counts_, 1-based
+        key_type min_ {};
+        key_type max_ {};
+        size_t size_ = 0;
+        size_t rebuilt_at_ = 0;
+
+        size_t bucket_cap() const
+        {
+            return std::max<size_t> (1, static_cast<size_t>(error_ * static_cast<double>(size_) / 2));
+        }
+
+        // upper_bound over the splits, with conditional moves instead of
+        // branches the random keys of queries would mispredict
+        size_t bucket_of (const key_type& key) const
+        {
+            const key_type* base = splits_.data();
+            size_t length = splits_.size();
+            while (length > 1)
+            {
+                size_t half = length / 2;
+                base = (key < base[half]) ? base : base + half;
+                length -= half;
+            }
+
+            return static_cast<size_t>(base - splits_.data()) + (length == 1 && !(key < *base) ? 1 : 0);
+        }
+
+        void fenwick_add (size_t bucket)
+        {
+            for (size_t i = bucket + 1; i < fenwick_.size(); i += i & (~i + 1))
+                fenwick_[i]++;
+        }
+
+        // Keys in buckets [0, end)
+        size_t prefix (size_t end) const
+        {
+            size_t sum = 0;
+            for (size_t i = end; i > 0; i -= i & (~i + 1))
+                sum += fenwick_[i];
+
+            return sum;
+        }
+
+        void rebuild_fenwick()
+        {
+            fenwick_.assign (counts_.size() + 1, 0);
+            for (size_t i = 1; i < fenwick_.size(); ++i)
+            {
+                fenwick_[i] += counts_[i - 1];
+                if (size_t parent = i + (i & (~i + 1)); parent < fenwick_.size())
+                    fenwick_[parent] += fenwick_[i];
+            }
+        }
+
+        void split (const TreeT& tree, size_t bucket)
+        {
+            size_t left = counts_[bucket] / 2;
+            key_type median = *tree.nth (prefix (bucket) + left);
+
+            splits_.insert (splits_.begin() + static_cast<std::ptrdiff_t>(bucket), median);
+            counts_.insert (counts_.begin() + static_cast<std::ptrdiff_t>(bucket) + 1, counts_[bucket] - left);
+            counts_[bucket] = left;
+            rebuild_fenwick();
+        }
+
+        // Share of bucket's keys in [low, high], which cuts the bucket. The
+        // bucket's first key is known exactly (a split, or min_ for bucket
+        // 0); the others are taken as spread evenly over the rest of it.
+        double partial (size_t bucket, const key_type& low, const key_type& high) const
+        {
+            if (counts_[bucket] == 0)
+                return 0.0;
+
+            const key_type& start = (bucket > 0) ? splits_[bucket - 1] : min_;
+            double share = (start < low || high < start) ? 0.0 : 1.0;
+            double rest = static_cast<double>(counts_[bucket] - 1);
+
+            if constexpr (std::integral<key_type>)
+            {
+                // the rest lies in [first, last]
+                double first = static_cast<double>(start) + 1.0;
+                double last = (bucket < splits_.size()) ? static_cast<double>(splits_[bucket]) - 1.0
+                                                        : static_cast<double>(max_);
+                double from = std::max (first, static_cast<double>(low));
+                double to = std::min (last, static_cast<double>(high));
+
+                if (from <= to)
+                    share += rest * (to - from + 1.0) / (last - first + 1.0);
+            }
+            else
+            {
+                share += rest / 2;
+            }
+
+            return share;
+        }
+
+    public:
+        // error is the target as a fraction of the key count, e.g. 0.01
+        explicit ApproxCounter (double error = 0.01)
+            : error_(error), counts_(1, 0), fenwick_(2, 0)
+        {
+            if (!(error > 0.0 && error < 1.0))
+                throw std::invalid_argument ("approx counter: error must be in (0, 1)");
+        }
+
+        // Resynchronises with every key of tree, after erases or inserts
+        // that bypassed add
+        void rebuild (const TreeT& tree)
+        {
+            size_ = tree.size();
+            rebuilt_at_ = size_;
+            splits_.clear();
+            counts_.assign (1, size_);
+
+            if (size_ != 0)
+            {
+                min_ = *tree.begin();
+                max_ = *tree.nth (size_ - 1);
+
+                size_t step = std::max<size_t> (1, bucket_cap() / 2);
+                size_t buckets = (size_ + step - 1) / step;
+                counts_.assign (buckets, 0);
+
+                size_t start = 0;
+                for (size_t i = 0; i < buckets; ++i)
+                {
+                    size_t end = std::min (size_, start + step);
+                    if (i > 0)
+                        splits_.push_back (*tree.nth (start));
+                    counts_[i] = end - start;
+                    start = end;
+                }
+            }
+
+            rebuild_fenwick();
+        }
+
+        // Records key, which the caller has just added to tree
+        void add (const TreeT& tree, const key_type& key)
+        {
+            if (size_ == 0 || key < min_)
+                min_ = key;
+            if (size_ == 0 || max_ < key)
+                max_ = key;
+            size_++;
+
+            if (size_ > 2 * rebuilt_at_)
+            {
+                rebuild (tree);
+                return;
+            }
+
+            size_t bucket = bucket_of (key);
+            counts_[bucket]++;
+            fenwick_add (bucket);
+
+            if (counts_[bucket] >= 2 && counts_[bucket] > bucket_cap())
+                split (tree, bucket);
+        }
+
+        // Estimated number of keys in [low, high]
+        size_t range_queries_solve (const key_type& low, const key_type& high) const
+        {
+            if (high < low || size_ == 0)
+                return 0;
+
+            size_t first = bucket_of (low);
+            size_t last = bucket_of (high);
+
+            double estimate;
+            if (first == last)
+                estimate = partial (first, low, high);
+            else
+                estimate = partial (first, low, max_) + partial (last, min_, high) +
+                           static_cast<double>(prefix (last) - prefix (first + 1));
+
+            return static_cast<size_t>(std::llround (estimate));
+        }
+
+        double error() const noexcept { return error_; }
+        size_t size() const noexcept { return size_; }
+        size_t buckets() const noexcept { return counts_.size(); }
+    }; // class ApproxCounter
+
+} // namespace rb
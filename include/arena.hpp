@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace rb
+{
+    enum class HugePages
+    {
+        NONE,
+        TRANSPARENT,        // madvise (MADV_HUGEPAGE) on regular mappings
+        EXPLICIT            // MAP_HUGETLB from the reserved pool, else TRANSPARENT
+    };
+
+    enum class NumaPolicy { DEFAULT, BIND, INTERLEAVE };
+
+    struct ArenaOptions
+    {
+        size_t chunk_size = size_t{64} << 20;   // rounded up to 2 MB
+        HugePages huge_pages = HugePages::TRANSPARENT;
+        NumaPolicy numa = NumaPolicy::DEFAULT;
+        unsigned long numa_nodes = 1;           // node bit mask for BIND / INTERLEAVE
+    };
+
+    // What the arena actually got; every request that the kernel refuses
+    // falls back silently and only shows up here
+    struct ArenaStats
+    {
+        size_t chunks = 0;
+        size_t bytes_mapped = 0;
+        size_t hugetlb_chunks = 0;      // backed by explicit huge pages
+        size_t thp_chunks = 0;          // accepted MADV_HUGEPAGE
+        size_t numa_chunks = 0;         // accepted the NUMA policy
+    };
+
+    // Bump allocator over large 2 MB aligned mappings, so that nodes
+    // allocated together share huge pages and a descent touches few TLB
+    // entries. Freed blocks go to a free list per size and are reused;
+    // memory returns to the system only when the arena is destroyed, which
+    // must happen after every container using it. Not thread-safe.
+    class NodeArena
+    {
+    private:
+        static constexpr size_t huge_page = size_t{2} << 20;
+        static constexpr size_t granule = 16;
+
+        struct FreeBlock { FreeBlock* next; };
+
+        struct Chunk
+        {
+            void* base;
+            size_t size;
+        };
+
+        ArenaOptions opts_;
+        ArenaStats stats_;
+        std::vector<Chunk> chunks_;
+        std::vector<FreeBlock*> free_lists_;    // [bytes / granule]
+        char* cursor_ = nullptr;
+        char* limit_ = nullptr;
+
+        static size_t round_up (size_t value, size_t step)
+        {
+            return (value + step - 1) / step * step;
+        }
+
+        // Regular mapping over-allocated by one huge page and trimmed, so
+        // the usable part starts on a huge page boundary
+        static void* map_aligned (size_t size)
+        {
+            size_t padded = size + huge_page;
+            void* raw = ::mmap (nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED)
+                return nullptr;
+
+            uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+            uintptr_t aligned = round_up (start, huge_page);
+            if (aligned != start)
+                ::munmap (raw, aligned - start);
+            if (uintptr_t tail = start + padded - (aligned + size); tail != 0)
+                ::munmap (reinterpret_cast<void*>(aligned + size), tail);
+
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        void* map_chunk (size_t size)
+        {
+            void* base = nullptr;
+
+#ifdef MAP_HUGETLB
+            if (opts_.huge_pages == HugePages::EXPLICIT)
+            {
+                base = ::mmap (nullptr, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (base == MAP_FAILED)
+                    base = nullptr;
+                else
+                    stats_.hugetlb_chunks++;
+            }
+#endif
+
+            bool explicit_pages = (base != nullptr);
+            if (base == nullptr)
+                base = map_aligned (size);
+            if (base == nullptr)
+                throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+            if (!explicit_pages && opts_.huge_pages != HugePages::NONE &&
+                ::madvise (base, size, MADV_HUGEPAGE) == 0)
+                stats_.thp_chunks++;
+#endif
+
+            if (opts_.numa != NumaPolicy::DEFAULT && bind_numa (base, size))
+                stats_.numa_chunks++;
+
+            stats_.chunks++;
+            stats_.bytes_mapped += size;
+
+            return base;
+        }
+
+        // mbind through the raw syscall so libnuma is not needed; fails on
+        // kernels or machines without NUMA support
+        bool bind_numa (void* base, size_t size) const
+        {
+#ifdef SYS_mbind
+            constexpr int mpol_bind = 2;
+            constexpr int mpol_interleave = 3;
+
+            int mode = (opts_.numa == NumaPolicy::BIND) ? mpol_bind : mpol_interleave;
+            unsigned long mask = opts_.numa_nodes;
+
+            return ::syscall (SYS_mbind, base, size, mode, &mask, sizeof (mask) * 8, 0) == 0;
+#else
+            (void) base;
+            (void) size;
+            return false;
+#endif
+        }
+
+        void grow (size_t at_least)
+        {
+            size_t size = round_up (std::max (opts_.chunk_size, at_least), huge_page);
+            void* base = map_chunk (size);
+            chunks_.push_back ({base, size});
+
+            cursor_ = static_cast<char*>(base);
+            limit_ = cursor_ + size;
+        }
+
+    public:
+        explicit NodeArena (const ArenaOptions& opts = {})
+            : opts_(opts) {}
+
+        NodeArena (const NodeArena&) = delete;
+        NodeArena& operator= (const NodeArena&) = delete;
+
+        ~NodeArena()
+        {
+            for (const Chunk& chunk : chunks_)
+                ::munmap (chunk.base, chunk.size);
+        }
+
+        void* allocate (size_t bytes, size_t alignment)
+        {
+            bytes = round_up (std::max (bytes, sizeof (FreeBlock)), granule);
+            size_t slot = bytes / granule;
+
+            // sized here, where the block size is first seen, so that
+            // deallocate never allocates
+            if (slot >= free_lists_.size())
+                free_lists_.resize (slot + 1, nullptr);
+
+            if (alignment <= granule && free_lists_[slot] != nullptr)
+            {
+                FreeBlock* block = free_lists_[slot];
+                free_lists_[slot] = block->next;
+                return block;
+            }
+
+            alignment = std::max (alignment, granule);
+            char* start = reinterpret_cast<char*>(round_up (reinterpret_cast<uintptr_t>(cursor_), alignment));
+            if (cursor_ == nullptr || start + bytes > limit_)
+            {
+                grow (bytes + alignment);
+                start = reinterpret_cast<char*>(round_up (reinterpret_cast<uintptr_t>(cursor_), alignment));
+            }
+
+            cursor_ = start + bytes;
+            return start;
+        }
+
+        void deallocate (void* ptr, size_t bytes) noexcept
+        {
+            bytes = round_up (std::max (bytes, sizeof (FreeBlock)), granule);
+            size_t slot = bytes / granule;
+
+            FreeBlock* block = static_cast<FreeBlock*>(ptr);
+            block->next = free_lists_[slot];
+            free_lists_[slot] = block;
+        }
+
+        const ArenaStats& stats() const noexcept { return stats_; }
+        const ArenaOptions& options() const noexcept { return opts_; }
+    }; // class NodeArena
+
+    // Standard allocator handle to a NodeArena, for rb::Tree's Alloc
+    // parameter:
+    //
+    //   rb::NodeArena arena ({.huge_pages = rb::HugePages::EXPLICIT});
+    //   rb::Tree<int, rb::NoAggregate, rb::UniqueKeys, rb::ArenaAllocator<int>> tree (arena);
+    template<typename T>
+    class ArenaAllocator
+    {
+    private:
+        NodeArena* arena_;
+
+        template<typename> friend class ArenaAllocator;
+
+    public:
+        using value_type = T;
+
+        ArenaAllocator (NodeArena& arena) noexcept : arena_(&arena) {}
+
+        template<typename U>
+        ArenaAllocator (const ArenaAllocator<U>& oth) noexcept : arena_(oth.arena_) {}
+
+        T* allocate (size_t n)
+        {
+            return static_cast<T*>(arena_->allocate (n * sizeof (T), alignof (T)));
+        }
+
+        void deallocate (T* ptr, size_t n) noexcept
+        {
+            arena_->deallocate (ptr, n * sizeof (T));
+        }
+
+        NodeArena& arena() const noexcept { return *arena_; }
+
+        template<typename U>
+        bool operator== (const ArenaAllocator<U>& oth) const noexcept { return arena_ == oth.arena_; }
+    }; // class ArenaAllocator
+
+} // namespace rb
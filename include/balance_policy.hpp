@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+namespace rb
+{
+    // Rebalancing scheme of rb::Tree. The container, iterators and subtree
+    // size augmentation are shared; only the per-node balance state and the
+    // fix-ups after insert and erase differ.
+    struct RedBlack {};     // colour per node, at most 2 log n high, O(1) rotations per update
+    struct Avl {};          // height per node, at most 1.44 log n high
+    struct Wavl {};         // rank per node, AVL shape until erases, O(1) rotations per update
+    struct Treap {};        // random priority per node, expected O(log n) depth
+
+    template<typename B>
+    concept BalancePolicy = std::is_same_v<B, RedBlack> || std::is_same_v<B, Avl> ||
+                            std::is_same_v<B, Wavl> || std::is_same_v<B, Treap>;
+
+    struct NoBalanceState {};
+
+    // RedBlack keeps using the node colour; AVL heights and WAVL ranks stay
+    // below 128 for any tree that fits in memory
+    template<typename B>
+    using balance_state_t = std::conditional_t<std::is_same_v<B, Treap>, uint32_t,
+                            std::conditional_t<std::is_same_v<B, RedBlack>, NoBalanceState, int8_t>>;
+
+    // Treap priorities: splitmix64 per thread, fixed seed so runs repeat
+    inline uint32_t treap_priority() noexcept
+    {
+        thread_local uint64_t state = 0x9E3779B97F4A7C15ull;
+
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+
+        return static_cast<uint32_t>((z ^ (z >> 31)) >> 32);
+    }
+
+} // namespace rb
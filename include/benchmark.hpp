@@ -5,6 +5,13 @@
 #include <sstream>
 #include <chrono>
 #include <utility>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace benchmark
 {
@@ -87,9 +94,91 @@ namespace benchmark
         }
     };
 
+    // dTLB load accesses and misses of this process in user space, through
+    // perf_event_open; available() is false where the kernel or the VM
+    // exposes no such counters
+    class TlbCounters
+    {
+    private:
+        int accesses_fd_ = -1;
+        int misses_fd_ = -1;
+
+        static int open_counter (uint64_t result)
+        {
+            perf_event_attr attr;
+            std::memset (&attr, 0, sizeof (attr));
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.size = sizeof (attr);
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            return static_cast<int>(::syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        static uint64_t read_counter (int fd)
+        {
+            uint64_t value = 0;
+            if (fd >= 0 && ::read (fd, &value, sizeof (value)) != sizeof (value))
+                value = 0;
+
+            return value;
+        }
+
+    public:
+        TlbCounters()
+            : accesses_fd_(open_counter (PERF_COUNT_HW_CACHE_RESULT_ACCESS)),
+              misses_fd_(open_counter (PERF_COUNT_HW_CACHE_RESULT_MISS)) {}
+
+        TlbCounters (const TlbCounters&) = delete;
+        TlbCounters& operator= (const TlbCounters&) = delete;
+
+        ~TlbCounters()
+        {
+            if (accesses_fd_ >= 0)
+                ::close (accesses_fd_);
+            if (misses_fd_ >= 0)
+                ::close (misses_fd_);
+        }
+
+        bool available() const { return accesses_fd_ >= 0 && misses_fd_ >= 0; }
+
+        void start()
+        {
+            for (int fd : {accesses_fd_, misses_fd_})
+            {
+                if (fd < 0)
+                    continue;
+                ::ioctl (fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl (fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+
+        void stop()
+        {
+            for (int fd : {accesses_fd_, misses_fd_})
+                if (fd >= 0)
+                    ::ioctl (fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+
+        uint64_t accesses() const { return read_counter (accesses_fd_); }
+        uint64_t misses() const { return read_counter (misses_fd_); }
+
+        double miss_rate() const
+        {
+            uint64_t total = accesses();
+            return total ? static_cast<double>(misses()) / static_cast<double>(total) : 0.0;
+        }
+    };
+
     template <typename TreeAdapter>
-    long long run_benchmark (const std::vector<Command>& commands, TreeAdapter& adapter)
+    long long run_benchmark (const std::vector<Command>& commands, TreeAdapter& adapter,
+                             TlbCounters* tlb = nullptr)
     {
+        if (tlb != nullptr)
+            tlb->start();
+
         auto start = std::chrono::high_resolution_clock::now();
 
         for (const auto& cmd : commands)
@@ -106,6 +195,10 @@ namespace benchmark
         }
 
         auto end = std::chrono::high_resolution_clock::now();
+
+        if (tlb != nullptr)
+            tlb->stop();
+
         return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
     }
 
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+namespace rb
+{
+    enum class DumpFormat { DOT, JSON };
+
+    template<typename T>
+    struct DumpOptions
+    {
+        DumpFormat format = DumpFormat::DOT;
+
+        std::optional<T> low;               // only nodes with keys in [low, high] are drawn,
+        std::optional<T> high;              // ancestors outside it are shown as elided stubs
+
+        size_t max_depth = std::numeric_limits<size_t>::max();  // deeper subtrees collapse
+        bool stats_only = false;            // write ShapeStats instead of the nodes
+
+        size_t buffer_size = 1 << 20;       // output file buffer
+    };
+
+    struct ShapeStats
+    {
+        size_t size = 0;                    // elements, counting multiset copies
+        size_t nodes = 0;                   // distinct keys
+        size_t height = 0;                  // nodes on the longest root-to-leaf path
+        size_t black_height = 0;            // black nodes on the leftmost path
+        size_t red_nodes = 0;
+        double avg_depth = 0.0;
+
+        std::vector<size_t> nodes_per_depth;
+        std::vector<size_t> subtree_size_log2;  // [i]: nodes with subtree size in [2^i, 2^(i+1))
+    };
+
+    inline void write_counts_json (std::ostream& out, const std::vector<size_t>& counts)
+    {
+        out << "[";
+        for (size_t i = 0; i < counts.size(); ++i)
+            out << (i ? ", " : "") << counts[i];
+        out << "]";
+    }
+
+    inline void write_stats_json (std::ostream& out, const ShapeStats& stats)
+    {
+        out << "{\n"
+            << "  \"size\": " << stats.size << ",\n"
+            << "  \"nodes\": " << stats.nodes << ",\n"
+            << "  \"height\": " << stats.height << ",\n"
+            << "  \"black_height\": " << stats.black_height << ",\n"
+            << "  \"red_nodes\": " << stats.red_nodes << ",\n"
+            << "  \"avg_depth\": " << stats.avg_depth << ",\n"
+            << "  \"nodes_per_depth\": ";
+        write_counts_json (out, stats.nodes_per_depth);
+        out << ",\n  \"subtree_size_log2\": ";
+        write_counts_json (out, stats.subtree_size_log2);
+        out << "\n}\n";
+    }
+
+    inline void write_stats_dot (std::ostream& out, const ShapeStats& stats)
+    {
+        out << "digraph RBTree {\n"
+            << "    \"stats\" [shape=box, fontname=\"Arial\", label=\""
+            << "size = " << stats.size << "\\l"
+            << "nodes = " << stats.nodes << "\\l"
+            << "height = " << stats.height << "\\l"
+            << "black height = " << stats.black_height << "\\l"
+            << "red nodes = " << stats.red_nodes << "\\l"
+            << "avg depth = " << stats.avg_depth << "\\l"
+            << "nodes per depth:";
+
+        for (size_t depth = 0; depth < stats.nodes_per_depth.size(); ++depth)
+            out << (depth % 8 == 0 ? "\\l  " : " ") << stats.nodes_per_depth[depth];
+
+        out << "\\l\"];\n}\n";
+    }
+
+} // namespace rb
@@ -0,0 +1,399 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace rb
+{
+    // Hierarchical timing wheel over integer ticks (Varghese, Lauck): level
+    // l has 64 slots of 64^l ticks. An item goes to the level of the
+    // highest 6-bit digit in which its deadline differs from now, and moves
+    // one level down each time the clock reaches the start of its slot, so
+    // every item is touched O(levels) times in total and advancing the
+    // clock skips straight over empty stretches.
+    template<typename Item>
+    class TimingWheel
+    {
+    private:
+        static constexpr size_t slot_bits = 6;
+        static constexpr size_t slots = size_t{1} << slot_bits;
+        static constexpr size_t levels = (64 + slot_bits - 1) / slot_bits;
+
+        struct Timer
+        {
+            Item item;
+            uint64_t deadline;
+        };
+
+        std::array<std::array<std::vector<Timer>, slots>, levels> wheel_;
+        std::array<size_t, levels> per_level_ {};
+        uint64_t now_ = 0;
+        size_t size_ = 0;
+
+        static size_t slot_of (uint64_t deadline, size_t level)
+        {
+            return static_cast<size_t>(deadline >> (level * slot_bits)) & (slots - 1);
+        }
+
+        // A deadline equal to now_ (met while cascading) lands in the slot
+        // that fires at the end of this tick
+        void place (Timer&& timer)
+        {
+            uint64_t differs = timer.deadline ^ now_;
+            size_t level = differs ? static_cast<size_t>(63 - std::countl_zero (differs)) / slot_bits : 0;
+            wheel_[level][slot_of (timer.deadline, level)].push_back (std::move (timer));
+            per_level_[level]++;
+        }
+
+        template<typename Fire>
+        void tick (Fire& fire)
+        {
+            ++now_;
+
+            // Levels whose slot starts now hand their items down, the
+            // highest first so they can cascade through several levels
+            size_t top = 0;
+            while (top + 1 < levels && (now_ & ((uint64_t{1} << ((top + 1) * slot_bits)) - 1)) == 0)
+                ++top;
+
+            for (size_t level = top; level >= 1; --level)
+            {
+                std::vector<Timer> due;
+                due.swap (wheel_[level][slot_of (now_, level)]);
+                per_level_[level] -= due.size();
+
+                for (Timer& timer : due)
+                    place (std::move (timer));
+            }
+
+            std::vector<Timer> due;
+            due.swap (wheel_[0][slot_of (now_, 0)]);
+            per_level_[0] -= due.size();
+            size_ -= due.size();
+
+            for (Timer& timer : due)
+                fire (timer.item, timer.deadline);
+        }
+
+    public:
+        explicit TimingWheel (uint64_t now = 0)
+            : now_(now) {}
+
+        uint64_t now() const noexcept { return now_; }
+        size_t size() const noexcept { return size_; }
+
+        // Returns false, scheduling nothing, when deadline is not in the future
+        bool schedule (const Item& item, uint64_t deadline)
+        {
+            if (deadline <= now_)
+                return false;
+
+            place ({item, deadline});
+            size_++;
+
+            return true;
+        }
+
+        // Drops every pending timer for which keep (item, deadline) is
+        // false, in one pass over the slots
+        template<typename Keep>
+        void purge (Keep&& keep)
+        {
+            for (size_t level = 0; level < levels; ++level)
+                for (std::vector<Timer>& slot : wheel_[level])
+                {
+                    size_t dropped = std::erase_if (slot, [&](const Timer& timer)
+                    {
+                        return !keep (timer.item, timer.deadline);
+                    });
+                    per_level_[level] -= dropped;
+                    size_ -= dropped;
+                }
+        }
+
+        // Moves the clock to now, calling fire (item, deadline) for every
+        // item whose deadline has come, in deadline order
+        template<typename Fire>
+        void advance (uint64_t now, Fire&& fire)
+        {
+            while (now_ < now)
+            {
+                size_t lowest = 0;
+                while (lowest < levels && per_level_[lowest] == 0)
+                    ++lowest;
+
+                if (lowest == levels)
+                {
+                    now_ = now;
+                    return;
+                }
+
+                // Nothing below level `lowest` can fire before the next
+                // boundary of its slots
+                if (lowest > 0)
+                {
+                    uint64_t span = uint64_t{1} << (lowest * slot_bits);
+                    uint64_t before_boundary = now_ | (span - 1);
+                    if (before_boundary >= now)
+                    {
+                        now_ = now;
+                        return;
+                    }
+                    now_ = before_boundary;
+                }
+
+                tick (fire);
+            }
+        }
+    }; // class TimingWheel
+
+    enum class Eviction
+    {
+        OLDEST,             // the least recently inserted key
+        SMALLEST_KEY
+    };
+
+    struct ExpiryOptions
+    {
+        size_t capacity = 0;                    // 0 = unbounded
+        Eviction eviction = Eviction::OLDEST;
+    };
+
+    struct ExpiryStats
+    {
+        size_t expired = 0;
+        size_t evicted = 0;
+    };
+
+    // Unique keys with optional expiry times and an optional capacity, over
+    // any rb::Tree. Time is in caller-chosen integer ticks (e.g. ms) and
+    // moves forward through the now arguments; every key whose deadline is
+    // at or before now has left the tree before a query at now is answered.
+    // Expired keys leave through the timing wheel in batches and evicted
+    // ones through an insertion-order queue (kept only for OLDEST eviction
+    // under a capacity). A refresh or removal leaves the key's old timer
+    // behind; once such stale timers outnumber the live keys the wheel is
+    // purged of them, so timers stay near 2 * size() + 64 and memory
+    // follows the live key count however long the tree runs.
+    template<typename TreeT>
+        requires (!TreeT::is_multiset)
+    class ExpiringTree
+    {
+    public:
+        using key_type = typename TreeT::value_type;
+
+        static constexpr uint64_t never = std::numeric_limits<uint64_t>::max();
+
+    private:
+        struct Meta
+        {
+            uint64_t deadline;
+            uint64_t sequence;      // insertion order, for OLDEST eviction
+        };
+
+        struct Arrival
+        {
+            key_type key;
+            uint64_t sequence;
+        };
+
+        TreeT tree_;
+        ExpiryOptions opts_;
+        ExpiryStats stats_;
+        std::unordered_map<key_type, Meta> meta_;
+        TimingWheel<key_type> wheel_;
+        std::deque<Arrival> arrivals_;          // stale entries are skipped and trimmed
+        uint64_t next_sequence_ = 0;
+        size_t stale_timers_ = 0;               // timers of refreshed or removed keys
+
+        bool is_current (const key_type& key, uint64_t deadline) const
+        {
+            auto it = meta_.find (key);
+            return it != meta_.end() && it->second.deadline == deadline;
+        }
+
+        // Counts the timer a key leaves behind, purging once stale ones
+        // make up most of the wheel
+        void supersede_timer (uint64_t deadline)
+        {
+            if (deadline == never)
+                return;
+
+            if (++stale_timers_ > meta_.size() + 64)
+            {
+                wheel_.purge ([&](const key_type& key, uint64_t due) { return is_current (key, due); });
+                stale_timers_ = 0;
+            }
+        }
+
+        void remove (const key_type& key)
+        {
+            auto it = meta_.find (key);
+            uint64_t deadline = it->second.deadline;
+
+            tree_.erase (key);
+            meta_.erase (it);
+            supersede_timer (deadline);
+        }
+
+        // Only OLDEST eviction under a capacity needs the insertion order
+        bool tracks_arrivals() const
+        {
+            return opts_.capacity != 0 && opts_.eviction == Eviction::OLDEST;
+        }
+
+        bool is_current (const Arrival& arrival) const
+        {
+            auto it = meta_.find (arrival.key);
+            return it != meta_.end() && it->second.sequence == arrival.sequence;
+        }
+
+        // Drops stale arrivals from the front, and rebuilds the queue once
+        // stale ones make up most of it, so it stays O(size())
+        void trim_arrivals()
+        {
+            while (!arrivals_.empty() && !is_current (arrivals_.front()))
+                arrivals_.pop_front();
+
+            if (arrivals_.size() > 2 * meta_.size() + 64)
+            {
+                std::deque<Arrival> live;
+                for (const Arrival& arrival : arrivals_)
+                    if (is_current (arrival))
+                        live.push_back (arrival);
+                arrivals_.swap (live);
+            }
+        }
+
+        void evict_one()
+        {
+            if (opts_.eviction == Eviction::SMALLEST_KEY)
+            {
+                key_type smallest = *tree_.begin();
+                remove (smallest);
+            }
+            else
+            {
+                trim_arrivals();
+                key_type oldest = arrivals_.front().key;
+                arrivals_.pop_front();
+                remove (oldest);
+            }
+
+            stats_.evicted++;
+        }
+
+    public:
+        explicit ExpiringTree (const ExpiryOptions& opts = {}, uint64_t now = 0)
+            : opts_(opts), wheel_(now) {}
+
+        // Inserts key, or refreshes its deadline and insertion order when it
+        // is present. A deadline at or before now inserts nothing, and
+        // expires key at once when it is present.
+        void insert (const key_type& key, uint64_t now, uint64_t deadline = never)
+        {
+            advance (now);
+            if (deadline <= wheel_.now())
+            {
+                if (meta_.find (key) != meta_.end())
+                {
+                    remove (key);
+                    stats_.expired++;
+                    trim_arrivals();
+                }
+                return;
+            }
+
+            uint64_t sequence = next_sequence_++;
+            auto [it, added] = meta_.try_emplace (key, Meta {deadline, sequence});
+            if (!added)
+            {
+                uint64_t old_deadline = it->second.deadline;
+                it->second = {deadline, sequence};
+                supersede_timer (old_deadline);
+            }
+            else
+                tree_.insert (key);
+
+            if (deadline != never)
+                wheel_.schedule (key, deadline);
+            if (tracks_arrivals())
+                arrivals_.push_back ({key, sequence});
+
+            if (opts_.capacity != 0 && meta_.size() > opts_.capacity)
+                evict_one();
+
+            trim_arrivals();
+        }
+
+        bool erase (const key_type& key)
+        {
+            if (meta_.find (key) == meta_.end())
+                return false;
+
+            remove (key);
+            trim_arrivals();
+
+            return true;
+        }
+
+        // Expires every key with a deadline at or before now
+        void advance (uint64_t now)
+        {
+            if (now <= wheel_.now())
+                return;
+
+            // a refreshed or removed key leaves its old timer, which no
+            // longer matches
+            wheel_.advance (now, [&](const key_type& key, uint64_t deadline)
+            {
+                auto it = meta_.find (key);
+                if (it == meta_.end() || it->second.deadline != deadline)
+                {
+                    --stale_timers_;
+                    return;
+                }
+
+                tree_.erase (key);
+                meta_.erase (it);
+                stats_.expired++;
+            });
+
+            trim_arrivals();
+        }
+
+        size_t range_queries_solve (const key_type& low, const key_type& high, uint64_t now)
+        {
+            advance (now);
+            return tree_.range_queries_solve (low, high);
+        }
+
+        bool contains (const key_type& key, uint64_t now)
+        {
+            advance (now);
+            return tree_.contains (key);
+        }
+
+        // Keys as of the last now seen
+        const TreeT& tree() const noexcept { return tree_; }
+        size_t size() const noexcept { return tree_.size(); }
+        uint64_t now() const noexcept { return wheel_.now(); }
+
+        const ExpiryStats& stats() const noexcept { return stats_; }
+
+        // Pending timers (refreshed keys leave stale ones until they fire
+        // or are purged) and queued arrivals, to check that bookkeeping
+        // stays bounded
+        size_t timers() const noexcept { return wheel_.size(); }
+        size_t arrivals() const noexcept { return arrivals_.size(); }
+    }; // class ExpiringTree
+
+} // namespace rb
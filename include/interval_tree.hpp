@@ -0,0 +1,194 @@
+#pragma once
+
+#include "rbtree.hpp"
+#include "aggregate.hpp"
+
+#include <compare>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+namespace rb
+{
+    template<typename K>
+    struct Interval
+    {
+        K start;
+        K end;          // inclusive
+
+        auto operator<=> (const Interval&) const = default;
+
+        bool overlaps (const K& low, const K& high) const
+        {
+            return !(high < start) && !(end < low);
+        }
+
+        friend std::ostream& operator<< (std::ostream& out, const Interval& interval)
+        {
+            return out << "[" << interval.start << ", " << interval.end << "]";
+        }
+    };
+
+    // Max and min interval end over a subtree: max_end prunes subtrees with
+    // nothing reaching the query, min_end lets a subtree that certainly
+    // overlaps be counted from its size without being entered
+    template<typename K>
+    struct IntervalAggregate
+    {
+        struct value_type
+        {
+            K max_end;
+            K min_end;
+
+            bool operator== (const value_type&) const = default;
+        };
+
+        static value_type identity()
+        {
+            return {std::numeric_limits<K>::lowest(), std::numeric_limits<K>::max()};
+        }
+
+        static value_type lift (const Interval<K>& interval)
+        {
+            return {interval.end, interval.end};
+        }
+
+        static value_type combine (const value_type& lhs, const value_type& rhs)
+        {
+            return {std::max (lhs.max_end, rhs.max_end), std::min (lhs.min_end, rhs.min_end)};
+        }
+    };
+
+    // Closed intervals keyed by (start, end) on top of rb::Tree. Equal
+    // intervals share a node with a copy count, and every count and visit
+    // below takes each copy into account.
+    template<typename K>
+    class IntervalTree
+    {
+    private:
+        using Base = Tree<Interval<K>, IntervalAggregate<K>, MultiKeys>;
+        using Node = typename Base::Node;
+
+        struct Frame
+        {
+            const Node* node;
+            bool starts_in_range;   // every start in the subtree is <= high
+        };
+
+        Base tree_;
+
+    public:
+        using value_type = Interval<K>;
+
+        // Intervals with end < start are ignored, like q with low > high
+        void insert (const K& start, const K& end)
+        {
+            if (end < start)
+                return;
+
+            tree_.insert ({start, end});
+        }
+
+        bool  empty() const noexcept { return tree_.empty(); }
+        size_t size() const noexcept { return tree_.size(); }
+
+        const Base& tree() const noexcept { return tree_; }
+
+        // Number of stored intervals intersecting [low, high]
+        size_t overlap_count (const K& low, const K& high) const
+        {
+            if (high < low)
+                return 0;
+
+            size_t count = 0;
+            walk (low, high, [&](const Frame& frame)
+            {
+                // Whole subtree overlaps: all starts <= high, all ends >= low
+                if (frame.starts_in_range && !(frame.node->aggregate().min_end < low))
+                {
+                    count += frame.node->subtree_size();
+                    return false;
+                }
+
+                if (frame.node->data().overlaps (low, high))
+                    count += frame.node->count();
+                return true;
+            });
+
+            return count;
+        }
+
+        size_t stab_count (const K& point) const
+        {
+            return overlap_count (point, point);
+        }
+
+        template<typename Fn>
+        void for_each_overlap (const K& low, const K& high, Fn&& fn) const
+        {
+            if (high < low)
+                return;
+
+            walk (low, high, [&](const Frame& frame)
+            {
+                if (frame.node->data().overlaps (low, high))
+                    for (size_t copy = 0; copy < frame.node->count(); ++copy)
+                        fn (frame.node->data());
+
+                return true;
+            });
+        }
+
+        std::vector<Interval<K>> overlaps (const K& low, const K& high) const
+        {
+            std::vector<Interval<K>> result;
+            for_each_overlap (low, high, [&](const Interval<K>& interval)
+            {
+                result.push_back (interval);
+            });
+
+            return result;
+        }
+
+        // Intervals containing point
+        std::vector<Interval<K>> stab (const K& point) const
+        {
+            return overlaps (point, point);
+        }
+
+    private:
+        // Visits, with an explicit stack, the subtrees that may hold an
+        // interval overlapping [low, high]: subtrees whose max_end < low and
+        // right subtrees of nodes starting after high are never entered.
+        // visit returns false to skip the children of the current node.
+        template<typename Visit>
+        void walk (const K& low, const K& high, Visit&& visit) const
+        {
+            std::vector<Frame> stack;
+            if (tree_.root_ != nullptr)
+                stack.push_back ({tree_.root_, false});
+
+            while (!stack.empty())
+            {
+                Frame frame = stack.back();
+                stack.pop_back();
+
+                const Node* node = frame.node;
+                if (node->aggregate().max_end < low)
+                    continue;
+
+                if (!visit (frame))
+                    continue;
+
+                bool node_starts_in_range = !(high < node->data().start);
+
+                if (node->right() != nullptr && node_starts_in_range)
+                    stack.push_back ({node->right(), frame.starts_in_range});
+
+                if (node->left() != nullptr)
+                    stack.push_back ({node->left(), frame.starts_in_range || node_starts_in_range});
+            }
+        }
+    }; // class IntervalTree
+
+} // namespace rb
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+namespace rb
+{
+    // Duplicate handling of rb::Tree
+    struct UniqueKeys {};   // duplicate inserts are ignored (std::set)
+    struct MultiKeys {};    // duplicates bump a per-node count (std::multiset), no extra nodes
+
+    template<typename K>
+    concept KeyPolicy = std::is_same_v<K, UniqueKeys> || std::is_same_v<K, MultiKeys>;
+
+    template<typename K>
+    constexpr bool is_multi_v = std::is_same_v<K, MultiKeys>;
+
+    struct NoCount {};
+
+    template<typename K>
+    using key_count_t = std::conditional_t<is_multi_v<K>, size_t, NoCount>;
+
+} // namespace rb
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace rb
+{
+    // Order in which Tree::compact places the nodes in memory
+    enum class Layout
+    {
+        PREORDER,       // a node, then its left subtree, then its right subtree
+        VEB             // van Emde Boas: the top half of the levels, then each
+                        // subtree hanging below them, recursively
+    };
+
+} // namespace rb
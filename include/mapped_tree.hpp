@@ -0,0 +1,627 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <iterator>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rb
+{
+    // Red-black tree whose nodes live in a memory-mapped file (POSIX only).
+    //
+    // Links are node indices into the mapped node array instead of pointers,
+    // so the file can be remapped at a different address when it grows and
+    // reopened later by mapping it and reading the root index from the header.
+    // Index 0 is reserved as NIL. Keys must be trivially copyable.
+    //
+    // This is a separate class rather than a storage mode of rb::Tree: Tree
+    // links nodes by pointer and allocates them through its allocator, and
+    // its insert finger is a node pointer too, so none of it survives a
+    // remap or a reopen. MappedTree keeps unique keys and offers insert,
+    // contains, count, lower_bound, upper_bound, iteration, size and
+    // range_queries_solve, plus sync to flush the mapping. There is no
+    // erase, aggregate or multiset support.
+    template<typename T>
+    class MappedTree
+    {
+        static_assert (std::is_trivially_copyable_v<T>,
+                       "MappedTree stores keys in raw file pages; T must be trivially copyable");
+
+    private:
+        using index_t = uint64_t;
+        static constexpr index_t NIL = 0;
+
+        static constexpr char     MAGIC[4] = {'R', 'B', 'T', 'M'};
+        static constexpr uint32_t VERSION  = 1;
+        static constexpr index_t  INITIAL_CAPACITY = 1024;
+
+        enum class Color : uint8_t { RED, BLACK };
+
+        struct Node
+        {
+            T data;
+            index_t left;
+            index_t right;
+            index_t parent;
+            uint64_t subtree_size;
+            Color color;
+        };
+
+        struct alignas (64) Header
+        {
+            char     magic[4];
+            uint32_t version;
+            uint32_t elem_size;
+            uint32_t node_size;
+            index_t  root;
+            uint64_t size;
+            index_t  used;      // nodes handed out, including NIL slot 0
+            index_t  capacity;  // node slots backed by the file
+        };
+
+        enum class Dir { LEFT, RIGHT };
+        enum class BoundType { LOWER, UPPER };
+
+        std::string path_;
+        int fd_ = -1;
+        unsigned char* base_ = nullptr;
+        size_t mapped_bytes_ = 0;
+
+    public:
+        class Iterator
+        {
+        private:
+            Iterator (const MappedTree* owner, index_t current)
+                : owner_(owner), curr_(current) {}
+
+            const MappedTree* owner_ = nullptr;
+            index_t curr_ = NIL;
+
+        public:
+            // ==== Type Traits ==== //
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using reference = const T&;
+            using pointer = const T*;
+            using iterator_category = std::bidirectional_iterator_tag;
+            // ===================== //
+
+            Iterator() = default;
+
+            reference operator*() const
+            {
+                assert (curr_ != NIL);
+                return owner_->node (curr_).data;
+            }
+
+            pointer operator->() const
+            {
+                return &(*(*this));
+            }
+
+            Iterator& operator++()
+            {
+                assert (curr_ != NIL);
+                curr_ = owner_->next_node (curr_);
+
+                return *this;
+            }
+
+            Iterator operator++ (int)
+            {
+                Iterator dumb = *this;
+                ++(*this);
+
+                return dumb;
+            }
+
+            Iterator& operator--()
+            {
+                curr_ = (curr_ != NIL) ? owner_->prev_node (curr_)
+                                       : owner_->max_node (owner_->header().root);
+                assert (curr_ != NIL);
+
+                return *this;
+            }
+
+            Iterator operator-- (int)
+            {
+                Iterator dumb = *this;
+                --(*this);
+
+                return dumb;
+            }
+
+            bool operator== (const Iterator& rht_sd) const
+            {
+                assert (owner_ == rht_sd.owner_);
+                return curr_ == rht_sd.curr_;
+            }
+
+            bool operator!= (const Iterator& rht_sd) const
+            {
+                return !(*this == rht_sd);
+            }
+
+            friend class MappedTree;
+        }; // class Iterator
+
+        using iterator = Iterator;
+        using const_iterator = Iterator;
+        using value_type = T;
+
+        // Opens an existing tree file or creates an empty one. Reopening only
+        // maps the file and validates the header, whatever the tree size.
+        explicit MappedTree (const std::string& path) : path_(path)
+        {
+            fd_ = ::open (path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd_ < 0)
+                throw std::runtime_error ("mapped tree: cannot open " + path);
+
+            // The destructor does not run for a throwing constructor
+            try
+            {
+                struct stat st;
+                if (::fstat (fd_, &st) != 0)
+                    throw std::runtime_error ("mapped tree: cannot stat " + path);
+
+                if (st.st_size == 0)
+                {
+                    init_file();
+                    return;
+                }
+
+                if (static_cast<size_t>(st.st_size) < sizeof (Header))
+                    throw std::runtime_error ("mapped tree: file too short: " + path);
+
+                map (static_cast<size_t>(st.st_size));
+                check_header();
+            }
+            catch (...)
+            {
+                unmap();
+                ::close (fd_);
+                throw;
+            }
+        }
+
+        ~MappedTree()
+        {
+            unmap();
+            if (fd_ >= 0)
+                ::close (fd_);
+        }
+
+        MappedTree (const MappedTree&) = delete;
+        MappedTree& operator= (const MappedTree&) = delete;
+
+        MappedTree (MappedTree&& oth) noexcept
+            : path_(std::move (oth.path_)), fd_(oth.fd_),
+              base_(oth.base_), mapped_bytes_(oth.mapped_bytes_)
+        {
+            oth.fd_ = -1;
+            oth.base_ = nullptr;
+            oth.mapped_bytes_ = 0;
+        }
+
+        Iterator begin() const
+        {
+            return Iterator (this, min_node (header().root));
+        }
+
+        Iterator end() const
+        {
+            return Iterator (this, NIL);
+        }
+
+        Iterator lower_bound (const T& key) const
+        {
+            return Iterator (this, find_bound (key, BoundType::LOWER));
+        }
+
+        Iterator upper_bound (const T& key) const
+        {
+            return Iterator (this, find_bound (key, BoundType::UPPER));
+        }
+
+        size_t range_queries_solve (const T& low, const T& high) const
+        {
+            if (low > high)
+                return 0;
+
+            return rank (high, BoundType::UPPER) - rank (low, BoundType::LOWER);
+        }
+
+        bool  empty() const noexcept { return header().size == 0; }
+        size_t size() const noexcept { return static_cast<size_t>(header().size); }
+
+        const std::string& path() const noexcept { return path_; }
+
+        bool contains (const T& key) const
+        {
+            index_t bound = find_bound (key, BoundType::LOWER);
+            return bound != NIL && !(key < node (bound).data);
+        }
+
+        size_t count (const T& key) const { return contains (key) ? 1 : 0; }
+
+        // Returns false when key is already present
+        bool insert (const T& data)
+        {
+            index_t new_node = insert_data (data);
+            if (new_node == NIL)
+                return false;
+
+            fix_insert (new_node);
+            update_sizes (new_node);
+
+            return true;
+        }
+
+        // Checkpoint: blocks until every dirty page has reached the file
+        void sync() const
+        {
+            if (::msync (base_, mapped_bytes_, MS_SYNC) != 0)
+                throw std::runtime_error ("mapped tree: msync failed for " + path_);
+        }
+
+    private:
+        static size_t bytes_for (index_t capacity)
+        {
+            return sizeof (Header) + static_cast<size_t>(capacity) * sizeof (Node);
+        }
+
+        Header& header() { return *reinterpret_cast<Header*>(base_); }
+        const Header& header() const { return *reinterpret_cast<const Header*>(base_); }
+
+        Node& node (index_t idx)
+        {
+            return reinterpret_cast<Node*>(base_ + sizeof (Header))[idx];
+        }
+
+        const Node& node (index_t idx) const
+        {
+            return reinterpret_cast<const Node*>(base_ + sizeof (Header))[idx];
+        }
+
+        void init_file()
+        {
+            resize_file (bytes_for (INITIAL_CAPACITY));
+            map (bytes_for (INITIAL_CAPACITY));
+
+            Header& hdr = header();
+            std::memcpy (hdr.magic, MAGIC, sizeof (MAGIC));
+            hdr.version = VERSION;
+            hdr.elem_size = static_cast<uint32_t>(sizeof (T));
+            hdr.node_size = static_cast<uint32_t>(sizeof (Node));
+            hdr.root = NIL;
+            hdr.size = 0;
+            hdr.used = 1;
+            hdr.capacity = INITIAL_CAPACITY;
+        }
+
+        void check_header() const
+        {
+            const Header& hdr = header();
+
+            if (std::memcmp (hdr.magic, MAGIC, sizeof (MAGIC)) != 0 || hdr.version != VERSION)
+                throw std::runtime_error ("mapped tree: bad header in " + path_);
+
+            if (hdr.elem_size != sizeof (T) || hdr.node_size != sizeof (Node))
+                throw std::runtime_error ("mapped tree: key type mismatch in " + path_);
+
+            if (bytes_for (hdr.capacity) > mapped_bytes_ || hdr.used > hdr.capacity)
+                throw std::runtime_error ("mapped tree: truncated file " + path_);
+        }
+
+        void resize_file (size_t bytes)
+        {
+            if (::ftruncate (fd_, static_cast<off_t>(bytes)) != 0)
+                throw std::runtime_error ("mapped tree: cannot grow " + path_);
+        }
+
+        void map (size_t bytes)
+        {
+            void* addr = ::mmap (nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (addr == MAP_FAILED)
+                throw std::runtime_error ("mapped tree: mmap failed for " + path_);
+
+            base_ = static_cast<unsigned char*>(addr);
+            mapped_bytes_ = bytes;
+        }
+
+        void unmap() noexcept
+        {
+            if (base_ != nullptr)
+                ::munmap (base_, mapped_bytes_);
+
+            base_ = nullptr;
+            mapped_bytes_ = 0;
+        }
+
+        // Doubles the node capacity. Invalidates every Node& taken before.
+        void grow()
+        {
+            index_t new_capacity = header().capacity * 2;
+            size_t new_bytes = bytes_for (new_capacity);
+
+            resize_file (new_bytes);
+            unmap();
+            map (new_bytes);
+
+            header().capacity = new_capacity;
+        }
+
+        index_t allocate_node (const T& data)
+        {
+            if (header().used == header().capacity)
+                grow();
+
+            index_t idx = header().used++;
+
+            Node& fresh = node (idx);
+            fresh.data = data;
+            fresh.left = NIL;
+            fresh.right = NIL;
+            fresh.parent = NIL;
+            fresh.subtree_size = 1;
+            fresh.color = Color::RED;
+
+            return idx;
+        }
+
+        uint64_t subtree_size (index_t idx) const
+        {
+            return (idx != NIL) ? node (idx).subtree_size : 0;
+        }
+
+        void upd_subtree_size (index_t idx)
+        {
+            Node& n = node (idx);
+            n.subtree_size = 1 + subtree_size (n.left) + subtree_size (n.right);
+        }
+
+        bool is_red (index_t idx) const
+        {
+            return idx != NIL && node (idx).color == Color::RED;
+        }
+
+        index_t insert_data (const T& data)
+        {
+            index_t curr = header().root;
+            index_t parent = NIL;
+            bool go_left = false;
+
+            while (curr != NIL)
+            {
+                parent = curr;
+                const T& key = node (curr).data;
+
+                if (data < key)
+                {
+                    go_left = true;
+                    curr = node (curr).left;
+                }
+                else if (data > key)
+                {
+                    go_left = false;
+                    curr = node (curr).right;
+                }
+                else
+                {
+                    return NIL;
+                }
+            }
+
+            index_t new_node = allocate_node (data);
+
+            node (new_node).parent = parent;
+            if (parent == NIL)
+                header().root = new_node;
+            else if (go_left)
+                node (parent).left = new_node;
+            else
+                node (parent).right = new_node;
+
+            header().size++;
+            return new_node;
+        }
+
+        void rotate (index_t idx, Dir dir)
+        {
+            Node& n = node (idx);
+            index_t pivot = (dir == Dir::LEFT) ? n.right : n.left;
+            if (pivot == NIL)
+                return;
+
+            Node& p = node (pivot);
+            index_t parent = n.parent;
+
+            p.parent = parent;
+            if (parent == NIL)
+                header().root = pivot;
+            else if (node (parent).left == idx)
+                node (parent).left = pivot;
+            else
+                node (parent).right = pivot;
+
+            if (dir == Dir::LEFT)
+            {
+                n.right = p.left;
+                if (p.left != NIL)
+                    node (p.left).parent = idx;
+
+                p.left = idx;
+            }
+            else
+            {
+                n.left = p.right;
+                if (p.right != NIL)
+                    node (p.right).parent = idx;
+
+                p.right = idx;
+            }
+
+            n.parent = pivot;
+
+            upd_subtree_size (idx);
+            upd_subtree_size (pivot);
+        }
+
+        void update_sizes (index_t idx)
+        {
+            while (idx != NIL)
+            {
+                upd_subtree_size (idx);
+                idx = node (idx).parent;
+            }
+        }
+
+        void fix_insert (index_t idx)
+        {
+            while (is_red (node (idx).parent))
+            {
+                index_t parent = node (idx).parent;
+                index_t gp = node (parent).parent;
+                bool parent_is_left = (node (gp).left == parent);
+                index_t uncle = parent_is_left ? node (gp).right : node (gp).left;
+
+                if (is_red (uncle))
+                {
+                    node (parent).color = Color::BLACK;
+                    node (uncle).color = Color::BLACK;
+                    node (gp).color = Color::RED;
+                    idx = gp;
+                    continue;
+                }
+
+                if (parent_is_left && node (parent).right == idx)
+                {
+                    rotate (parent, Dir::LEFT);
+                    std::swap (idx, parent);
+                }
+                else if (!parent_is_left && node (parent).left == idx)
+                {
+                    rotate (parent, Dir::RIGHT);
+                    std::swap (idx, parent);
+                }
+
+                node (parent).color = Color::BLACK;
+                node (gp).color = Color::RED;
+                rotate (gp, parent_is_left ? Dir::RIGHT : Dir::LEFT);
+            }
+
+            node (header().root).color = Color::BLACK;
+        }
+
+        index_t min_node (index_t idx) const
+        {
+            while (idx != NIL && node (idx).left != NIL)
+                idx = node (idx).left;
+
+            return idx;
+        }
+
+        index_t max_node (index_t idx) const
+        {
+            while (idx != NIL && node (idx).right != NIL)
+                idx = node (idx).right;
+
+            return idx;
+        }
+
+        index_t next_node (index_t idx) const
+        {
+            if (idx == NIL)
+                return NIL;
+
+            if (node (idx).right != NIL)
+                return min_node (node (idx).right);
+
+            index_t parent = node (idx).parent;
+            while (parent != NIL && idx == node (parent).right)
+            {
+                idx = parent;
+                parent = node (parent).parent;
+            }
+
+            return parent;
+        }
+
+        index_t prev_node (index_t idx) const
+        {
+            if (idx == NIL)
+                return NIL;
+
+            if (node (idx).left != NIL)
+                return max_node (node (idx).left);
+
+            index_t parent = node (idx).parent;
+            while (parent != NIL && idx == node (parent).left)
+            {
+                idx = parent;
+                parent = node (parent).parent;
+            }
+
+            return parent;
+        }
+
+        index_t find_bound (const T& key, BoundType type) const
+        {
+            index_t curr = header().root;
+            index_t target = NIL;
+
+            while (curr != NIL)
+            {
+                const Node& n = node (curr);
+                bool cond = (type == BoundType::LOWER) ? (key <= n.data) : (key < n.data);
+                if (cond)
+                {
+                    target = curr;
+                    curr = n.left;
+                }
+                else
+                {
+                    curr = n.right;
+                }
+            }
+
+            return target;
+        }
+
+        // Number of keys before the lower/upper bound of key
+        size_t rank (const T& key, BoundType type) const
+        {
+            index_t curr = header().root;
+            uint64_t count = 0;
+
+            while (curr != NIL)
+            {
+                const Node& n = node (curr);
+                bool cond = (type == BoundType::LOWER) ? (key <= n.data) : (key < n.data);
+                if (cond)
+                {
+                    curr = n.left;
+                }
+                else
+                {
+                    count += 1 + subtree_size (n.left);
+                    curr = n.right;
+                }
+            }
+
+            return static_cast<size_t>(count);
+        }
+    }; // class MappedTree
+
+} // namespace rb
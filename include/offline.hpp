@@ -0,0 +1,154 @@
+#pragma once
+
+#include "pipeline.hpp"
+#include "interval_tree.hpp"
+#include "approx_counter.hpp"
+#include "rbtree.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rb_app
+{
+    // Counts over a fixed set of slots in O(log n) per update or prefix,
+    // in one flat array
+    class FenwickTree
+    {
+    private:
+        std::vector<uint32_t> tree_;
+
+    public:
+        explicit FenwickTree (size_t n)
+            : tree_(n + 1, 0) {}
+
+        void add (size_t slot)
+        {
+            for (size_t i = slot + 1; i < tree_.size(); i += i & (~i + 1))
+                tree_[i]++;
+        }
+
+        // Marked slots in [0, end)
+        size_t prefix (size_t end) const
+        {
+            size_t sum = 0;
+            for (size_t i = end; i > 0; i -= i & (~i + 1))
+                sum += tree_[i];
+
+            return sum;
+        }
+    }; // class FenwickTree
+
+    // Answers a whole command stream at once instead of maintaining the
+    // tree online. Every key the stream will ever insert is known up front,
+    // so the keys are sorted and compressed to slots, inserts mark a slot
+    // in a Fenwick tree and a q becomes two binary searches and two prefix
+    // sums. An a must give the estimate process_input gives, so a stream
+    // with a commands also keeps a tree of the keys, and the first a builds
+    // the same ApproxCounter from it. Interval commands keep their online
+    // IntervalTree, they do not interact with the keys.
+    inline std::vector<size_t> solve_offline (const std::vector<Command>& commands, double approx_error = 0.01)
+    {
+        std::vector<int> keys;
+        bool approximate = false;
+        for (const Command& command : commands)
+        {
+            if (command.op == 'k')
+                keys.push_back (command.first);
+            approximate |= (command.op == 'a');
+        }
+
+        std::sort (keys.begin(), keys.end());
+        keys.erase (std::unique (keys.begin(), keys.end()), keys.end());
+
+        FenwickTree present (keys.size());
+        std::vector<bool> inserted (keys.size(), false);
+        rb::IntervalTree<int> intervals;
+        std::vector<size_t> results;
+
+        rb::Tree<int> tree;
+        std::optional<rb::ApproxCounter<rb::Tree<int>>> approx;
+
+        auto slot_of = [&](int key)
+        {
+            return static_cast<size_t>(std::lower_bound (keys.begin(), keys.end(), key) - keys.begin());
+        };
+
+        for (const Command& command : commands)
+        {
+            switch (command.op)
+            {
+                case 'k':
+                {
+                    size_t slot = slot_of (command.first);
+                    if (!inserted[slot])
+                    {
+                        inserted[slot] = true;
+                        present.add (slot);
+
+                        if (approximate)
+                        {
+                            tree.insert (command.first);
+                            if (approx)
+                                approx->add (tree, command.first);
+                        }
+                    }
+                    break;
+                }
+                case 'a':
+                {
+                    if (!approx)
+                    {
+                        approx.emplace (approx_error);
+                        approx->rebuild (tree);
+                    }
+
+                    results.push_back (approx->range_queries_solve (command.first, command.second));
+                    break;
+                }
+                case 'q':
+                {
+                    if (command.first > command.second)
+                    {
+                        results.push_back (0);
+                        break;
+                    }
+
+                    size_t begin = slot_of (command.first);
+                    size_t end = static_cast<size_t>(std::upper_bound (keys.begin(), keys.end(), command.second)
+                                                     - keys.begin());
+                    results.push_back (present.prefix (end) - present.prefix (begin));
+                    break;
+                }
+                case 'i': intervals.insert (command.first, command.second); break;
+                case 'o': results.push_back (intervals.overlap_count (command.first, command.second)); break;
+                case 's': results.push_back (intervals.stab_count (command.first)); break;
+            }
+        }
+
+        return results;
+    }
+
+    inline std::vector<Command> parse_commands (const std::string& input)
+    {
+        std::istringstream isstr (input);
+        CommandScanner scanner (isstr);
+
+        std::vector<Command> commands;
+        Command command;
+        while (read_command (scanner, command))
+            commands.push_back (command);
+
+        return commands;
+    }
+
+    // Offline counterpart of process_input, with the same results
+    inline std::vector<size_t> process_offline (const std::string& input, double approx_error = 0.01)
+    {
+        return solve_offline (parse_commands (input), approx_error);
+    }
+} // namespace rb_app
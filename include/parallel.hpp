@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+namespace rb
+{
+    struct ParallelOptions
+    {
+        size_t threads = 0;                 // 0 = std::thread::hardware_concurrency()
+        size_t min_partition = 1 << 14;     // elements below which another thread does not pay off
+    };
+
+} // namespace rb
@@ -0,0 +1,387 @@
+#pragma once
+
+#include "processor.hpp"
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <exception>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace rb_app
+{
+    // Bounded single-producer single-consumer queue. The producer only
+    // writes tail_, the consumer only head_, so neither side takes a lock;
+    // a full or empty ring is waited out by yielding. Both sides give up
+    // once cancelled is set, so a failed stage cannot leave the others
+    // blocked.
+    template<typename T, size_t Capacity>
+    class SpscRing
+    {
+    private:
+        static_assert ((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+        std::array<T, Capacity> slots_;
+        alignas(64) std::atomic<size_t> head_ {0};      // next slot to pop
+        alignas(64) std::atomic<size_t> tail_ {0};      // next slot to push
+
+    public:
+        bool push (T&& item, const std::atomic<bool>& cancelled)
+        {
+            size_t tail = tail_.load (std::memory_order_relaxed);
+            while (tail - head_.load (std::memory_order_acquire) == Capacity)
+            {
+                if (cancelled.load (std::memory_order_relaxed))
+                    return false;
+                std::this_thread::yield();
+            }
+
+            slots_[tail & (Capacity - 1)] = std::move (item);
+            tail_.store (tail + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        bool pop (T& item, const std::atomic<bool>& cancelled)
+        {
+            size_t head = head_.load (std::memory_order_relaxed);
+            while (tail_.load (std::memory_order_acquire) == head)
+            {
+                if (cancelled.load (std::memory_order_relaxed))
+                    return false;
+                std::this_thread::yield();
+            }
+
+            item = std::move (slots_[head & (Capacity - 1)]);
+            head_.store (head + 1, std::memory_order_release);
+
+            return true;
+        }
+    }; // class SpscRing
+
+    // One parsed command; second is unused by k and s
+    struct Command
+    {
+        char op;
+        int first;
+        int second;
+    };
+
+    // Integers that follow the command word op, -1 for an unknown word
+    inline int command_arity (char op)
+    {
+        switch (op)
+        {
+            case 'k':
+            case 's':
+                return 1;
+            case 'q':
+            case 'a':
+            case 'i':
+            case 'o':
+                return 2;
+            default:
+                return -1;
+        }
+    }
+
+    // Reads an integer from the front of text the way operator>> does:
+    // optional sign, then digits. Returns the characters used, 0 when text
+    // does not start with an integer or it is out of range.
+    inline size_t scan_integer (std::string_view text, int& value)
+    {
+        size_t digits = (!text.empty() && (text[0] == '+' || text[0] == '-')) ? 1 : 0;
+        size_t stop = digits;
+        while (stop < text.size() && text[stop] >= '0' && text[stop] <= '9')
+            ++stop;
+
+        if (stop == digits)
+            return 0;
+
+        const char* first = text.data() + (text[0] == '+' ? 1 : 0);
+        auto [ptr, ec] = std::from_chars (first, text.data() + stop, value);
+
+        return (ec == std::errc {}) ? stop : 0;
+    }
+
+    // Pulls whitespace separated words from the first line of a stream in
+    // large chunks, and integers the way operator>> reads them: optional
+    // sign and digits, with the rest of the word left for the next read
+    class CommandScanner
+    {
+    private:
+        std::istream& in_;
+        std::vector<char> buffer_;
+        size_t pos_ = 0;
+        size_t end_ = 0;
+        bool line_done_ = false;
+
+        std::string pending_;       // unread rest of the last word
+
+        static bool is_space (char c)
+        {
+            return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+        }
+
+        bool fill()
+        {
+            if (line_done_)
+                return false;
+
+            end_ = static_cast<size_t>(in_.rdbuf()->sgetn (buffer_.data(),
+                                                           static_cast<std::streamsize>(buffer_.size())));
+            pos_ = 0;
+            if (end_ == 0)
+                line_done_ = true;
+
+            return end_ != 0;
+        }
+
+    public:
+        explicit CommandScanner (std::istream& in, size_t chunk_size = 1 << 16)
+            : in_(in), buffer_(chunk_size) {}
+
+        bool word (std::string& out)
+        {
+            if (!pending_.empty())
+            {
+                out.swap (pending_);
+                pending_.clear();
+                return true;
+            }
+
+            out.clear();
+            while (true)
+            {
+                if (pos_ == end_ && !fill())
+                    return !out.empty();
+
+                char c = buffer_[pos_];
+                if (c == '\n')
+                {
+                    line_done_ = true;
+                    end_ = pos_;
+                    return !out.empty();
+                }
+
+                if (is_space (c))
+                {
+                    ++pos_;
+                    if (!out.empty())
+                        return true;
+                    continue;
+                }
+
+                out.push_back (c);
+                ++pos_;
+            }
+        }
+
+        bool integer (int& value)
+        {
+            std::string text;
+            if (!word (text))
+                return false;
+
+            size_t stop = scan_integer (text, value);
+            if (stop == 0)
+                return false;
+
+            pending_.assign (text, stop);
+
+            return true;
+        }
+    }; // class CommandScanner
+
+    // Reads the next known command; unknown words are skipped. Returns
+    // false at the end of input or at a malformed number, where the
+    // istringstream based parser stops too.
+    inline bool read_command (CommandScanner& scanner, Command& command)
+    {
+        std::string token;
+        while (scanner.word (token))
+        {
+            command = {token.size() == 1 ? token[0] : '\0', 0, 0};
+            switch (command_arity (command.op))
+            {
+                case 1:
+                    return scanner.integer (command.first);
+                case 2:
+                    return scanner.integer (command.first) && scanner.integer (command.second);
+                default:
+                    break;
+            }
+        }
+
+        return false;
+    }
+
+    struct PipelineOptions
+    {
+        size_t batch_size = 4096;           // commands per parsed batch
+        size_t output_buffer = 1 << 16;     // formatted bytes per write
+    };
+
+    // Same commands and output as process_input + print_results, on three
+    // threads: the calling one reads and parses, one runs the tree and one
+    // formats the results, connected by rings of batches. An empty batch
+    // ends the stream.
+    class Pipeline
+    {
+    private:
+        using CommandBatch = std::vector<Command>;
+        using ResultBatch = std::vector<size_t>;
+
+        static constexpr size_t ring_batches = 64;
+
+        PipelineOptions opts_;
+        SpscRing<CommandBatch, ring_batches> commands_;
+        SpscRing<ResultBatch, ring_batches> results_;
+        std::atomic<bool> failed_ {false};
+        std::exception_ptr errors_[3];
+
+        template<typename Stage>
+        void guarded (size_t index, Stage&& stage)
+        {
+            try
+            {
+                stage();
+            }
+            catch (...)
+            {
+                errors_[index] = std::current_exception();
+                failed_.store (true);
+            }
+        }
+
+        void parse (std::istream& in)
+        {
+            CommandScanner scanner (in);
+            CommandBatch batch;
+            batch.reserve (opts_.batch_size);
+
+            Command command;
+            while (read_command (scanner, command))
+            {
+                batch.push_back (command);
+                if (batch.size() == opts_.batch_size)
+                {
+                    if (!commands_.push (std::move (batch), failed_))
+                        return;
+
+                    batch = CommandBatch {};
+                    batch.reserve (opts_.batch_size);
+                }
+            }
+
+            if (!batch.empty() && !commands_.push (std::move (batch), failed_))
+                return;
+
+            commands_.push (CommandBatch {}, failed_);
+        }
+
+        void execute (Session& session)
+        {
+            CommandBatch batch;
+            while (commands_.pop (batch, failed_) && !batch.empty())
+            {
+                for (const Command& command : batch)
+                {
+                    switch (command.op)
+                    {
+                        case 'k': insert_key (command.first, session); break;
+                        case 'q': session.results.push_back (count_range (command.first, command.second,
+                                                                          session)); break;
+                        case 'a': session.results.push_back (approx_count_range (command.first, command.second,
+                                                                                 session)); break;
+                        case 'i': session.intervals.insert (command.first, command.second); break;
+                        case 'o': session.results.push_back (session.intervals.overlap_count (command.first,
+                                                                                              command.second)); break;
+                        case 's': session.results.push_back (session.intervals.stab_count (command.first)); break;
+                    }
+                }
+
+                if (!session.results.empty() && !results_.push (std::move (session.results), failed_))
+                    return;
+
+                session.results = ResultBatch {};
+            }
+
+            results_.push (ResultBatch {}, failed_);
+        }
+
+        void format (std::ostream& out)
+        {
+            std::string text;
+            text.reserve (opts_.output_buffer + 32);
+            bool first = true;
+
+            ResultBatch batch;
+            while (results_.pop (batch, failed_) && !batch.empty())
+            {
+                for (size_t count : batch)
+                {
+                    if (!first)
+                        text.push_back (' ');
+                    first = false;
+
+                    char digits[24];
+                    auto [end, ec] = std::to_chars (digits, digits + sizeof (digits), count);
+                    text.append (digits, end);
+
+                    if (text.size() >= opts_.output_buffer)
+                    {
+                        out.write (text.data(), static_cast<std::streamsize>(text.size()));
+                        text.clear();
+                    }
+                }
+            }
+
+            if (failed_.load())
+                return;
+
+            text.push_back ('\n');
+            out.write (text.data(), static_cast<std::streamsize>(text.size()));
+            out.flush();
+        }
+
+    public:
+        explicit Pipeline (const PipelineOptions& opts = {})
+            : opts_(opts) {}
+
+        void run (std::istream& in, Session& session, std::ostream& out)
+        {
+            std::thread executor ([&] { guarded (1, [&] { execute (session); }); });
+            std::thread formatter ([&] { guarded (2, [&] { format (out); }); });
+
+            guarded (0, [&] { parse (in); });
+
+            executor.join();
+            formatter.join();
+
+            for (const std::exception_ptr& error : errors_)
+                if (error)
+                    std::rethrow_exception (error);
+        }
+    }; // class Pipeline
+
+    // Pipelined counterpart of process_input + print_results: reads the
+    // first line of in and writes the results line to out
+    inline void process_pipelined (std::istream& in, std::ostream& out, const ProcessorOptions& opts,
+                                   rb::CacheStats* cache_stats = nullptr,
+                                   const PipelineOptions& pipeline_opts = {})
+    {
+        run_session (opts, cache_stats, [&](Session& session)
+        {
+            Pipeline pipeline (pipeline_opts);
+            pipeline.run (in, session, out);
+        });
+    }
+} // namespace rb_app
@@ -1,62 +1,246 @@
 #pragma once
 
 #include "rbtree.hpp"
+#include "interval_tree.hpp"
+#include "wal.hpp"
+#include "query_cache.hpp"
+#include "write_buffer.hpp"
+#include "approx_counter.hpp"
 #include <iostream>
+#include <optional>
 #include <string>
 #include <sstream>
 #include <vector>
 
 namespace rb_app
 {
-    void process_insert (std::istringstream& isstr, rb::Tree<int>& tree)
+    // State shared by the commands of one input stream
+    struct Session
+    {
+        rb::Tree<int> tree;
+        rb::IntervalTree<int> intervals;
+        std::vector<size_t> results;
+
+        Durability* durability = nullptr;
+        std::optional<rb::RangeCache<rb::Tree<int>>> cache;
+        std::optional<rb::WriteBuffer<rb::Tree<int>>> buffer;
+
+        double approx_error = 0.01;
+        std::optional<rb::ApproxCounter<rb::Tree<int>>> approx;    // built by the first a
+    };
+
+    struct ProcessorOptions
+    {
+        DurabilityOptions durability;   // durable mode when durability.dir is set
+        size_t cache_entries = 0;       // q results cache, 0 disables it
+        size_t write_buffer = 0;        // k keys buffered before merging, 0 disables it
+        double approx_error = 0.01;     // a answers within this share of the key count
+    };
+
+    inline void insert_key (int key, Session& session)
+    {
+        if (session.durability != nullptr)
+            session.durability->log_insert (key);
+
+        // The counter has to see every key that reaches the tree, so once
+        // it exists inserts go straight to the tree
+        if (session.approx)
+        {
+            size_t before = session.tree.size();
+            session.tree.insert (key);
+            if (session.tree.size() != before)
+                session.approx->add (session.tree, key);
+        }
+        else if (session.buffer)
+            session.buffer->insert (session.tree, key);
+        else
+            session.tree.insert(key);
+
+        if (session.durability != nullptr)
+        {
+            if (session.buffer && session.durability->checkpoint_due())
+                session.buffer->flush (session.tree);
+            session.durability->maybe_checkpoint (session.tree);
+        }
+    }
+
+    // Buffered keys of the range are merged first, which also bumps the
+    // tree version the cache entries are checked against
+    inline size_t count_range (int low, int high, Session& session)
+    {
+        if (session.buffer)
+            session.buffer->flush_range (session.tree, low, high);
+
+        return session.cache ? session.cache->range_queries_solve (session.tree, low, high)
+                             : session.tree.range_queries_solve (low, high);
+    }
+
+    // Estimated count of [low, high] that reads only the histogram; the
+    // first call builds it from the tree, with every buffered key merged
+    inline size_t approx_count_range (int low, int high, Session& session)
+    {
+        if (!session.approx)
+        {
+            if (session.buffer)
+                session.buffer->flush (session.tree);
+
+            session.approx.emplace (session.approx_error);
+            session.approx->rebuild (session.tree);
+        }
+
+        return session.approx->range_queries_solve (low, high);
+    }
+
+    inline void process_insert (std::istringstream& isstr, Session& session)
     {
         int key;
         if (isstr >> key)
-            tree.insert(key);
+            insert_key (key, session);
     }
 
-    void process_query (std::istringstream& isstr,
-                         rb::Tree<int>& tree,
-                        std::vector<size_t>& results)
+    inline void process_query (std::istringstream& isstr, Session& session)
     {
         int low = 0;
         int high = 0;
 
         if (isstr >> low >> high)
-        {
-            size_t count = tree.range_queries_solve (low, high);
-            results.push_back (count);
-        }
+            session.results.push_back (count_range (low, high, session));
     }
 
-    void process_token (const std::string& token, std::istringstream& isstr,
-                        rb::Tree<int>& tree, std::vector<size_t>& results)
+    inline void process_approx_query (std::istringstream& isstr, Session& session)
+    {
+        int low = 0;
+        int high = 0;
+
+        if (isstr >> low >> high)
+            session.results.push_back (approx_count_range (low, high, session));
+    }
+
+    inline void process_interval_insert (std::istringstream& isstr, Session& session)
+    {
+        int start = 0;
+        int end = 0;
+
+        if (isstr >> start >> end)
+            session.intervals.insert (start, end);
+    }
+
+    inline void process_overlap_query (std::istringstream& isstr, Session& session)
+    {
+        int low = 0;
+        int high = 0;
+
+        if (isstr >> low >> high)
+            session.results.push_back (session.intervals.overlap_count (low, high));
+    }
+
+    inline void process_stab_query (std::istringstream& isstr, Session& session)
+    {
+        int point = 0;
+
+        if (isstr >> point)
+            session.results.push_back (session.intervals.stab_count (point));
+    }
+
+    inline void process_token (const std::string& token, std::istringstream& isstr,
+                               Session& session)
     {
         if (token == "k")
         {
-            process_insert (isstr, tree);
+            process_insert (isstr, session);
         }
         else if (token == "q")
         {
-            process_query (isstr, tree, results);
+            process_query (isstr, session);
+        }
+        else if (token == "a")
+        {
+            process_approx_query (isstr, session);
+        }
+        else if (token == "i")
+        {
+            process_interval_insert (isstr, session);
+        }
+        else if (token == "o")
+        {
+            process_overlap_query (isstr, session);
+        }
+        else if (token == "s")
+        {
+            process_stab_query (isstr, session);
         }
     }
 
-    std::vector<size_t> process_input (const std::string& input)
+    inline void process_stream (const std::string& input, Session& session)
     {
-        rb::Tree<int> tree;
-        std::vector<size_t> results;
-
         std::istringstream isstr (input);
         std::string token;
 
         while (isstr >> token)
-            process_token (token, isstr, tree, results);
+            process_token (token, isstr, session);
+    }
+
+    inline std::vector<size_t> process_input (const std::string& input)
+    {
+        Session session;
+        process_stream (input, session);
+
+        return std::move (session.results);
+    }
+
+    // Runs body on a session with the optional features of opts enabled;
+    // the cache hit and miss counts go to cache_stats when it is given
+    template<typename Body>
+    void run_session (const ProcessorOptions& opts, rb::CacheStats* cache_stats, Body&& body)
+    {
+        Session session;
+        session.approx_error = opts.approx_error;
+        if (opts.cache_entries != 0)
+            session.cache.emplace (opts.cache_entries);
+        if (opts.write_buffer != 0)
+            session.buffer.emplace (opts.write_buffer);
+
+        std::optional<Durability> durability;
+        if (!opts.durability.dir.empty())
+        {
+            durability.emplace (opts.durability);
+            durability->recover (session.tree);
+            session.durability = &*durability;
+        }
+
+        body (session);
+
+        if (session.buffer)
+            session.buffer->flush (session.tree);
+
+        if (durability)
+            durability->flush();
+
+        if (cache_stats != nullptr && session.cache)
+            *cache_stats = session.cache->stats();
+    }
+
+    inline std::vector<size_t> process_input (const std::string& input, const ProcessorOptions& opts,
+                                              rb::CacheStats* cache_stats = nullptr)
+    {
+        std::vector<size_t> results;
+        run_session (opts, cache_stats, [&](Session& session)
+        {
+            process_stream (input, session);
+            results = std::move (session.results);
+        });
 
         return results;
     }
 
-    void print_results (const std::vector<size_t>& results)
+    // The tree starts from the state recovered from opts.dir and every
+    // insert is logged there
+    inline std::vector<size_t> process_input (const std::string& input, const DurabilityOptions& opts)
+    {
+        return process_input (input, ProcessorOptions {opts});
+    }
+
+    inline void print_results (const std::vector<size_t>& results)
     {
         for (size_t i = 0; i < results.size(); ++i)
         {
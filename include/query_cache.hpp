@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace rb
+{
+    struct CacheStats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+
+        double hit_rate() const noexcept
+        {
+            size_t total = hits + misses;
+            return total ? static_cast<double>(hits) / static_cast<double>(total) : 0.0;
+        }
+    };
+
+    // Bounded cache of range_queries_solve (low, high) results for one tree.
+    // Entries are tagged with the tree version they were computed at, so any
+    // insert or erase invalidates all of them without touching the table.
+    // The table is split into sets of Ways entries picked by a hash of
+    // (low, high); a full set evicts its least recently used entry.
+    template<typename TreeT>
+    class RangeCache
+    {
+    private:
+        using key_type = typename TreeT::value_type;
+
+        static constexpr size_t Ways = 4;
+
+        struct Entry
+        {
+            key_type low {};
+            key_type high {};
+            size_t count = 0;
+            uint64_t version = 0;
+            uint64_t last_used = 0;     // 0: never filled
+        };
+
+        std::vector<Entry> entries_;
+        size_t set_mask_;
+        uint64_t clock_ = 0;
+        CacheStats stats_;
+
+        static size_t sets_for (size_t capacity)
+        {
+            size_t sets = 1;
+            while (sets * Ways < capacity)
+                sets <<= 1;
+
+            return sets;
+        }
+
+        size_t set_of (const key_type& low, const key_type& high) const
+        {
+            size_t h = std::hash<key_type> {}(low);
+            h ^= std::hash<key_type> {}(high) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+            h *= 0x9e3779b97f4a7c15ull;
+
+            return (h >> 32) & set_mask_;
+        }
+
+    public:
+        // capacity is rounded up to a power of two number of sets
+        explicit RangeCache (size_t capacity)
+            : entries_(sets_for (capacity) * Ways),
+              set_mask_(sets_for (capacity) - 1) {}
+
+        size_t range_queries_solve (const TreeT& tree, const key_type& low, const key_type& high)
+        {
+            Entry* set = &entries_[set_of (low, high) * Ways];
+            Entry* victim = set;
+            uint64_t version = tree.version();
+
+            clock_++;
+            for (size_t way = 0; way < Ways; ++way)
+            {
+                Entry& entry = set[way];
+                bool fresh = entry.last_used != 0 && entry.version == version;
+
+                if (fresh && entry.low == low && entry.high == high)
+                {
+                    entry.last_used = clock_;
+                    stats_.hits++;
+                    return entry.count;
+                }
+
+                // stale entries go first, then the least recently used one
+                if (!fresh)
+                    entry.last_used = 0;
+                if (entry.last_used < victim->last_used)
+                    victim = &entry;
+            }
+
+            stats_.misses++;
+            size_t count = tree.range_queries_solve (low, high);
+            *victim = {low, high, count, version, clock_};
+
+            return count;
+        }
+
+        size_t capacity() const noexcept { return entries_.size(); }
+
+        const CacheStats& stats() const noexcept { return stats_; }
+
+        void clear()
+        {
+            for (Entry& entry : entries_)
+                entry.last_used = 0;
+
+            stats_ = {};
+        }
+    }; // class RangeCache
+
+} // namespace rb
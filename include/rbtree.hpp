@@ -2,36 +2,129 @@
 
 #include <iostream>
 #include <vector>
-#include <sstream>
 #include <fstream>
 #include <iterator>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <cassert>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <memory>
+#include <optional>
+#include <algorithm>
+#include <exception>
+
+#include "snapshot.hpp"
+#include "dump.hpp"
+#include "verify.hpp"
+#include "parallel.hpp"
+#include "aggregate.hpp"
+#include "key_policy.hpp"
+#include "layout.hpp"
+#include "balance_policy.hpp"
 
 namespace rb
 {
-    template<typename T>
+    // Order-statistic red-black tree (or another Balance policy) with
+    // optional subtree aggregates. With MultiKeys a node holds one distinct
+    // key and its copy count: size(), count() and the range counts include
+    // copies, while iterators visit each node once, so for a multiset
+    // std::distance (begin(), end()) is the number of distinct keys, not
+    // size(). shape_stats() reports both.
+    template<typename T, typename Agg = NoAggregate, typename Keys = UniqueKeys,
+             typename Alloc = std::allocator<T>, typename Balance = RedBlack>
+        requires ((!has_aggregate_v<Agg> || Aggregate<Agg, T>) && KeyPolicy<Keys> && BalancePolicy<Balance>)
     class Tree
     {
+    public:
+        using aggregate_type = aggregate_value_t<Agg>;
+        using allocator_type = Alloc;
+        using balance_type = Balance;
+
+        static constexpr bool is_multiset = is_multi_v<Keys>;
+        static constexpr bool is_red_black = std::is_same_v<Balance, RedBlack>;
+
     private:
+        using count_type = key_count_t<Keys>;
+        using balance_state = balance_state_t<Balance>;
+
+        // Aggregate of n copies of key; O(log n) combines in multiset mode
+        static aggregate_type lift_repeated (const T& key, size_t n)
+        {
+            aggregate_type unit = Agg::lift (key);
+            if constexpr (!is_multiset)
+            {
+                (void) n;
+                return unit;
+            }
+            else
+            {
+                aggregate_type result = Agg::identity();
+                for (; n != 0; n >>= 1)
+                {
+                    if (n & 1)
+                        result = Agg::combine (result, unit);
+                    unit = Agg::combine (unit, unit);
+                }
+
+                return result;
+            }
+        }
+
+        static count_type initial_count()
+        {
+            if constexpr (is_multiset)
+                return 1;
+            else
+                return {};
+        }
+
+        // State of a new leaf: height 1, rank 0 or a fresh priority
+        static balance_state initial_balance()
+        {
+            if constexpr (std::is_same_v<Balance, Avl>)
+                return 1;
+            else if constexpr (std::is_same_v<Balance, Treap>)
+                return treap_priority();
+            else
+                return {};
+        }
 
         class Node
         {
         private:
-            enum class Color { RED, BLACK };
+            enum class Color : uint8_t { RED, BLACK };
 
             T data_;
-            Color color_;
-            Node* left_;
-            Node* right_;
+            Color color_;                   // always BLACK unless is_red_black
+            [[no_unique_address]] balance_state balance_;
+            Node* child_[2];        // [0] left, [1] right: indexable for branchless descent
             Node* parent_;
             size_t subtree_size_;
+            [[no_unique_address]] aggregate_type aggregate_;
+            [[no_unique_address]] count_type count_;
 
             void upd_subtree_size()
             {
-                subtree_size_ = 1 +
-                    (left_ ? left_->subtree_size_ : 0) +
-                    (right_ ? right_->subtree_size_ : 0);
+                subtree_size_ = count() +
+                    (child_[0] ? child_[0]->subtree_size_ : 0) +
+                    (child_[1] ? child_[1]->subtree_size_ : 0);
+
+                if constexpr (has_aggregate_v<Agg>)
+                {
+                    aggregate_ = Agg::combine (Agg::combine (aggregate_of (child_[0]),
+                                                             lift_repeated (data_, count())),
+                                               aggregate_of (child_[1]));
+                }
             }
 
         public:
@@ -41,10 +134,12 @@ namespace rb
                                           Node* parent = nullptr) :
                 data_ (data),
                 color_ (c),
-                left_ (left),
-                right_ (right),
+                balance_ (initial_balance()),
+                child_ {left, right},
                 parent_ (parent),
-                subtree_size_ (1) { upd_subtree_size(); }
+                subtree_size_ (1),
+                aggregate_ {},
+                count_ (initial_count()) { upd_subtree_size(); }
 
             explicit Node (T&& data, Color c = Color::RED,
                                           Node* left = nullptr,
@@ -52,18 +147,22 @@ namespace rb
                                           Node* parent = nullptr) :
                 data_ (std::move(data)),
                 color_ (c),
-                left_ (left),
-                right_ (right),
+                balance_ (initial_balance()),
+                child_ {left, right},
                 parent_ (parent),
-                subtree_size_ (1) { upd_subtree_size(); }
+                subtree_size_ (1),
+                aggregate_ {},
+                count_ (initial_count()) { upd_subtree_size(); }
 
             Node (const Node& oth) :
                 data_ (oth.data_),
                 color_ (oth.color_),
-                left_ (nullptr),
-                right_ (nullptr),
+                balance_ (oth.balance_),
+                child_ {nullptr, nullptr},
                 parent_ (nullptr),
-                subtree_size_ (oth.subtree_size_) {}
+                subtree_size_ (oth.subtree_size_),
+                aggregate_ (oth.aggregate_),
+                count_ (oth.count_) {}
 
             const T& data() const { return data_; }
             T& data() { return data_; }
@@ -73,13 +172,16 @@ namespace rb
             bool is_red() const { return color_ == Color::RED; }
             bool is_black() const { return color_ == Color::BLACK; }
 
-            const Node* left() const { return left_; }
-            Node* left() { return left_;  }
-            void set_left (Node* left) { left_ = left; }
+            const Node* left() const { return child_[0]; }
+            Node* left() { return child_[0];  }
+            void set_left (Node* left) { child_[0] = left; }
+
+            const Node* right() const { return child_[1]; }
+            Node* right() { return child_[1]; }
+            void set_right (Node* right) { child_[1] = right; }
 
-            const Node* right() const { return right_; }
-            Node* right() { return right_; }
-            void set_right (Node* right) { right_ = right; }
+            const Node* child (bool right) const { return child_[right]; }
+            Node* child (bool right) { return child_[right]; }
 
             const Node* parent() const { return parent_; }
             Node* parent() { return parent_; }
@@ -88,6 +190,30 @@ namespace rb
             size_t subtree_size() const { return subtree_size_; }
             void set_subtree_size (size_t s_size) { subtree_size_ = s_size; }
 
+            const aggregate_type& aggregate() const { return aggregate_; }
+
+            // Copies of the key held by this node; always 1 for unique keys
+            size_t count() const
+            {
+                if constexpr (is_multiset)
+                    return count_;
+                else
+                    return 1;
+            }
+
+            void set_count (size_t count)
+            {
+                if constexpr (is_multiset)
+                    count_ = count;
+                else
+                    assert (count == 1);
+            }
+
+            static aggregate_type aggregate_of (const Node* node)
+            {
+                return node ? node->aggregate_ : Agg::identity();
+            }
+
             Node* grandparent() const
             {
                 return (parent_) ? parent_->parent_ : nullptr;
@@ -98,7 +224,7 @@ namespace rb
                 Node* gp = grandparent();
                 if (gp == nullptr) return nullptr;
 
-                return (parent_ == gp->left_) ? gp->right_ : gp->left_;
+                return (parent_ == gp->child_[0]) ? gp->child_[1] : gp->child_[0];
             }
 
             Node* sibling() const
@@ -106,26 +232,65 @@ namespace rb
                 if (parent_ == nullptr)
                     return nullptr;
 
-                return (this == parent_->left_) ? parent_->right_ : parent_->left_;
+                return (this == parent_->child_[0]) ? parent_->child_[1] : parent_->child_[0];
             }
 
             bool is_left_child() const
             {
-                return (parent_ && this == parent_->left_);
+                return (parent_ && this == parent_->child_[0]);
             }
 
             bool is_right_child() const
             {
-                return (parent_ && this == parent_->right_);
+                return (parent_ && this == parent_->child_[1]);
             }
 
             friend class Tree;
         }; // class Node
 
         enum class Dir { LEFT, RIGHT };
+        enum class BoundType { LOWER, UPPER };
+
+        // Other policies never look at colours; keeping their nodes black
+        // leaves verify() and the dumps consistent
+        static constexpr typename Node::Color leaf_color = is_red_black ? Node::Color::RED : Node::Color::BLACK;
+
+        // Arithmetic keys compare in one instruction, so descents select the
+        // child by index (a cmov) instead of branching on the comparison
+        static constexpr bool branchless_keys = std::is_arithmetic_v<T>;
+
+        // Levels the automatic insert finger may climb before the search
+        // restarts from the root: a key that far from the last one is random
+        static constexpr size_t finger_climb_limit = 6;
+
+        // True when the bound of key lies at node or in its left subtree
+        template<BoundType Type>
+        static bool bound_goes_left (const T& key, const T& data)
+        {
+            if constexpr (Type == BoundType::LOWER)
+                return !(data < key);
+            else
+                return key < data;
+        }
 
+        using node_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+        using node_traits = std::allocator_traits<node_allocator>;
+
+        [[no_unique_address]] node_allocator alloc_;
         Node* root_;
         size_t size_;
+        uint64_t version_ = 0;     // bumped by every change to the key set
+
+        Node* min_ = nullptr;
+        Node* max_ = nullptr;
+        Node* finger_ = nullptr;   // last inserted node, where the next insert search starts
+
+        // compact_step resumes at the subtree holding compact_cursor_ when
+        // compact_resume_ is set. Not a std::optional: GCC 12 at -O3 flags
+        // swapping one out of a fresh copy as maybe-uninitialized.
+        T compact_cursor_ {};
+        bool compact_resume_ = false;
+        bool compact_top_pending_ = false; // every subtree is done, the nodes above them are next
 
     public:
         class Iterator
@@ -213,17 +378,27 @@ namespace rb
 
         Tree() : root_(nullptr), size_(0) {};
 
+        // Nodes come from alloc, e.g. an rb::ArenaAllocator on huge pages
+        explicit Tree(const Alloc& alloc)
+            : alloc_(alloc), root_(nullptr), size_(0) {}
+
         ~Tree() { clear_tree (root_); }
 
         Tree(const Tree& oth)
-            : root_(copy_subtree (oth.root_, nullptr)),
-              size_(oth.size_) {}
+            : alloc_(oth.alloc_), root_(nullptr), size_(oth.size_)
+        {
+            root_ = copy_subtree (oth.root_, nullptr);
+            reset_fingers();
+        }
 
         Tree(Tree&& oth) noexcept
-            : root_(oth.root_), size_(oth.size_)
+            : alloc_(oth.alloc_), root_(oth.root_), size_(oth.size_),
+              min_(oth.min_), max_(oth.max_), finger_(oth.finger_)
         {
             oth.root_ = nullptr;
             oth.size_ = 0;
+            oth.version_++;
+            oth.reset_fingers();
         }
 
         Tree& operator= (const Tree& oth)
@@ -238,10 +413,7 @@ namespace rb
         {
             if (this != &oth)
             {
-                clear_tree (root_);
-                root_ = nullptr;
-                size_ = 0;
-
+                clear();
                 swap (oth);
             }
 
@@ -250,7 +422,7 @@ namespace rb
 
         Iterator begin() const
         {
-            return Iterator (this, min_node());
+            return Iterator (this, min_);
         }
 
         Iterator end() const
@@ -268,239 +440,1572 @@ namespace rb
             return Iterator (this, find_upper_bound (key));
         }
 
+        // Same as above, but the search starts from hint and climbs only as
+        // far as needed, so a scan with ascending keys pays for the distance
+        // between consecutive answers instead of the tree height
+        Iterator lower_bound (Iterator hint, const T& key) const
+        {
+            return Iterator (this, find_bound<BoundType::LOWER> (key, hint.curr_));
+        }
+
+        Iterator upper_bound (Iterator hint, const T& key) const
+        {
+            return Iterator (this, find_bound<BoundType::UPPER> (key, hint.curr_));
+        }
+
+        // Number of elements (duplicates included) in [low, high], from the
+        // subtree sizes along two root-to-leaf paths
         size_t range_queries_solve (const T& low, const T& high) const
         {
             if (low > high)
                 return 0;
 
-            Iterator it_low = lower_bound (low);
-            Iterator it_high = upper_bound (high);
+            return rank<BoundType::UPPER> (high) - rank<BoundType::LOWER> (low);
+        }
 
-            size_t count = 0;
+        // Copies of key in the tree: 0 or 1 unless is_multiset
+        size_t count (const T& key) const
+        {
+            const Node* node = find_node (key);
+            return node ? node->count() : 0;
+        }
+
+        bool contains (const T& key) const
+        {
+            return find_node (key) != nullptr;
+        }
+
+        // Aggregate of the keys in [low, high] in O(log n): only the two
+        // boundary paths below the split node are walked, everything between
+        // them is taken from the cached subtree aggregates
+        aggregate_type range_aggregate (const T& low, const T& high) const
+            requires (has_aggregate_v<Agg>)
+        {
+            if (high < low)
+                return Agg::identity();
+
+            const Node* split = root_;
+            while (split != nullptr && (split->data() < low || high < split->data()))
+                split = (split->data() < low) ? split->right() : split->left();
+
+            if (split == nullptr)
+                return Agg::identity();
 
-            while (it_low != it_high)
+            aggregate_type left_part = Agg::identity();
+            for (const Node* node = split->left(); node != nullptr; )
             {
-                count++;
-                it_low++;
+                if (node->data() < low)
+                {
+                    node = node->right();
+                }
+                else
+                {
+                    left_part = Agg::combine (lift_repeated (node->data(), node->count()),
+                                              Agg::combine (Node::aggregate_of (node->right()), left_part));
+                    node = node->left();
+                }
             }
 
-            return count;
-        }
+            aggregate_type right_part = Agg::identity();
+            for (const Node* node = split->right(); node != nullptr; )
+            {
+                if (high < node->data())
+                {
+                    node = node->left();
+                }
+                else
+                {
+                    right_part = Agg::combine (right_part,
+                                               Agg::combine (Node::aggregate_of (node->left()),
+                                                             lift_repeated (node->data(), node->count())));
+                    node = node->right();
+                }
+            }
 
-        bool  empty() const noexcept { return size_ == 0; }
-        size_t size() const noexcept { return size_; }
+            return Agg::combine (left_part, Agg::combine (lift_repeated (split->data(), split->count()),
+                                                          right_part));
+        }
 
-        void clear() const
+        aggregate_type aggregate() const
+            requires (has_aggregate_v<Agg>)
         {
-            clear_tree (root_);
+            return Node::aggregate_of (root_);
         }
 
-        void insert (const T& data)
+        // Calls fn (key) for every key in [low, high] in ascending order,
+        // once per copy like range_queries_solve counts them. One descent to
+        // low, then an in-order walk on an explicit stack: no parent climbs
+        // and no iterator state per step.
+        template<typename Fn>
+        void for_each_in_range (const T& low, const T& high, Fn fn) const
         {
-            Node* new_node = insert_data (data);
-            if (new_node != nullptr)
+            walk_range (low, high, [&](const Node* node)
             {
-                fix_insert (new_node);
-                update_sizes (new_node);
-            }
+                for (size_t copy = 0; copy < node->count(); ++copy)
+                    fn (node->data());
+            });
         }
 
-        void save_dot_to_file (const std::string& filename) const
+        // Writes the keys in [low, high] to out in ascending order, copies
+        // included; returns the end of the output
+        template<typename OutputIt>
+        OutputIt copy_range (const T& low, const T& high, OutputIt out) const
         {
-            std::ofstream file (filename);
-            file << make_dot();
-            file.close();
-            std::cout << "[.dot file saved]: " << filename << std::endl;
+            for_each_in_range (low, high, [&](const T& key) { *out++ = key; });
+            return out;
         }
 
-    private:
-        Node* copy_subtree (const Node* node, Node* parent)
+        // The keys in [low, high] in one buffer sized up front from the rank
+        // difference, so it never reallocates
+        std::vector<T> extract_range (const T& low, const T& high) const
         {
-            if (node == nullptr)
-                return nullptr;
+            std::vector<T> keys;
+            keys.reserve (range_queries_solve (low, high));
+            copy_range (low, high, std::back_inserter (keys));
 
-            Node* new_node = new Node (node->data(), node->color(), nullptr, nullptr, parent);
-
-            Node* left_child = copy_subtree (node->left(), new_node);
-            new_node->set_left (left_child);
-            if (left_child != nullptr)
-                left_child->set_parent (new_node);
+            return keys;
+        }
 
-            Node* right_child = copy_subtree (node->right(), new_node);
-            new_node->set_right (right_child);
-            if (right_child != nullptr)
-                right_child->set_parent (new_node);
+        // Element at position index of the sorted sequence (copies counted
+        // in multiset mode), end() past the last one; O(log n)
+        Iterator nth (size_t index) const
+        {
+            return Iterator (this, node_at (index));
+        }
 
-            new_node->upd_subtree_size();
+        // Splits the keys in [low, high] into at most parts contiguous
+        // ranges of about equal size, in key order, in O(parts * log n). The
+        // ranges can go to separate threads, e.g. each into a sequential
+        // std algorithm: the iterators are bidirectional, so std::execution
+        // policies cannot split them on their own.
+        std::vector<std::pair<Iterator, Iterator>> split_range (const T& low, const T& high, size_t parts) const
+        {
+            std::vector<std::pair<Iterator, Iterator>> ranges;
+            for (auto [first, last] : partition_range (low, high, parts))
+                ranges.push_back ({Iterator (this, first), Iterator (this, last)});
 
-            return new_node;
+            return ranges;
         }
 
-        void swap (Tree& oth) noexcept
+        // Calls fn (key) for every key in [low, high], once per copy like
+        // for_each_in_range, from several threads at once: fn must be safe
+        // to call concurrently. The tree must not change meanwhile.
+        template<typename Fn>
+        void parallel_for_each (const T& low, const T& high, Fn fn, const ParallelOptions& opts = {}) const
         {
-            std::swap (root_, oth.root_);
-            std::swap (size_, oth.size_);
+            run_partitions (low, high, opts, [&](size_t, Node* first, Node* last)
+            {
+                for (Node* node = first; node != last; node = next_node (node))
+                    for (size_t copy = 0; copy < node->count(); ++copy)
+                        fn (static_cast<const T&>(node->data()));
+            });
         }
 
-        void clear_tree (Node* node) noexcept
+        // combine over map (key) for the keys in [low, high] in key order,
+        // copies included, starting from identity. Each thread folds its own partition and
+        // the partial results are combined in order, so combine only has to
+        // be associative.
+        template<typename R, typename Map, typename Combine>
+        R parallel_reduce (const T& low, const T& high, R identity, Map map, Combine combine,
+                           const ParallelOptions& opts = {}) const
         {
-            if (node == nullptr)
-                return;
-
-            std::vector<Node*> vec;
-            vec.push_back (node);
+            // one cache line per partial, so threads storing their results
+            // do not falsely share a line; it also keeps std::vector<R> from
+            // packing the partials into shared words and racing when R is
+            // bool
+            struct alignas (64) Partial
+            {
+                R value;
+            };
 
-            while (!vec.empty())
+            std::vector<Partial> partials;
+            run_partitions (low, high, opts, [&](size_t part, Node* first, Node* last)
             {
-                Node* current = vec.back();
-                vec.pop_back();
+                R acc = identity;
+                for (Node* node = first; node != last; node = next_node (node))
+                    for (size_t copy = 0; copy < node->count(); ++copy)
+                        acc = combine (std::move (acc), map (static_cast<const T&>(node->data())));
 
-                Node* left = current->left();
-                if (left)
-                    vec.push_back (left);
+                partials[part].value = std::move (acc);
+            }, [&](size_t parts) { partials.assign (parts, Partial {identity}); });
 
-                Node* right = current->right();
-                if (right)
-                    vec.push_back (right);
+            R result = std::move (identity);
+            for (Partial& partial : partials)
+                result = combine (std::move (result), std::move (partial.value));
 
-                delete current;
-            }
+            return result;
         }
 
-        Node* insert_data (const T& data)
-        {
-            Node* new_node = new Node (data);
+        static constexpr size_t node_size() noexcept { return sizeof (Node); }
 
-            if (root_ == nullptr)
-            {
-                root_ = new_node;
-                root_->set_color (Node::Color::BLACK);
-                size_ = 1;
-                return new_node;
-            }
+        allocator_type get_allocator() const { return allocator_type (alloc_); }
 
-            Node* curr = root_;
-            Node* parent = nullptr;
+        bool  empty() const noexcept { return size_ == 0; }
+        size_t size() const noexcept { return size_; }
 
-            while (curr != nullptr)
-            {
-                parent = curr;
-                if (new_node->data() < curr->data())
-                {
-                    curr = curr->left();
-                }
-                else if (new_node->data() > curr->data())
-                {
-                    curr = curr->right();
-                }
-                else
-                {
-                    delete new_node;
-                    return curr;
-                }
-            }
+        // Changes whenever the stored keys may have changed, so results
+        // computed from the tree can be reused while it stays the same
+        uint64_t version() const noexcept { return version_; }
 
-            new_node->set_parent (parent);
-            if (new_node->data() < parent->data())
-                parent->set_left (new_node);
-            else
-                parent->set_right (new_node);
+        void clear() noexcept
+        {
+            clear_tree (root_);
+            root_ = nullptr;
+            size_ = 0;
+            version_++;
+            reset_fingers();
+        }
 
-            size_++;
-            return new_node;
+        // The search starts from the previous insertion point, so sorted and
+        // nearly sorted input finds its place in O(1) amortized
+        void insert (const T& data)
+        {
+            insert_from (data, finger_, finger_climb_limit);
         }
 
-        void rotate (Node* node, Dir dir)
+        // Inserts data searching from hint (end() means "append") and
+        // returns an iterator to its node
+        Iterator insert (Iterator hint, const T& data)
         {
-            if (node == nullptr)
-                return;
+            return Iterator (this, insert_from (data, hint.curr_, std::numeric_limits<size_t>::max()));
+        }
 
-            Node* pivot = (dir == Dir::LEFT) ? node->right() : node->left();
-            if (pivot == nullptr)
-                return;
+        // Removes one copy of key (in multiset mode the count is decremented
+        // and the node only goes away with its last copy)
+        bool erase (const T& key)
+        {
+            Node* node = find_node (key);
+            if (node == nullptr)
+                return false;
 
-            pivot->set_parent (node->parent());
-            if (node->parent() != nullptr)
+            version_++;
+            if (node->count() > 1)
             {
-                if (node->parent()->left() == node)
-                    node->parent()->set_left (pivot);
-                else
-                    node->parent()->set_right (pivot);
+                node->set_count (node->count() - 1);
+                size_--;
+                update_sizes (node);
             }
             else
             {
-                root_ = pivot;
+                erase_node (node);
             }
 
-            if (dir == Dir::LEFT)
-            {
-                node->set_right (pivot->left());
-                if (pivot->left() != nullptr)
-                    pivot->left()->set_parent (node);
+            return true;
+        }
 
-                pivot->set_left (node);
-            }
-            else
-            {
-                node->set_left (pivot->right());
-                if (pivot->right() != nullptr)
-                    pivot->right()->set_parent (node);
+        // Removes every copy of key, returns how many there were
+        size_t erase_all (const T& key)
+        {
+            Node* node = find_node (key);
+            if (node == nullptr)
+                return 0;
 
-                pivot->set_right (node);
-            }
+            version_++;
+            size_t copies = node->count();
+            node->set_count (1);
+            size_ -= copies - 1;
+            erase_node (node);
 
-            node->set_parent (pivot);
+            return copies;
+        }
 
-            node->upd_subtree_size();
-            pivot->upd_subtree_size();
+        // Moves node contents so that the layout order matches ascending
+        // node addresses. With nodes from one arena, or from a heap that
+        // handed them out close together, a descent then touches a few
+        // pages instead of one per level. Iterators are invalidated.
+        void compact (Layout layout = Layout::VEB)
+        {
+            if (root_ == nullptr)
+                return;
+
+            std::vector<Node*> order;
+            order.reserve (root_->subtree_size());
+            layout_fragment (root_, layout, [](const Node*) { return true; }, order);
+            relayout (order);
+
+            compact_resume_ = false;
+            compact_top_pending_ = false;
         }
 
-        void update_sizes (Node* node)
+        // compact() in bounded pieces for quiet periods between operations:
+        // each call relayouts the next subtree of at most budget elements in
+        // key order, and after the last one the nodes above those subtrees
+        // (about 2 * size() / budget of them). Returns false when the call
+        // completed a whole pass. Iterators are invalidated.
+        bool compact_step (size_t budget = 4096, Layout layout = Layout::VEB)
         {
-            while (node != nullptr)
+            if (root_ == nullptr)
+                return false;
+
+            budget = std::max<size_t> (budget, 1);
+
+            Node* node = nullptr;
+            if (!compact_top_pending_)
+                node = compact_resume_ ? find_lower_bound (compact_cursor_) : min_;
+
+            while (node != nullptr && node->subtree_size() > budget)
+                node = next_node (node);
+
+            std::vector<Node*> order;
+            if (node == nullptr)
             {
-                node->upd_subtree_size();
-                node = node->parent();
+                layout_fragment (root_, layout, [budget](const Node* top)
+                {
+                    return top->subtree_size() > budget;
+                }, order);
+                relayout (order);
+
+                compact_resume_ = false;
+                compact_top_pending_ = false;
+
+                return false;
             }
-        }
 
-        void rotate_left  (Node* node) { rotate (node, Dir::LEFT); }
-        void rotate_right (Node* node) { rotate (node, Dir::RIGHT); }
+            while (node->parent() != nullptr && node->parent()->subtree_size() <= budget)
+                node = node->parent();
 
-        void fix_insert (Node* node)
-        {
-            fix_insert_root (node);
-        }
+            Node* after = next_node (max_node (node));      // outside the subtree, stays put
 
-        void fix_insert_root (Node* node)
-        {
-            if (node->parent() == nullptr)
+            layout_fragment (node, layout, [](const Node*) { return true; }, order);
+            relayout (order);
+
+            if (after != nullptr)
             {
-                node->set_color (Node::Color::BLACK);
-                root_ = node;
-                return;
+                compact_cursor_ = after->data();
+                compact_resume_ = true;
             }
+            else
+                compact_top_pending_ = true;
 
-            fix_insert_black_parent (node);
+            return true;
         }
 
-        void fix_insert_black_parent (Node* node)
+        void save_dot_to_file (const std::string& filename) const
         {
-            Node* parent = node->parent();
-            if (parent == nullptr || parent->is_black())
-                return;
-
-            fix_insert_red_uncle (node);
+            dump (filename);
+            std::cout << "[.dot file saved]: " << filename << std::endl;
         }
 
-        void fix_insert_red_uncle (Node* node)
+        // Streams the tree to a buffered file as DOT or JSON, optionally only
+        // a key range, the top levels, or just the shape statistics
+        void dump (const std::string& path, const DumpOptions<T>& opts = {}) const
         {
-            Node* uncle = node->uncle();
+            std::vector<char> buffer (opts.buffer_size);
+            std::ofstream file;
+            if (!buffer.empty())
+                file.rdbuf()->pubsetbuf (buffer.data(), static_cast<std::streamsize>(buffer.size()));
 
-            if (uncle != nullptr && uncle->is_red())
-            {
-                node->parent()->set_color (Node::Color::BLACK);
-                uncle->set_color (Node::Color::BLACK);
+            file.open (path);
+            if (!file)
+                throw std::runtime_error ("dump: cannot create " + path);
+
+            if (opts.stats_only)
+            {
+                ShapeStats stats = shape_stats();
+                if (opts.format == DumpFormat::JSON)
+                    write_stats_json (file, stats);
+                else
+                    write_stats_dot (file, stats);
+            }
+            else if (opts.format == DumpFormat::JSON)
+            {
+                write_json (file, opts);
+            }
+            else
+            {
+                write_dot (file, opts);
+            }
+
+            file.flush();
+            if (!file)
+                throw std::runtime_error ("dump: write failed for " + path);
+        }
+
+        // Full check of the balance (red-black, AVL, WAVL or treap), BST
+        // order, parent link and subtree size invariants in one O(n) pass;
+        // large trees are split into subtrees checked on separate threads
+        VerifyResult verify (const VerifyOptions& opts = {}) const
+        {
+            VerifyResult result;
+            if (root_ == nullptr)
+            {
+                if (size_ != 0)
+                    fail (result, "empty tree reports non-zero size");
+                return result;
+            }
+
+            if (root_->parent() != nullptr)
+                return fail (result, "root has a parent");
+            if (root_->is_red())
+                return fail (result, "root is red");
+            if (root_->subtree_size() != size_)
+                return fail (result, "root subtree size differs from tree size");
+
+            const size_t black_height = leftmost_black_height();
+
+            size_t threads = opts.threads ? opts.threads : std::thread::hardware_concurrency();
+            if (threads <= 1 || size_ < opts.parallel_threshold)
+            {
+                verify_subtree ({root_, nullptr, nullptr, 0}, black_height, result);
+                return result;
+            }
+
+            // Check the top levels here until there are enough independent
+            // subtrees to keep every thread busy, then hand those out
+            std::vector<VerifyFrame> frontier {{root_, nullptr, nullptr, 0}};
+            while (frontier.size() < threads * 4 && result.ok)
+            {
+                std::vector<VerifyFrame> next;
+                for (const VerifyFrame& frame : frontier)
+                    check_node (frame, black_height, result, next);
+
+                if (next.empty())
+                    break;
+
+                frontier.swap (next);
+            }
+
+            if (!result.ok)
+                return result;
+
+            std::atomic<size_t> cursor {0};
+            std::atomic<bool> failed {false};
+            std::mutex merge_mutex;
+
+            auto worker = [&]()
+            {
+                VerifyResult local;
+                for (size_t i = cursor++; i < frontier.size() && !failed; i = cursor++)
+                {
+                    verify_subtree (frontier[i], black_height, local);
+                    if (!local.ok)
+                        failed = true;
+                }
+
+                std::lock_guard<std::mutex> lock (merge_mutex);
+                result.nodes_checked += local.nodes_checked;
+                if (!local.ok && result.ok)
+                {
+                    result.ok = false;
+                    result.error = local.error;
+                }
+            };
+
+            std::vector<std::thread> pool;
+            for (size_t t = 1; t < threads; ++t)
+                pool.emplace_back (worker);
+            worker();
+
+            for (std::thread& thread : pool)
+                thread.join();
+
+            return result;
+        }
+
+        // Checks `paths` random root-to-leaf paths: O(paths * log n), cheap
+        // enough to run periodically on a live tree
+        VerifyResult verify_sampled (size_t paths, uint64_t seed = std::random_device{}()) const
+        {
+            VerifyResult result;
+            if (root_ == nullptr)
+                return result;
+
+            if (root_->parent() != nullptr || root_->is_red())
+                return fail (result, "bad root");
+
+            const size_t black_height = leftmost_black_height();
+            std::mt19937_64 rng (seed);
+            std::vector<VerifyFrame> next;
+
+            for (size_t path = 0; path < paths && result.ok; ++path)
+            {
+                VerifyFrame frame {root_, nullptr, nullptr, 0};
+                while (result.ok)
+                {
+                    next.clear();
+                    check_node (frame, black_height, result, next);
+                    if (next.empty())
+                        break;
+
+                    frame = next[rng() % next.size()];
+                }
+            }
+
+            return result;
+        }
+
+        ShapeStats shape_stats() const
+        {
+            ShapeStats stats;
+            stats.size = size_;
+
+            for (const Node* node = root_; node != nullptr; node = node->left())
+                stats.black_height += node->is_black();
+
+            if (root_ == nullptr)
+                return stats;
+
+            size_t depth_sum = 0;
+            std::vector<DumpFrame> stack;
+            stack.push_back ({root_, 0});
+
+            while (!stack.empty())
+            {
+                DumpFrame frame = stack.back();
+                stack.pop_back();
+
+                const Node* node = frame.node;
+                if (stats.nodes_per_depth.size() <= frame.depth)
+                    stats.nodes_per_depth.resize (frame.depth + 1, 0);
+                stats.nodes_per_depth[frame.depth]++;
+
+                size_t bucket = 0;
+                while ((size_t{2} << bucket) <= node->subtree_size())
+                    ++bucket;
+                if (stats.subtree_size_log2.size() <= bucket)
+                    stats.subtree_size_log2.resize (bucket + 1, 0);
+                stats.subtree_size_log2[bucket]++;
+
+                stats.nodes++;
+                stats.red_nodes += node->is_red();
+                depth_sum += frame.depth;
+
+                if (node->right())
+                    stack.push_back ({node->right(), frame.depth + 1});
+                if (node->left())
+                    stack.push_back ({node->left(), frame.depth + 1});
+            }
+
+            stats.height = stats.nodes_per_depth.size();
+            stats.avg_depth = static_cast<double>(depth_sum) / static_cast<double>(stats.nodes);
+
+            return stats;
+        }
+
+        // Binary snapshot, see snapshot.hpp for the format
+        void save (const std::string& path) const
+        {
+            std::ofstream file (path, std::ios::binary | std::ios::trunc);
+            if (!file)
+                throw std::runtime_error ("snapshot: cannot create " + path);
+
+            save (file, path);
+        }
+
+        // Same into any seekable binary stream; name is for error messages
+        void save (std::ostream& file, const std::string& name) const
+        {
+            static_assert (snapshot::is_serializable_v<T>,
+                           "snapshots need an integral or trivially copyable key type");
+
+            snapshot::Header header {};
+            std::memcpy (header.magic, snapshot::MAGIC, sizeof (snapshot::MAGIC));
+            header.version = snapshot::VERSION;
+            header.encoding = static_cast<uint8_t>(snapshot::encoding_for<T>());
+            header.elem_size = static_cast<uint32_t>(sizeof (T));
+            header.count = size_;
+
+            file.write (reinterpret_cast<const char*>(&header), sizeof (header));
+
+            snapshot::Checksum checksum;
+            std::vector<unsigned char> buffer;
+            buffer.reserve (1 << 16);
+
+            auto flush = [&]()
+            {
+                checksum.update (buffer.data(), buffer.size());
+                file.write (reinterpret_cast<const char*>(buffer.data()),
+                            static_cast<std::streamsize>(buffer.size()));
+                header.payload_bytes += buffer.size();
+                buffer.clear();
+            };
+
+            [[maybe_unused]] snapshot::encoder_t<T> encoder {};
+            unsigned char scratch[16];
+
+            // Multiset nodes write their key once per copy (a zero delta each)
+            for (Node* node = min_node(); node != nullptr; node = next_node (node))
+            {
+                for (size_t copy = 0; copy < node->count(); ++copy)
+                {
+                    size_t len = 0;
+                    if constexpr (snapshot::is_delta_encodable_v<T>)
+                    {
+                        len = encoder.encode (node->data(), scratch);
+                        buffer.insert (buffer.end(), scratch, scratch + len);
+                    }
+                    else
+                    {
+                        const unsigned char* raw = reinterpret_cast<const unsigned char*>(&node->data());
+                        buffer.insert (buffer.end(), raw, raw + sizeof (T));
+                    }
+
+                    if (buffer.size() >= (1 << 16) - sizeof (scratch) - sizeof (T))
+                        flush();
+                }
+            }
+            flush();
+
+            snapshot::checksum_header (checksum, header);
+            header.checksum = checksum.value();
+            file.seekp (0);
+            file.write (reinterpret_cast<const char*>(&header), sizeof (header));
+
+            file.flush();
+            if (!file)
+                throw std::runtime_error ("snapshot: write failed for " + name);
+        }
+
+        // Replaces the contents with a snapshot; the tree is rebuilt balanced
+        // in O(n) straight from the (mapped) file, without per-key inserts
+        void load (const std::string& path)
+        {
+            static_assert (snapshot::is_serializable_v<T>,
+                           "snapshots need an integral or trivially copyable key type");
+
+            snapshot::FileView view (path);
+            if (view.size() < sizeof (snapshot::Header))
+                throw std::runtime_error ("snapshot: file too short: " + path);
+
+            snapshot::Header header;
+            std::memcpy (&header, view.data(), sizeof (header));
+            snapshot::check_header (header, snapshot::encoding_for<T>(), sizeof (T), path);
+
+            const unsigned char* payload = view.data() + sizeof (header);
+            const unsigned char* end = payload + header.payload_bytes;
+            if (header.payload_bytes > view.size() - sizeof (header))
+                throw std::runtime_error ("snapshot: truncated payload in " + path);
+
+            snapshot::Checksum checksum;
+            checksum.update (payload, header.payload_bytes);
+            snapshot::checksum_header (checksum, header);
+            if (checksum.value() != header.checksum)
+                throw std::runtime_error ("snapshot: checksum mismatch in " + path);
+
+            [[maybe_unused]] snapshot::decoder_t<T> decoder {};
+            const unsigned char* cursor = payload;
+
+            auto read_key = [&]() -> T
+            {
+                T key {};
+                if constexpr (snapshot::is_delta_encodable_v<T>)
+                {
+                    cursor = decoder.decode (cursor, end, key);
+                }
+                else
+                {
+                    std::memcpy (&key, cursor, sizeof (T));
+                    cursor += sizeof (T);
+                }
+
+                return key;
+            };
+
+            // First pass: validate the order and count distinct keys, so the
+            // build pass below cannot fail halfway
+            const size_t total = static_cast<size_t>(header.count);
+            size_t distinct = 0;
+            T prev {};
+            for (size_t i = 0; i < total; ++i)
+            {
+                T key = read_key();
+                if (i != 0 && !(prev < key))
+                {
+                    if (!is_multiset || key < prev)
+                        throw std::runtime_error ("snapshot: keys out of order in " + path);
+                    continue;
+                }
+
+                prev = key;
+                ++distinct;
+            }
+
+            if (cursor != end)
+                throw std::runtime_error ("snapshot: trailing bytes in " + path);
+
+            cursor = payload;
+            decoder = {};
+
+            size_t consumed = 0;
+            bool has_pending = false;
+            T pending {};
+
+            auto next_entry = [&]() -> std::pair<T, size_t>
+            {
+                T key = has_pending ? pending : read_key();
+                consumed += !has_pending;
+                has_pending = false;
+
+                size_t copies = 1;
+                while (is_multiset && consumed < total)
+                {
+                    T next = read_key();
+                    ++consumed;
+                    if (key < next)
+                    {
+                        pending = next;
+                        has_pending = true;
+                        break;
+                    }
+                    ++copies;
+                }
+
+                return {key, copies};
+            };
+
+            Tree fresh (alloc_);
+            fresh.build_from_sorted (distinct, next_entry);
+            swap (fresh);
+        }
+
+    private:
+        // Read-only views that walk the nodes and their aggregates directly
+        template<typename> friend class IntervalTree;
+
+        // Builds a perfectly balanced tree of n nodes from {key, copies}
+        // pairs yielded in ascending key order by next_entry(). Every level is
+        // black except the deepest one, which is red, so all root-to-NIL
+        // paths share a black height; other policies derive their state from
+        // the finished children.
+        template<typename NextEntry>
+        void build_from_sorted (size_t n, NextEntry& next_entry)
+        {
+            clear();
+            if (n == 0)
+                return;
+
+            size_t red_depth = 0;
+            while ((size_t{2} << red_depth) <= n)
+                ++red_depth;
+
+            root_ = build_subtree (n, 0, red_depth, nullptr, next_entry);
+            size_ = root_->subtree_size();
+            reset_fingers();
+        }
+
+        template<typename NextEntry>
+        Node* build_subtree (size_t n, size_t depth, size_t red_depth, Node* parent,
+                             NextEntry& next_entry)
+        {
+            if (n == 0)
+                return nullptr;
+
+            size_t left_n = (n - 1) / 2;
+
+            Node* left = build_subtree (left_n, depth + 1, red_depth, nullptr, next_entry);
+
+            auto color = (is_red_black && depth == red_depth && depth != 0) ? Node::Color::RED : Node::Color::BLACK;
+            auto [key, copies] = next_entry();
+            Node* node = make_node (std::move (key), color, left, nullptr, parent);
+            node->set_count (copies);
+            if (left != nullptr)
+                left->set_parent (node);
+
+            Node* right = build_subtree (n - 1 - left_n, depth + 1, red_depth, node, next_entry);
+            node->set_right (right);
+            node->upd_subtree_size();
+            init_balance (node);
+
+            return node;
+        }
+
+        Node* copy_subtree (const Node* node, Node* parent)
+        {
+            if (node == nullptr)
+                return nullptr;
+
+            Node* new_node = make_node (node->data(), node->color(), nullptr, nullptr, parent);
+            new_node->set_count (node->count());
+            new_node->balance_ = node->balance_;
+
+            Node* left_child = copy_subtree (node->left(), new_node);
+            new_node->set_left (left_child);
+            if (left_child != nullptr)
+                left_child->set_parent (new_node);
+
+            Node* right_child = copy_subtree (node->right(), new_node);
+            new_node->set_right (right_child);
+            if (right_child != nullptr)
+                right_child->set_parent (new_node);
+
+            new_node->upd_subtree_size();
+
+            return new_node;
+        }
+
+        template<typename... Args>
+        Node* make_node (Args&&... args)
+        {
+            Node* node = node_traits::allocate (alloc_, 1);
+            node_traits::construct (alloc_, node, std::forward<Args>(args)...);
+
+            return node;
+        }
+
+        void destroy_node (Node* node) noexcept
+        {
+            node_traits::destroy (alloc_, node);
+            node_traits::deallocate (alloc_, node, 1);
+        }
+
+        // Appends the nodes of the connected fragment below root for which
+        // include() holds, in layout order; root comes first
+        template<typename Include>
+        void layout_fragment (Node* root, Layout layout, const Include& include, std::vector<Node*>& out) const
+        {
+            if (root == nullptr || !include (root))
+                return;
+
+            if (layout == Layout::PREORDER)
+            {
+                std::vector<Node*> stack {root};
+                while (!stack.empty())
+                {
+                    Node* node = stack.back();
+                    stack.pop_back();
+                    out.push_back (node);
+
+                    for (Node* child : {node->right(), node->left()})
+                        if (child != nullptr && include (child))
+                            stack.push_back (child);
+                }
+
+                return;
+            }
+
+            veb_order (root, fragment_height (root, include), include, out);
+        }
+
+        template<typename Include>
+        static size_t fragment_height (Node* root, const Include& include)
+        {
+            size_t height = 0;
+            std::vector<std::pair<Node*, size_t>> stack {{root, 1}};
+            while (!stack.empty())
+            {
+                auto [node, depth] = stack.back();
+                stack.pop_back();
+                height = std::max (height, depth);
+
+                for (Node* child : {node->left(), node->right()})
+                    if (child != nullptr && include (child))
+                        stack.push_back ({child, depth + 1});
+            }
+
+            return height;
+        }
+
+        // Lays out the top height / 2 levels below root, then every
+        // fragment hanging below them left to right, each the same way
+        template<typename Include>
+        static void veb_order (Node* root, size_t height, const Include& include, std::vector<Node*>& out)
+        {
+            if (height == 1)
+            {
+                out.push_back (root);
+                return;
+            }
+
+            size_t top = height / 2;
+            veb_order (root, top, include, out);
+
+            std::vector<std::pair<Node*, size_t>> stack {{root, 0}};
+            std::vector<Node*> bottoms;
+            while (!stack.empty())
+            {
+                auto [node, depth] = stack.back();
+                stack.pop_back();
+
+                if (depth == top)
+                {
+                    bottoms.push_back (node);
+                    continue;
+                }
+
+                for (Node* child : {node->right(), node->left()})
+                    if (child != nullptr && include (child))
+                        stack.push_back ({child, depth + 1});
+            }
+
+            for (Node* bottom : bottoms)
+                veb_order (bottom, height - top, include, out);
+        }
+
+        // Permutes the contents of a connected fragment (order[0] its root)
+        // among the fragment's own nodes, so that order[i] lands in the i-th
+        // lowest address, and repoints every link into the fragment
+        void relayout (const std::vector<Node*>& order)
+        {
+            if (order.empty())
+                return;
+
+            std::vector<Node*> slots (order);
+            std::sort (slots.begin(), slots.end(), std::less<Node*> {});
+
+            std::vector<std::pair<Node*, Node*>> moves (order.size());
+            for (size_t i = 0; i < order.size(); ++i)
+                moves[i] = {order[i], slots[i]};
+            std::sort (moves.begin(), moves.end(), [](const auto& lhs, const auto& rhs)
+            {
+                return std::less<Node*> {}(lhs.first, rhs.first);
+            });
+
+            auto moved_to = [&](Node* node)
+            {
+                auto it = std::lower_bound (moves.begin(), moves.end(), node, [](const auto& move, Node* key)
+                {
+                    return std::less<Node*> {}(move.first, key);
+                });
+                return (node != nullptr && it != moves.end() && it->first == node) ? it->second : node;
+            };
+
+            struct Content
+            {
+                T data;
+                typename Node::Color color;
+                balance_state balance;
+                Node* left;
+                Node* right;
+                Node* parent;
+                size_t subtree_size;
+                aggregate_type aggregate;
+                count_type count;
+            };
+
+            std::vector<Content> contents;
+            contents.reserve (order.size());
+            for (Node* node : order)
+                contents.push_back ({std::move (node->data_), node->color_, node->balance_,
+                                     moved_to (node->child_[0]), moved_to (node->child_[1]), node->parent_,
+                                     node->subtree_size_, node->aggregate_, node->count_});
+
+            Node* old_root = order[0];
+            for (size_t i = 0; i < slots.size(); ++i)
+            {
+                Node* slot = slots[i];
+                Content& content = contents[i];
+
+                slot->data_ = std::move (content.data);
+                slot->color_ = content.color;
+                slot->balance_ = content.balance;
+                slot->child_[0] = content.left;
+                slot->child_[1] = content.right;
+                slot->parent_ = (i == 0) ? content.parent : moved_to (content.parent);
+                slot->subtree_size_ = content.subtree_size;
+                slot->aggregate_ = content.aggregate;
+                slot->count_ = content.count;
+            }
+
+            // children hanging below the fragment and the link from above
+            for (Node* slot : slots)
+                for (Node* child : slot->child_)
+                    if (child != nullptr)
+                        child->parent_ = slot;
+
+            Node* parent = slots[0]->parent_;
+            if (parent == nullptr)
+                root_ = slots[0];
+            else
+                parent->child_[parent->child_[0] == old_root ? 0 : 1] = slots[0];
+
+            min_ = moved_to (min_);
+            max_ = moved_to (max_);
+            finger_ = moved_to (finger_);
+        }
+
+        void swap (Tree& oth) noexcept
+        {
+            std::swap (alloc_, oth.alloc_);
+            std::swap (root_, oth.root_);
+            std::swap (size_, oth.size_);
+            std::swap (min_, oth.min_);
+            std::swap (max_, oth.max_);
+            std::swap (finger_, oth.finger_);
+            std::swap (compact_cursor_, oth.compact_cursor_);
+            std::swap (compact_resume_, oth.compact_resume_);
+            std::swap (compact_top_pending_, oth.compact_top_pending_);
+            version_++;
+            oth.version_++;
+        }
+
+        void reset_fingers() noexcept
+        {
+            min_ = min_node (root_);
+            max_ = max_node (root_);
+            finger_ = nullptr;
+        }
+
+        Node* insert_from (const T& data, Node* hint, size_t max_climb)
+        {
+            auto [node, added] = insert_data (data, finger_start (data, hint, max_climb).first);
+            if (!added)
+                return node;
+
+            version_++;
+            finger_ = node;
+            if (node->count() == 1)
+                rebalance_insert (node);
+
+            update_sizes (node);
+
+            return node;
+        }
+
+        // Where a search for key may start instead of root_: the lowest
+        // ancestor of hint whose key interval strictly contains key, or
+        // min_/max_ when key falls outside the tree. Also returns the node
+        // bounding that subtree from above (null if none), which is the
+        // answer to a bound search that finds nothing inside the subtree.
+        // After max_climb levels the search falls back to root_.
+        std::pair<Node*, Node*> finger_start (const T& key, Node* hint,
+                                              size_t max_climb = std::numeric_limits<size_t>::max()) const
+        {
+            if (max_ != nullptr && max_->data() < key)
+                return {max_, nullptr};
+
+            if (min_ != nullptr && key < min_->data())
+                return {min_, min_};
+
+            if (hint == nullptr)
+                return {root_, nullptr};
+
+            bool after_hint = !(key < hint->data());
+
+            Node* curr = hint;
+            for (size_t climbed = 0; curr->parent() != nullptr; ++climbed)
+            {
+                if (climbed == max_climb)
+                    return {root_, nullptr};
+
+                Node* parent = curr->parent();
+                bool from_left = (curr == parent->left());
+
+                if (after_hint && from_left && key < parent->data())
+                    return {curr, parent};
+
+                if (!after_hint && !from_left && parent->data() < key)
+                    return {curr, nullptr};
+
+                curr = parent;
+            }
+
+            return {curr, nullptr};
+        }
+
+
+        void clear_tree (Node* node) noexcept
+        {
+            if (node == nullptr)
+                return;
+
+            std::vector<Node*> vec;
+            vec.push_back (node);
+
+            while (!vec.empty())
+            {
+                Node* current = vec.back();
+                vec.pop_back();
+
+                Node* left = current->left();
+                if (left)
+                    vec.push_back (left);
+
+                Node* right = current->right();
+                if (right)
+                    vec.push_back (right);
+
+                destroy_node (current);
+            }
+        }
+
+        // Descends from start, which must span data, and links a new red
+        // leaf for it. Returns {node holding data, whether a copy was added}:
+        // a duplicate bumps the existing count in multiset mode and is
+        // ignored otherwise.
+        std::pair<Node*, bool> insert_data (const T& data, Node* start)
+        {
+            Node* curr = start;
+            Node* parent = nullptr;
+            bool go_left = false;
+
+            while (curr != nullptr)
+            {
+                parent = curr;
+                if (data < curr->data())
+                {
+                    go_left = true;
+                    curr = curr->left();
+                }
+                else if (data > curr->data())
+                {
+                    go_left = false;
+                    curr = curr->right();
+                }
+                else
+                {
+                    if constexpr (!is_multiset)
+                        return {curr, false};
+
+                    curr->set_count (curr->count() + 1);
+                    size_++;
+                    return {curr, true};
+                }
+            }
+
+            Node* new_node = make_node (data, leaf_color);
+            size_++;
+
+            if (parent == nullptr)
+            {
+                root_ = new_node;
+                root_->set_color (Node::Color::BLACK);
+                min_ = max_ = new_node;
+                return {new_node, true};
+            }
+
+            new_node->set_parent (parent);
+            if (go_left)
+                parent->set_left (new_node);
+            else
+                parent->set_right (new_node);
+
+            if (go_left && parent == min_)
+                min_ = new_node;
+            if (!go_left && parent == max_)
+                max_ = new_node;
+
+            return {new_node, true};
+        }
+
+        // Puts child (possibly null) where node hangs from its parent
+        void transplant (Node* node, Node* child)
+        {
+            Node* parent = node->parent();
+            if (parent == nullptr)
+                root_ = child;
+            else if (node == parent->left())
+                parent->set_left (child);
+            else
+                parent->set_right (child);
+
+            if (child != nullptr)
+                child->set_parent (parent);
+        }
+
+        // Unlinks and frees a node holding a single copy
+        void erase_node (Node* node)
+        {
+            if (node == finger_)
+                finger_ = nullptr;
+            if (node == min_)
+                min_ = next_node (node);
+            if (node == max_)
+                max_ = prev_node (node);
+
+            Node* moved = node;                     // node that leaves its position
+            bool removed_black = moved->is_black();
+            Node* child = nullptr;                  // takes moved's place
+            Node* child_parent = nullptr;
+
+            if (node->left() == nullptr)
+            {
+                child = node->right();
+                child_parent = node->parent();
+                transplant (node, child);
+            }
+            else if (node->right() == nullptr)
+            {
+                child = node->left();
+                child_parent = node->parent();
+                transplant (node, child);
+            }
+            else
+            {
+                moved = min_node (node->right());
+                removed_black = moved->is_black();
+                child = moved->right();
+
+                if (moved->parent() == node)
+                {
+                    child_parent = moved;
+                }
+                else
+                {
+                    child_parent = moved->parent();
+                    transplant (moved, moved->right());
+                    moved->set_right (node->right());
+                    moved->right()->set_parent (moved);
+                }
+
+                transplant (node, moved);
+                moved->set_left (node->left());
+                moved->left()->set_parent (moved);
+                moved->set_color (node->color());
+                moved->balance_ = node->balance_;
+            }
+
+            destroy_node (node);
+            size_--;
+
+            update_sizes (child_parent);
+
+            if constexpr (is_red_black)
+            {
+                if (removed_black)
+                    fix_erase (child, child_parent);
+            }
+            else
+            {
+                rebalance_erase (child, child_parent);
+            }
+        }
+
+        static bool is_black_or_null (const Node* node)
+        {
+            return node == nullptr || node->is_black();
+        }
+
+        // node carries an extra black; push it up or resolve it with the
+        // sibling's colours and at most three rotations
+        void fix_erase (Node* node, Node* parent)
+        {
+            while (node != root_ && is_black_or_null (node))
+            {
+                bool is_left = (node == parent->left());
+                Dir toward = is_left ? Dir::LEFT : Dir::RIGHT;
+                Dir away   = is_left ? Dir::RIGHT : Dir::LEFT;
+
+                Node* sibling = is_left ? parent->right() : parent->left();
+
+                if (sibling->is_red())
+                {
+                    sibling->set_color (Node::Color::BLACK);
+                    parent->set_color (Node::Color::RED);
+                    rotate (parent, toward);
+                    sibling = is_left ? parent->right() : parent->left();
+                }
+
+                Node* near = is_left ? sibling->left() : sibling->right();
+                Node* far  = is_left ? sibling->right() : sibling->left();
+
+                if (is_black_or_null (near) && is_black_or_null (far))
+                {
+                    sibling->set_color (Node::Color::RED);
+                    node = parent;
+                    parent = node->parent();
+                    continue;
+                }
+
+                if (is_black_or_null (far))
+                {
+                    near->set_color (Node::Color::BLACK);
+                    sibling->set_color (Node::Color::RED);
+                    rotate (sibling, away);
+                    sibling = is_left ? parent->right() : parent->left();
+                    far = is_left ? sibling->right() : sibling->left();
+                }
+
+                sibling->set_color (parent->color());
+                parent->set_color (Node::Color::BLACK);
+                far->set_color (Node::Color::BLACK);
+                rotate (parent, toward);
+                node = root_;
+            }
+
+            if (node != nullptr)
+                node->set_color (Node::Color::BLACK);
+        }
+
+        // In-order visit of the nodes with keys in [low, high]. The stack
+        // holds the pending ancestors, at most the tree height.
+        template<typename Visit>
+        void walk_range (const T& low, const T& high, const Visit& visit) const
+        {
+            if (high < low || root_ == nullptr)
+                return;
+
+            size_t height_bound = 2;
+            for (size_t n = size_; n != 0; n >>= 1)
+                height_bound += 2;
+
+            std::vector<const Node*> stack;
+            stack.reserve (height_bound);
+
+            for (const Node* node = root_; node != nullptr; )
+            {
+                if (node->data() < low)
+                {
+                    node = node->right();
+                }
+                else
+                {
+                    stack.push_back (node);
+                    node = node->left();
+                }
+            }
+
+            while (!stack.empty())
+            {
+                const Node* node = stack.back();
+                stack.pop_back();
+                if (high < node->data())
+                    return;
+
+                visit (node);
+
+                for (const Node* child = node->right(); child != nullptr; child = child->left())
+                    stack.push_back (child);
+            }
+        }
+
+        Node* node_at (size_t index) const
+        {
+            Node* curr = root_;
+            while (curr != nullptr)
+            {
+                size_t left = curr->left() ? curr->left()->subtree_size() : 0;
+                if (index < left)
+                {
+                    curr = curr->left();
+                }
+                else if (index < left + curr->count())
+                {
+                    return curr;
+                }
+                else
+                {
+                    index -= left + curr->count();
+                    curr = curr->right();
+                }
+            }
+
+            return nullptr;
+        }
+
+        // [first, last) node ranges covering [low, high], cut at equally
+        // spaced ranks; a cut inside the copies of a multiset node goes to
+        // the start of that node
+        std::vector<std::pair<Node*, Node*>> partition_range (const T& low, const T& high, size_t parts) const
+        {
+            std::vector<std::pair<Node*, Node*>> ranges;
+            if (high < low || parts == 0)
+                return ranges;
+
+            size_t begin = rank<BoundType::LOWER> (low);
+            size_t end = rank<BoundType::UPPER> (high);
+            if (begin >= end)
+                return ranges;
+
+            Node* last = find_upper_bound (high);
+            Node* first = node_at (begin);
+            for (size_t part = 1; part <= parts; ++part)
+            {
+                Node* next = (part == parts) ? last : node_at (begin + (end - begin) * part / parts);
+                if (next != first)
+                    ranges.push_back ({first, next});
+                first = next;
+            }
+
+            return ranges;
+        }
+
+        // Runs body (index, first, last) on every partition of [low, high],
+        // one per thread; before that, prepare (partition count) if given.
+        // Each call starts its threads afresh rather than borrowing them
+        // from a pool, which min_partition keeps worth the start-up cost.
+        template<typename Body, typename Prepare = void (*)(size_t)>
+        void run_partitions (const T& low, const T& high, const ParallelOptions& opts, const Body& body,
+                             const Prepare& prepare = [](size_t) {}) const
+        {
+            size_t in_range = range_queries_solve (low, high);
+            size_t threads = opts.threads ? opts.threads : std::thread::hardware_concurrency();
+            size_t parts = std::clamp<size_t> (in_range / std::max<size_t> (opts.min_partition, 1),
+                                               1, std::max<size_t> (threads, 1));
+
+            std::vector<std::pair<Node*, Node*>> ranges = partition_range (low, high, parts);
+            prepare (ranges.size());
+            if (ranges.size() <= 1)
+            {
+                if (!ranges.empty())
+                    body (0, ranges[0].first, ranges[0].second);
+                return;
+            }
+
+            std::vector<std::exception_ptr> errors (ranges.size());
+            auto guarded = [&](size_t part)
+            {
+                try
+                {
+                    body (part, ranges[part].first, ranges[part].second);
+                }
+                catch (...)
+                {
+                    errors[part] = std::current_exception();
+                }
+            };
+
+            // a thread that fails to start must not leave the others unjoined
+            std::vector<std::thread> pool;
+            pool.reserve (ranges.size() - 1);
+            try
+            {
+                for (size_t part = 1; part < ranges.size(); ++part)
+                    pool.emplace_back (guarded, part);
+            }
+            catch (...)
+            {
+                for (std::thread& thread : pool)
+                    thread.join();
+                throw;
+            }
+            guarded (0);
+
+            for (std::thread& thread : pool)
+                thread.join();
+
+            for (const std::exception_ptr& error : errors)
+                if (error)
+                    std::rethrow_exception (error);
+        }
+
+        Node* find_node (const T& key) const
+        {
+            Node* curr = root_;
+            while (curr != nullptr)
+            {
+                if (key < curr->data())
+                    curr = curr->left();
+                else if (curr->data() < key)
+                    curr = curr->right();
+                else
+                    return curr;
+            }
+
+            return nullptr;
+        }
+
+        // Elements before the lower (upper) bound of key
+        template<BoundType Type>
+        size_t rank (const T& key) const
+        {
+            const Node* curr = root_;
+            size_t count = 0;
+
+            while (curr != nullptr)
+            {
+                bool go_left = bound_goes_left<Type> (key, curr->data_);
+                if constexpr (branchless_keys)
+                {
+                    const Node* right = curr->child_[1];
+                    size_t skipped = curr->subtree_size() - (right ? right->subtree_size() : 0);
+                    count += go_left ? 0 : skipped;
+                    curr = curr->child_[!go_left];
+                }
+                else if (go_left)
+                {
+                    curr = curr->left();
+                }
+                else
+                {
+                    count += curr->subtree_size() - (curr->right() ? curr->right()->subtree_size() : 0);
+                    curr = curr->right();
+                }
+            }
+
+            return count;
+        }
+
+        void rotate (Node* node, Dir dir)
+        {
+            if (node == nullptr)
+                return;
+
+            Node* pivot = (dir == Dir::LEFT) ? node->right() : node->left();
+            if (pivot == nullptr)
+                return;
+
+            pivot->set_parent (node->parent());
+            if (node->parent() != nullptr)
+            {
+                if (node->parent()->left() == node)
+                    node->parent()->set_left (pivot);
+                else
+                    node->parent()->set_right (pivot);
+            }
+            else
+            {
+                root_ = pivot;
+            }
+
+            if (dir == Dir::LEFT)
+            {
+                node->set_right (pivot->left());
+                if (pivot->left() != nullptr)
+                    pivot->left()->set_parent (node);
+
+                pivot->set_left (node);
+            }
+            else
+            {
+                node->set_left (pivot->right());
+                if (pivot->right() != nullptr)
+                    pivot->right()->set_parent (node);
+
+                pivot->set_right (node);
+            }
+
+            node->set_parent (pivot);
+
+            node->upd_subtree_size();
+            pivot->upd_subtree_size();
+        }
+
+        void update_sizes (Node* node)
+        {
+            while (node != nullptr)
+            {
+                node->upd_subtree_size();
+                node = node->parent();
+            }
+        }
+
+        void rotate_left  (Node* node) { rotate (node, Dir::LEFT); }
+        void rotate_right (Node* node) { rotate (node, Dir::RIGHT); }
+
+        void fix_insert (Node* node)
+        {
+            fix_insert_root (node);
+        }
+
+        void fix_insert_root (Node* node)
+        {
+            if (node->parent() == nullptr)
+            {
+                node->set_color (Node::Color::BLACK);
+                root_ = node;
+                return;
+            }
+
+            fix_insert_black_parent (node);
+        }
+
+        void fix_insert_black_parent (Node* node)
+        {
+            Node* parent = node->parent();
+            if (parent == nullptr || parent->is_black())
+                return;
+
+            fix_insert_red_uncle (node);
+        }
+
+        void fix_insert_red_uncle (Node* node)
+        {
+            Node* uncle = node->uncle();
+
+            if (uncle != nullptr && uncle->is_red())
+            {
+                node->parent()->set_color (Node::Color::BLACK);
+                uncle->set_color (Node::Color::BLACK);
 
                 Node* gp = node->grandparent();
                 if (gp != nullptr)
@@ -552,58 +2057,455 @@ namespace rb
                 rotate_left (gp);
         }
 
-        void generate_dot_node (std::stringstream& sstr, const Node* node) const
+        // Fix-up after a new leaf was linked in
+        void rebalance_insert (Node* node)
         {
-            if (node == nullptr)
+            if constexpr (is_red_black)
+                fix_insert (node);
+            else if constexpr (std::is_same_v<Balance, Avl>)
+                avl_retrace (node->parent());
+            else if constexpr (std::is_same_v<Balance, Wavl>)
+                wavl_fix_insert (node);
+            else
+                treap_sift_up (node);
+        }
+
+        // Fix-up after child (possibly null) took the place of a removed
+        // node below parent. A treap has nothing to do: the node moved into
+        // the removed one's position took over its priority as well.
+        void rebalance_erase (Node* child, Node* parent)
+        {
+            if constexpr (std::is_same_v<Balance, Avl>)
+                avl_retrace (parent);
+            else if constexpr (std::is_same_v<Balance, Wavl>)
+                wavl_fix_erase (child, parent);
+
+            (void) child;
+            (void) parent;
+        }
+
+        // Balance state of a node built bottom-up from sorted input
+        void init_balance (Node* node)
+        {
+            if constexpr (std::is_same_v<Balance, Avl>)
+            {
+                avl_refresh (node);
+            }
+            else if constexpr (std::is_same_v<Balance, Wavl>)
+            {
+                node->balance_ = static_cast<balance_state>(1 + std::max (rank_of (node->left()),
+                                                                          rank_of (node->right())));
+            }
+            else if constexpr (std::is_same_v<Balance, Treap>)
+            {
+                // The priority a random treap expects at this subtree size:
+                // heap ordered, and later inserts settle at their usual depth
+                constexpr uint32_t top = std::numeric_limits<uint32_t>::max();
+                node->balance_ = top - static_cast<uint32_t>(top / (node->subtree_size() + 1));
+            }
+        }
+
+        static int height_of (const Node* node) { return node ? node->balance_ : 0; }
+        static int rank_of (const Node* node) { return node ? node->balance_ : -1; }
+
+        static void avl_refresh (Node* node)
+        {
+            node->balance_ = static_cast<balance_state>(1 + std::max (height_of (node->left()),
+                                                                      height_of (node->right())));
+        }
+
+        // Recomputes the heights from node up to the root, with a single or
+        // double rotation wherever the two sides differ by two
+        void avl_retrace (Node* node)
+        {
+            while (node != nullptr)
+            {
+                int diff = height_of (node->right()) - height_of (node->left());
+                if (diff > 1 || diff < -1)
+                {
+                    bool heavy_right = (diff > 0);
+                    Node* child = node->child (heavy_right);
+                    if (height_of (child->child (!heavy_right)) > height_of (child->child (heavy_right)))
+                    {
+                        rotate (child, heavy_right ? Dir::RIGHT : Dir::LEFT);
+                        avl_refresh (child);
+                    }
+
+                    rotate (node, heavy_right ? Dir::LEFT : Dir::RIGHT);
+                    avl_refresh (node);
+                    node = node->parent();
+                }
+
+                avl_refresh (node);
+                node = node->parent();
+            }
+        }
+
+        // WAVL ranks: every rank difference to a child is 1 or 2, with null
+        // children at rank -1 and leaves at rank 0. A new leaf can leave its
+        // parent with a 0-child: promote up the tree, or finish with one or
+        // two rotations (Haeupler, Sen, Tarjan).
+        void wavl_fix_insert (Node* node)
+        {
+            for (Node* parent = node->parent(); parent && rank_of (parent) == rank_of (node);
+                 parent = node->parent())
+            {
+                bool is_left = (node == parent->left());
+                if (rank_of (parent) - rank_of (parent->child (is_left)) == 1)
+                {
+                    parent->balance_++;
+                    node = parent;
+                    continue;
+                }
+
+                Dir lift = is_left ? Dir::RIGHT : Dir::LEFT;
+                Node* inner = node->child (is_left);
+                if (rank_of (node) - rank_of (inner) == 2)
+                {
+                    rotate (parent, lift);
+                    parent->balance_--;
+                }
+                else
+                {
+                    rotate (node, is_left ? Dir::LEFT : Dir::RIGHT);
+                    rotate (parent, lift);
+                    inner->balance_++;
+                    node->balance_--;
+                    parent->balance_--;
+                }
+
                 return;
+            }
+        }
 
-            std::string node_color = node->is_red() ? "red" : "black";
-            std::string fill_color = node->is_red() ? "#FF4444" : "#333333";
-            std::string font_color = "white";
+        // A removal can leave a leaf of rank 1 or a 3-child below parent:
+        // demote up the tree, or finish with one or two rotations
+        void wavl_fix_erase (Node* node, Node* parent)
+        {
+            if (parent == nullptr)
+                return;
 
-            sstr << "    \"" << node << "\" [label=\"" << node->data()
-                 << "\\n(size=" << node->subtree_size() << ")\", style=filled, fillcolor=\""
-                 << fill_color << "\", fontcolor=" << font_color << "];\n";
+            if (parent->left() == nullptr && parent->right() == nullptr && parent->balance_ == 1)
+            {
+                parent->balance_ = 0;
+                node = parent;
+                parent = node->parent();
+            }
 
-            if (node->left())
+            while (parent != nullptr && rank_of (parent) - rank_of (node) == 3)
             {
-                sstr << "    \"" << node << "\" -> \"" << node->left() << "\" [label=\"L\"];\n";
-                generate_dot_node (sstr, node->left());
+                bool is_left = (node == parent->left());
+                Node* sibling = parent->child (is_left);
+
+                if (rank_of (parent) - rank_of (sibling) == 2)
+                {
+                    parent->balance_--;
+                    node = parent;
+                    parent = node->parent();
+                    continue;
+                }
+
+                Node* inner = sibling->child (!is_left);
+                Node* outer = sibling->child (is_left);
+                if (rank_of (sibling) - rank_of (inner) == 2 && rank_of (sibling) - rank_of (outer) == 2)
+                {
+                    parent->balance_--;
+                    sibling->balance_--;
+                    node = parent;
+                    parent = node->parent();
+                    continue;
+                }
+
+                Dir lift = is_left ? Dir::LEFT : Dir::RIGHT;
+                if (rank_of (sibling) - rank_of (outer) == 1)
+                {
+                    rotate (parent, lift);
+                    sibling->balance_++;
+                    parent->balance_--;
+                    if (parent->left() == nullptr && parent->right() == nullptr)
+                        parent->balance_--;
+                }
+                else
+                {
+                    rotate (sibling, is_left ? Dir::RIGHT : Dir::LEFT);
+                    rotate (parent, lift);
+                    inner->balance_ += 2;
+                    sibling->balance_--;
+                    parent->balance_ -= 2;
+                }
+
+                return;
             }
-            else
+        }
+
+        // Rotates a new leaf up while its priority beats its parent's
+        void treap_sift_up (Node* node)
+        {
+            while (node->parent() != nullptr && node->parent()->balance_ < node->balance_)
+                rotate (node->parent(), node->is_left_child() ? Dir::RIGHT : Dir::LEFT);
+        }
+
+        struct VerifyFrame
+        {
+            const Node* node;
+            const T* low;           // exclusive key bounds inherited from ancestors
+            const T* high;
+            size_t blacks_above;    // black nodes strictly above node
+        };
+
+        static VerifyResult& fail (VerifyResult& result, const std::string& error)
+        {
+            if (result.ok)
+            {
+                result.ok = false;
+                result.error = error;
+            }
+
+            return result;
+        }
+
+        size_t leftmost_black_height() const
+        {
+            size_t blacks = 0;
+            for (const Node* node = root_; node != nullptr; node = node->left())
+                blacks += node->is_black();
+
+            return blacks;
+        }
+
+        // Checks the invariants local to one node and appends the non-null
+        // children to `children`; NIL children close a path and are checked
+        // against the expected black height
+        void check_node (const VerifyFrame& frame, size_t black_height,
+                         VerifyResult& result, std::vector<VerifyFrame>& children) const
+        {
+            const Node* node = frame.node;
+            result.nodes_checked++;
+
+            auto describe = [&](const char* what)
+            {
+                std::ostringstream msg;
+                msg << what << " at key " << node->data();
+                fail (result, msg.str());
+            };
+
+            if ((frame.low && !(*frame.low < node->data())) ||
+                (frame.high && !(node->data() < *frame.high)))
+                return describe ("BST order violated");
+
+            if (node->count() == 0)
+                return describe ("node with zero copies");
+
+            size_t expected_size = node->count() + (node->left() ? node->left()->subtree_size() : 0)
+                                                 + (node->right() ? node->right()->subtree_size() : 0);
+            if (node->subtree_size() != expected_size)
+                return describe ("stale subtree size");
+
+            if constexpr (has_aggregate_v<Agg> && std::equality_comparable<aggregate_type>)
             {
-                sstr << "    \"null_" << node << "_left\" [shape=point, width=0.2];\n";
-                sstr << "    \"" << node << "\" -> \"null_" << node << "_left\" [style=dashed];\n";
+                aggregate_type expected = Agg::combine (Agg::combine (Node::aggregate_of (node->left()),
+                                                                      lift_repeated (node->data(), node->count())),
+                                                        Node::aggregate_of (node->right()));
+                if (!(node->aggregate() == expected))
+                    return describe ("stale subtree aggregate");
             }
 
-            if (node->right())
+            if constexpr (std::is_same_v<Balance, Avl>)
             {
-                sstr << "    \"" << node << "\" -> \"" << node->right() << "\" [label=\"R\"];\n";
-                generate_dot_node (sstr, node->right());
+                int diff = height_of (node->right()) - height_of (node->left());
+                if (height_of (node) != 1 + std::max (height_of (node->left()), height_of (node->right())))
+                    return describe ("stale AVL height");
+                if (diff > 1 || diff < -1)
+                    return describe ("AVL balance violated");
             }
-            else
+            else if constexpr (std::is_same_v<Balance, Wavl>)
+            {
+                for (const Node* child : {node->left(), node->right()})
+                    if (int diff = rank_of (node) - rank_of (child); diff != 1 && diff != 2)
+                        return describe ("WAVL rank difference out of range");
+                if (node->left() == nullptr && node->right() == nullptr && rank_of (node) != 0)
+                    return describe ("WAVL leaf with non-zero rank");
+            }
+            else if constexpr (std::is_same_v<Balance, Treap>)
+            {
+                for (const Node* child : {node->left(), node->right()})
+                    if (child != nullptr && node->balance_ < child->balance_)
+                        return describe ("treap heap order violated");
+            }
+
+            size_t blacks = frame.blacks_above + node->is_black();
+
+            for (const Node* child : {node->left(), node->right()})
+            {
+                if (child == nullptr)
+                {
+                    if (is_red_black && blacks != black_height)
+                        return describe ("black height mismatch");
+                    continue;
+                }
+
+                if (child->parent() != node)
+                    return describe ("broken parent link below");
+                if (node->is_red() && child->is_red())
+                    return describe ("red node with red child");
+
+                bool is_left = (child == node->left());
+                children.push_back ({child,
+                                     is_left ? frame.low : &node->data(),
+                                     is_left ? &node->data() : frame.high,
+                                     blacks});
+            }
+        }
+
+        void verify_subtree (const VerifyFrame& top, size_t black_height, VerifyResult& result) const
+        {
+            std::vector<VerifyFrame> stack {top};
+            while (!stack.empty() && result.ok)
             {
-                sstr << "    \"null_" << node << "_right\" [shape=point, width=0.2];\n";
-                sstr << "    \"" << node << "\" -> \"null_" << node << "_right\" [style=dashed];\n";
+                VerifyFrame frame = stack.back();
+                stack.pop_back();
+                check_node (frame, black_height, result, stack);
             }
         }
 
-        std::string make_dot() const
+        enum class DumpRole { NODE, ELIDED };
+
+        struct DumpFrame
+        {
+            const Node* node;
+            size_t depth;
+        };
+
+        // Pre-order walk with an explicit stack. Subtrees that cannot hold keys
+        // of [low, high] are skipped, out-of-range nodes on the way to the range
+        // are reported as ELIDED, and children below max_depth are not entered.
+        template<typename Visit>
+        void walk_for_dump (const DumpOptions<T>& opts, Visit&& visit) const
         {
-            std::stringstream sstr;
+            if (root_ == nullptr)
+                return;
 
-            sstr << "digraph RBTree {\n";
-            sstr << "    node [fontname=\"Arial\", shape=circle, width=1.5, height=1.5];\n";
-            sstr << "    edge [arrowhead=normal];\n\n";
+            std::vector<DumpFrame> stack;
+            stack.push_back ({root_, 0});
 
-            if (root_ != nullptr)
-                generate_dot_node (sstr, root_);
-            else
-                sstr << "    \"empty\" [label=\"Empty Tree\"];\n";
+            while (!stack.empty())
+            {
+                DumpFrame frame = stack.back();
+                stack.pop_back();
+
+                const Node* node = frame.node;
+                bool in_range = (!opts.low  || !(node->data() < *opts.low)) &&
+                                (!opts.high || !(*opts.high < node->data()));
+
+                bool go_left  = node->left()  && (!opts.low  || *opts.low < node->data());
+                bool go_right = node->right() && (!opts.high || node->data() < *opts.high);
+                bool deeper   = frame.depth < opts.max_depth;
+
+                visit (node, frame.depth, in_range ? DumpRole::NODE : DumpRole::ELIDED,
+                       go_left, go_right, deeper);
+
+                if (!deeper)
+                    continue;
+
+                if (go_right)
+                    stack.push_back ({node->right(), frame.depth + 1});
+                if (go_left)
+                    stack.push_back ({node->left(), frame.depth + 1});
+            }
+        }
+
+        void write_dot (std::ostream& out, const DumpOptions<T>& opts) const
+        {
+            out << "digraph RBTree {\n";
+            out << "    node [fontname=\"Arial\", shape=circle, width=1.5, height=1.5];\n";
+            out << "    edge [arrowhead=normal];\n\n";
+
+            if (root_ == nullptr)
+                out << "    \"empty\" [label=\"Empty Tree\"];\n";
+
+            auto write_child = [&](const Node* node, const Node* child, const char* side,
+                                   bool visited, bool deeper)
+            {
+                if (child == nullptr)
+                {
+                    out << "    \"null_" << node << "_" << side << "\" [shape=point, width=0.2];\n";
+                    out << "    \"" << node << "\" -> \"null_" << node << "_" << side << "\" [style=dashed];\n";
+                }
+                else if (visited && deeper)
+                {
+                    out << "    \"" << node << "\" -> \"" << child << "\" [label=\"" << side[0] << "\"];\n";
+                }
+                else if (visited)
+                {
+                    out << "    \"more_" << child << "\" [shape=box, label=\"+" << child->subtree_size() << "\"];\n";
+                    out << "    \"" << node << "\" -> \"more_" << child << "\" [style=dotted];\n";
+                }
+            };
+
+            walk_for_dump (opts, [&](const Node* node, size_t, DumpRole role,
+                                     bool go_left, bool go_right, bool deeper)
+            {
+                if (role == DumpRole::ELIDED)
+                {
+                    out << "    \"" << node << "\" [label=\"" << node->data()
+                        << "\", style=dashed, fontcolor=gray, color=gray];\n";
+                }
+                else
+                {
+                    const char* fill_color = node->is_red() ? "#FF4444" : "#333333";
+
+                    out << "    \"" << node << "\" [label=\"" << node->data();
+                    if (node->count() > 1)
+                        out << " x" << node->count();
+                    out << "\\n(size=" << node->subtree_size() << ")\", style=filled, fillcolor=\""
+                        << fill_color << "\", fontcolor=white];\n";
+                }
+
+                write_child (node, node->left(),  "L", go_left,  deeper);
+                write_child (node, node->right(), "R", go_right, deeper);
+            });
+
+            out << "}\n";
+        }
+
+        void write_json (std::ostream& out, const DumpOptions<T>& opts) const
+        {
+            out << "{\"size\": " << size_ << ", \"nodes\": [";
+
+            bool first = true;
+            auto write_child = [&](const char* side, const Node* child, bool visited, bool deeper)
+            {
+                out << ", \"" << side << "\": ";
+                if (child != nullptr && visited && deeper)
+                    out << "\"" << child << "\"";
+                else if (child != nullptr && visited)
+                    out << "{\"collapsed\": " << child->subtree_size() << "}";
+                else
+                    out << "null";
+            };
+
+            walk_for_dump (opts, [&](const Node* node, size_t depth, DumpRole role,
+                                     bool go_left, bool go_right, bool deeper)
+            {
+                out << (first ? "\n  " : ",\n  ");
+                first = false;
+
+                out << "{\"id\": \"" << node << "\", \"key\": " << node->data()
+                    << ", \"color\": \"" << (node->is_red() ? "red" : "black")
+                    << "\", \"size\": " << node->subtree_size() << ", \"depth\": " << depth;
+
+                if (is_multiset)
+                    out << ", \"count\": " << node->count();
+
+                if (role == DumpRole::ELIDED)
+                    out << ", \"elided\": true";
 
-            sstr << "}\n";
+                write_child ("left",  node->left(),  go_left,  deeper);
+                write_child ("right", node->right(), go_right, deeper);
+                out << "}";
+            });
 
-            return sstr.str();
+            out << "\n]}\n";
         }
 
         Node* min_node (Node* node) const
@@ -661,19 +2563,32 @@ namespace rb
             return parent;
         }
 
-        enum class BoundType { LOWER, UPPER };
+        template<BoundType Type>
+        Node* find_bound (const T& key) const
+        {
+            return find_bound<Type> (key, root_, nullptr);
+        }
 
-        Node* find_bound (const T& key, BoundType type) const
+        template<BoundType Type>
+        Node* find_bound (const T& key, Node* hint) const
         {
-            Node* curr = root_;
-            Node* target = nullptr;
+            auto [start, above] = finger_start (key, hint);
+            return find_bound<Type> (key, start, above);
+        }
 
+        // target: answer if nothing in the subtree of curr qualifies
+        template<BoundType Type>
+        Node* find_bound (const T& key, Node* curr, Node* target) const
+        {
             while (curr != nullptr)
             {
-                bool cond = (type == BoundType::LOWER)
-                          ? (key <= curr->data_)
-                          : (key <  curr->data_);
-                if (cond)
+                bool go_left = bound_goes_left<Type> (key, curr->data_);
+                if constexpr (branchless_keys)
+                {
+                    target = go_left ? curr : target;
+                    curr = curr->child_[!go_left];
+                }
+                else if (go_left)
                 {
                     target = curr;
                     curr = curr->left();
@@ -689,13 +2604,25 @@ namespace rb
 
         Node* find_lower_bound (const T& key) const
         {
-            return find_bound (key, BoundType::LOWER);
+            return find_bound<BoundType::LOWER> (key);
         }
 
         Node* find_upper_bound (const T& key) const
         {
-            return find_bound (key, BoundType::UPPER);
+            return find_bound<BoundType::UPPER> (key);
         }
     }; // class Tree
 
+    template<typename T, typename Agg = NoAggregate, typename Alloc = std::allocator<T>>
+    using MultiTree = Tree<T, Agg, MultiKeys, Alloc>;
+
+    template<typename T, typename Agg = NoAggregate, typename Keys = UniqueKeys>
+    using AvlTree = Tree<T, Agg, Keys, std::allocator<T>, Avl>;
+
+    template<typename T, typename Agg = NoAggregate, typename Keys = UniqueKeys>
+    using WavlTree = Tree<T, Agg, Keys, std::allocator<T>, Wavl>;
+
+    template<typename T, typename Agg = NoAggregate, typename Keys = UniqueKeys>
+    using TreapTree = Tree<T, Agg, Keys, std::allocator<T>, Treap>;
+
 } // namespace rb
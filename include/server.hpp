@@ -0,0 +1,590 @@
+#pragma once
+
+#include "rbtree.hpp"
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace rb_app
+{
+    struct ServerOptions
+    {
+        std::string unix_path;          // listen on this Unix socket when set,
+        uint16_t port = 0;              // else on 127.0.0.1:port, 0 picks a free one
+        size_t threads = 4;             // epoll workers
+        size_t read_chunk = 1 << 16;
+        size_t reads_per_wakeup = 4;    // read_chunk reads before other connections get a turn
+        size_t max_request = 1 << 20;   // unparsed bytes before the connection is dropped
+        size_t max_output = 1 << 20;    // unsent answer bytes before reading pauses
+    };
+
+    // Parses the complete commands of a protocol stream: the k and q words
+    // of the driver, with its integer rules, separated by any whitespace. A
+    // word touching end is complete only at_eof. Stops before the first
+    // incomplete command and returns how many bytes were consumed. Returns
+    // npos at a malformed number or at any other word, which the server
+    // cannot answer; error then names the problem and commands holds the
+    // commands before it.
+    inline size_t parse_requests (std::string_view text, bool at_eof, std::vector<Command>& commands,
+                                  std::string_view* error = nullptr)
+    {
+        size_t pos = 0;
+        size_t consumed = 0;
+
+        auto next_word = [&](std::string_view& word)
+        {
+            while (pos < text.size() && std::isspace (static_cast<unsigned char>(text[pos])))
+                ++pos;
+
+            size_t start = pos;
+            while (pos < text.size() && !std::isspace (static_cast<unsigned char>(text[pos])))
+                ++pos;
+
+            word = text.substr (start, pos - start);
+            return !word.empty() && (pos < text.size() || at_eof);
+        };
+
+        // unlike the driver, trailing characters make the number malformed
+        auto next_int = [&](int& value)
+        {
+            std::string_view word;
+            if (!next_word (word))
+                return 0;
+
+            return scan_integer (word, value) == word.size() ? 1 : -1;
+        };
+
+        auto reject = [&](std::string_view what)
+        {
+            if (error != nullptr)
+                *error = what;
+            return std::string_view::npos;
+        };
+
+        std::string_view word;
+        while (next_word (word))
+        {
+            Command command {word.size() == 1 ? word[0] : '\0', 0, 0};
+            if (command.op != 'k' && command.op != 'q')
+                return reject ("unknown command");
+
+            int status = next_int (command.first);
+            if (status == 1 && command_arity (command.op) == 2)
+                status = next_int (command.second);
+
+            if (status < 0)
+                return reject ("malformed number");
+            if (status == 0)
+                break;
+
+            commands.push_back (command);
+            consumed = pos;
+        }
+
+        if (at_eof)
+            consumed = text.size();
+
+        return consumed;
+    }
+
+    // Serves the k/q protocol of the driver over a socket: every q is
+    // answered with its count on a line of its own, in request order, and
+    // clients may pipeline any number of requests. Each worker thread runs
+    // an epoll loop over its share of the connections; the commands that
+    // arrive in one read are applied as batches, consecutive inserts under
+    // one exclusive lock and consecutive queries under one shared lock, so
+    // readers on different connections proceed in parallel.
+    class Server
+    {
+    private:
+        struct Connection
+        {
+            int fd;
+            std::string in;
+            std::string out;
+            uint32_t events = EPOLLIN;  // currently registered with epoll
+            bool closing = false;       // peer is done, close once out is sent
+        };
+
+        ServerOptions opts_;
+        rb::Tree<int> tree_;
+        mutable std::shared_mutex tree_mutex_;
+
+        int listen_fd_ = -1;
+        int stop_fd_ = -1;
+        uint16_t port_ = 0;
+        std::vector<std::thread> workers_;
+
+        [[noreturn]] static void fail (const std::string& what)
+        {
+            throw std::runtime_error ("server: " + what + ": " + std::strerror (errno));
+        }
+
+        void listen_unix()
+        {
+            sockaddr_un addr {};
+            if (opts_.unix_path.size() >= sizeof (addr.sun_path))
+                throw std::runtime_error ("server: socket path too long " + opts_.unix_path);
+
+            addr.sun_family = AF_UNIX;
+            std::memcpy (addr.sun_path, opts_.unix_path.c_str(), opts_.unix_path.size() + 1);
+
+            listen_fd_ = ::socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listen_fd_ < 0)
+                fail ("socket");
+
+            ::unlink (opts_.unix_path.c_str());
+            if (::bind (listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof (addr)) != 0)
+                fail ("cannot bind " + opts_.unix_path);
+        }
+
+        void listen_tcp()
+        {
+            listen_fd_ = ::socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listen_fd_ < 0)
+                fail ("socket");
+
+            int one = 1;
+            ::setsockopt (listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+
+            sockaddr_in addr {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+            addr.sin_port = htons (opts_.port);
+            if (::bind (listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof (addr)) != 0)
+                fail ("cannot bind port " + std::to_string (opts_.port));
+
+            socklen_t len = sizeof (addr);
+            ::getsockname (listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+            port_ = ntohs (addr.sin_port);
+        }
+
+        // Applies the commands in order, grouping runs of the same kind
+        // under one lock
+        void execute (const std::vector<Command>& commands, std::string& out)
+        {
+            size_t i = 0;
+            while (i < commands.size())
+            {
+                size_t run_end = i;
+                while (run_end < commands.size() && commands[run_end].op == commands[i].op)
+                    ++run_end;
+
+                if (commands[i].op == 'k')
+                {
+                    std::unique_lock lock (tree_mutex_);
+                    for (; i < run_end; ++i)
+                        tree_.insert (commands[i].first);
+                }
+                else
+                {
+                    std::shared_lock lock (tree_mutex_);
+                    for (; i < run_end; ++i)
+                    {
+                        char digits[24];
+                        auto [end, ec] = std::to_chars (digits, digits + sizeof (digits),
+                                                        tree_.range_queries_solve (commands[i].first,
+                                                                                   commands[i].second));
+                        out.append (digits, end);
+                        out.push_back ('\n');
+                    }
+                }
+            }
+        }
+
+        // Returns false once the connection should be dropped. Reads at most
+        // reads_per_wakeup chunks so one busy client cannot starve the others
+        // of its worker; epoll is level-triggered, so a socket with more
+        // left is reported again by the next epoll_wait.
+        bool on_readable (Connection& conn, std::vector<Command>& commands)
+        {
+            bool at_eof = false;
+            for (size_t reads = 0; reads < std::max<size_t> (opts_.reads_per_wakeup, 1); )
+            {
+                size_t old_size = conn.in.size();
+                conn.in.resize (old_size + opts_.read_chunk);
+
+                ssize_t got = ::read (conn.fd, conn.in.data() + old_size, opts_.read_chunk);
+                conn.in.resize (old_size + (got > 0 ? static_cast<size_t>(got) : 0));
+
+                if (got > 0)
+                {
+                    ++reads;
+                    continue;
+                }
+                if (got == 0)
+                    at_eof = true;
+                else if (errno == EINTR)
+                    continue;
+                else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    return false;
+
+                break;
+            }
+
+            commands.clear();
+            std::string_view error;
+            size_t consumed = parse_requests (conn.in, at_eof, commands, &error);
+            execute (commands, conn.out);
+
+            if (consumed == std::string_view::npos)
+                return refuse (conn, error);
+
+            conn.in.erase (0, consumed);
+            if (conn.in.size() > opts_.max_request)
+                return refuse (conn, "request too large");
+
+            conn.closing = conn.closing || at_eof;
+
+            return true;
+        }
+
+        // Answers with the error, then closes once the answers are sent
+        static bool refuse (Connection& conn, std::string_view error)
+        {
+            conn.out.append ("error: ").append (error).push_back ('\n');
+            conn.in.clear();
+            conn.closing = true;
+
+            return true;
+        }
+
+        // Writes what it can; returns false once the connection should be
+        // dropped. Reading pauses while more than max_output bytes of
+        // answers wait, so a client that does not read cannot make the
+        // server buffer without bound.
+        bool on_writable (int epoll_fd, Connection& conn)
+        {
+            size_t sent = 0;
+            while (sent < conn.out.size())
+            {
+                ssize_t put = ::send (conn.fd, conn.out.data() + sent, conn.out.size() - sent, MSG_NOSIGNAL);
+                if (put > 0)
+                    sent += static_cast<size_t>(put);
+                else if (put < 0 && errno == EINTR)
+                    continue;
+                else if (put < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+                else
+                    return false;
+            }
+            conn.out.erase (0, sent);
+
+            bool blocked = !conn.out.empty();
+            bool reading = !conn.closing && conn.out.size() <= opts_.max_output;
+            uint32_t events = (reading ? EPOLLIN : 0u) | (blocked ? EPOLLOUT : 0u);
+            if (events != conn.events)
+            {
+                epoll_event event {};
+                event.events = events;
+                event.data.fd = conn.fd;
+                if (::epoll_ctl (epoll_fd, EPOLL_CTL_MOD, conn.fd, &event) != 0)
+                    return false;
+                conn.events = events;
+            }
+
+            return blocked || !conn.closing;
+        }
+
+        void accept_all (int epoll_fd, std::unordered_map<int, Connection>& connections)
+        {
+            while (true)
+            {
+                int fd = ::accept4 (listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0)
+                    return;
+
+                if (opts_.unix_path.empty())
+                {
+                    int one = 1;
+                    ::setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+                }
+
+                epoll_event event {};
+                event.events = EPOLLIN;
+                event.data.fd = fd;
+                if (::epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+                {
+                    ::close (fd);
+                    continue;
+                }
+                connections.emplace (fd, Connection {fd, {}, {}});
+            }
+        }
+
+        void worker_loop (int epoll_fd)
+        {
+            std::unordered_map<int, Connection> connections;
+            std::vector<Command> commands;
+            epoll_event events[64];
+
+            bool running = true;
+            while (running)
+            {
+                int ready = ::epoll_wait (epoll_fd, events, 64, -1);
+                if (ready < 0 && errno != EINTR)
+                    break;
+                for (int e = 0; e < ready; ++e)
+                {
+                    int fd = events[e].data.fd;
+                    if (fd == stop_fd_)
+                    {
+                        running = false;
+                        break;
+                    }
+
+                    if (fd == listen_fd_)
+                    {
+                        accept_all (epoll_fd, connections);
+                        continue;
+                    }
+
+                    auto found = connections.find (fd);
+                    if (found == connections.end())
+                        continue;
+
+                    Connection& conn = found->second;
+                    bool keep = true;
+                    if ((events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && (conn.events & EPOLLIN) && !conn.closing)
+                        keep = on_readable (conn, commands);
+                    if (keep)
+                        keep = on_writable (epoll_fd, conn);
+
+                    if (!keep)
+                    {
+                        ::close (fd);
+                        connections.erase (found);
+                    }
+                }
+            }
+
+            for (auto& [fd, conn] : connections)
+                ::close (fd);
+            ::close (epoll_fd);
+        }
+
+    public:
+        // Binds and listens right away, so clients may connect before start()
+        explicit Server (const ServerOptions& opts)
+            : opts_(opts)
+        {
+            if (opts_.unix_path.empty())
+                listen_tcp();
+            else
+                listen_unix();
+
+            if (::listen (listen_fd_, SOMAXCONN) != 0)
+                fail ("listen");
+
+            stop_fd_ = ::eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (stop_fd_ < 0)
+                fail ("eventfd");
+        }
+
+        Server (const Server&) = delete;
+        Server& operator= (const Server&) = delete;
+
+        ~Server()
+        {
+            stop();
+            ::close (stop_fd_);
+            ::close (listen_fd_);
+            if (!opts_.unix_path.empty())
+                ::unlink (opts_.unix_path.c_str());
+        }
+
+        void start()
+        {
+            for (size_t i = 0; i < std::max<size_t> (opts_.threads, 1); ++i)
+            {
+                int epoll_fd = ::epoll_create1 (EPOLL_CLOEXEC);
+                if (epoll_fd < 0)
+                    fail ("epoll_create1");
+
+                epoll_event event {};
+                event.events = EPOLLIN | EPOLLEXCLUSIVE;
+                event.data.fd = listen_fd_;
+                bool added = ::epoll_ctl (epoll_fd, EPOLL_CTL_ADD, listen_fd_, &event) == 0;
+
+                event.events = EPOLLIN;
+                event.data.fd = stop_fd_;
+                added = added && ::epoll_ctl (epoll_fd, EPOLL_CTL_ADD, stop_fd_, &event) == 0;
+
+                if (!added)
+                {
+                    int error = errno;
+                    ::close (epoll_fd);
+                    errno = error;
+                    fail ("epoll_ctl");
+                }
+
+                workers_.emplace_back ([this, epoll_fd] { worker_loop (epoll_fd); });
+            }
+        }
+
+        // Closes every connection and joins the workers
+        void stop()
+        {
+            if (workers_.empty())
+                return;
+
+            uint64_t one = 1;
+            [[maybe_unused]] ssize_t put = ::write (stop_fd_, &one, sizeof (one));
+
+            for (std::thread& worker : workers_)
+                worker.join();
+            workers_.clear();
+        }
+
+        uint16_t port() const noexcept { return port_; }
+
+        size_t size() const
+        {
+            std::shared_lock lock (tree_mutex_);
+            return tree_.size();
+        }
+    }; // class Server
+
+    // Blocking client for the server protocol
+    class Client
+    {
+    private:
+        int fd_ = -1;
+        std::string in_;
+        size_t in_pos_ = 0;         // start of the unread responses in in_
+
+        explicit Client (int fd) : fd_(fd) {}
+
+    public:
+        static Client connect_unix (const std::string& path)
+        {
+            sockaddr_un addr {};
+            if (path.size() >= sizeof (addr.sun_path))
+                throw std::runtime_error ("client: socket path too long " + path);
+
+            addr.sun_family = AF_UNIX;
+            std::memcpy (addr.sun_path, path.c_str(), path.size() + 1);
+
+            int fd = ::socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0 || ::connect (fd, reinterpret_cast<sockaddr*>(&addr), sizeof (addr)) != 0)
+            {
+                if (fd >= 0)
+                    ::close (fd);
+                throw std::runtime_error ("client: cannot connect to " + path);
+            }
+
+            return Client (fd);
+        }
+
+        static Client connect_tcp (uint16_t port)
+        {
+            sockaddr_in addr {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+            addr.sin_port = htons (port);
+
+            int fd = ::socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0 || ::connect (fd, reinterpret_cast<sockaddr*>(&addr), sizeof (addr)) != 0)
+            {
+                if (fd >= 0)
+                    ::close (fd);
+                throw std::runtime_error ("client: cannot connect to port " + std::to_string (port));
+            }
+
+            int one = 1;
+            ::setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+            return Client (fd);
+        }
+
+        Client (Client&& oth) noexcept
+            : fd_(oth.fd_), in_(std::move (oth.in_)), in_pos_(oth.in_pos_)
+        {
+            oth.fd_ = -1;
+        }
+
+        Client (const Client&) = delete;
+        Client& operator= (const Client&) = delete;
+        Client& operator= (Client&&) = delete;
+
+        ~Client()
+        {
+            if (fd_ >= 0)
+                ::close (fd_);
+        }
+
+        void send (std::string_view requests)
+        {
+            while (!requests.empty())
+            {
+                ssize_t put = ::send (fd_, requests.data(), requests.size(), MSG_NOSIGNAL);
+                if (put < 0 && errno == EINTR)
+                    continue;
+                if (put <= 0)
+                    throw std::runtime_error ("client: send failed");
+
+                requests.remove_prefix (static_cast<size_t>(put));
+            }
+        }
+
+        // No more requests; the server answers the rest and closes
+        void finish()
+        {
+            ::shutdown (fd_, SHUT_WR);
+        }
+
+        // Next response line, without the newline
+        std::string read_line()
+        {
+            size_t newline;
+            while ((newline = in_.find ('\n', in_pos_)) == std::string::npos)
+            {
+                in_.erase (0, in_pos_);
+                in_pos_ = 0;
+
+                char chunk[1 << 14];
+                ssize_t got = ::read (fd_, chunk, sizeof (chunk));
+                if (got < 0 && errno == EINTR)
+                    continue;
+                if (got <= 0)
+                    throw std::runtime_error ("client: connection closed");
+
+                in_.append (chunk, static_cast<size_t>(got));
+            }
+
+            std::string line = in_.substr (in_pos_, newline - in_pos_);
+            in_pos_ = newline + 1;
+
+            return line;
+        }
+
+        size_t read_count()
+        {
+            return std::stoul (read_line());
+        }
+    }; // class Client
+} // namespace rb_app
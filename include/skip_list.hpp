@@ -0,0 +1,241 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <utility>
+
+namespace rb
+{
+    // Indexable skip list of unique keys, the non-tree contender to
+    // rb::Tree in the balancing benchmarks. Every link also stores how many
+    // bottom-level steps it skips, so the number of keys before a bound,
+    // and with it range_queries_solve, is O(log n) expected like the
+    // subtree sizes of the tree.
+    template<typename T>
+    class SkipList
+    {
+    private:
+        static constexpr size_t max_level = 32;
+
+        struct Node;
+
+        struct Link
+        {
+            Node* next;
+            size_t width;       // bottom-level steps to next
+        };
+
+        // A node is its header followed by `level` links, in one allocation
+        struct Node
+        {
+            T key;
+            size_t level;
+
+            Link* links() { return reinterpret_cast<Link*>(this + 1); }
+            const Link* links() const { return reinterpret_cast<const Link*>(this + 1); }
+        };
+
+        static_assert (alignof (Node) >= alignof (Link));
+
+        Node* head_;
+        size_t level_ = 1;
+        size_t size_ = 0;
+        uint64_t rng_ = 0x2545F4914F6CDD1Dull;
+
+        static Node* make_node (const T& key, size_t level)
+        {
+            void* raw = ::operator new (sizeof (Node) + level * sizeof (Link));
+            Node* node = new (raw) Node {key, level};
+            for (size_t i = 0; i < level; ++i)
+                new (node->links() + i) Link {nullptr, 0};
+
+            return node;
+        }
+
+        static void destroy_node (Node* node) noexcept
+        {
+            node->~Node();
+            ::operator delete (node);
+        }
+
+        // Geometric with p = 1/4: two random bits per level
+        size_t random_level()
+        {
+            rng_ ^= rng_ << 13;
+            rng_ ^= rng_ >> 7;
+            rng_ ^= rng_ << 17;
+
+            size_t level = 1 + static_cast<size_t>(std::countr_zero (rng_ | (uint64_t{1} << 62))) / 2;
+            return level < max_level ? level : max_level;
+        }
+
+        // Keys before the first one for which stop(key) holds
+        template<typename Stop>
+        size_t rank (const Stop& stop) const
+        {
+            const Node* node = head_;
+            size_t position = 0;
+
+            for (size_t i = level_; i-- > 0; )
+            {
+                for (const Link* link = node->links() + i; link->next && !stop (link->next->key);
+                     link = node->links() + i)
+                {
+                    position += link->width;
+                    node = link->next;
+                }
+            }
+
+            return position;
+        }
+
+    public:
+        class Iterator
+        {
+        private:
+            const Node* curr_ = nullptr;
+
+            explicit Iterator (const Node* curr) : curr_(curr) {}
+
+        public:
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using reference = const T&;
+            using pointer = const T*;
+            using iterator_category = std::forward_iterator_tag;
+
+            Iterator() = default;
+
+            reference operator*() const { return curr_->key; }
+            pointer operator->() const { return &curr_->key; }
+
+            Iterator& operator++()
+            {
+                curr_ = curr_->links()[0].next;
+                return *this;
+            }
+
+            Iterator operator++ (int)
+            {
+                Iterator dumb = *this;
+                ++(*this);
+
+                return dumb;
+            }
+
+            bool operator== (const Iterator& rht_sd) const { return curr_ == rht_sd.curr_; }
+            bool operator!= (const Iterator& rht_sd) const { return !(*this == rht_sd); }
+
+            friend class SkipList;
+        }; // class Iterator
+
+        using iterator = Iterator;
+        using const_iterator = Iterator;
+        using value_type = T;
+
+        SkipList()
+            : head_(make_node (T {}, max_level))
+        {
+            head_->links()[0].width = 1;
+        }
+
+        SkipList (const SkipList&) = delete;
+        SkipList& operator= (const SkipList&) = delete;
+
+        ~SkipList()
+        {
+            for (Node* node = head_; node != nullptr; )
+            {
+                Node* next = node->links()[0].next;
+                destroy_node (node);
+                node = next;
+            }
+        }
+
+        Iterator begin() const { return Iterator (head_->links()[0].next); }
+        Iterator end() const { return Iterator (nullptr); }
+
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        bool contains (const T& key) const
+        {
+            const Node* node = head_;
+            for (size_t i = level_; i-- > 0; )
+                while (node->links()[i].next && node->links()[i].next->key < key)
+                    node = node->links()[i].next;
+
+            const Node* next = node->links()[0].next;
+            return next != nullptr && !(key < next->key);
+        }
+
+        // Returns false when key is already present
+        bool insert (const T& key)
+        {
+            Node* update[max_level];
+            size_t position[max_level];
+
+            Node* node = head_;
+            size_t pos = 0;
+            for (size_t i = level_; i-- > 0; )
+            {
+                for (Link* link = node->links() + i; link->next && link->next->key < key; link = node->links() + i)
+                {
+                    pos += link->width;
+                    node = link->next;
+                }
+
+                update[i] = node;
+                position[i] = pos;
+            }
+
+            Node* next = node->links()[0].next;
+            if (next != nullptr && !(key < next->key))
+                return false;
+
+            size_t level = random_level();
+            for (; level_ < level; ++level_)
+            {
+                update[level_] = head_;
+                position[level_] = 0;
+                head_->links()[level_].width = size_ + 1;
+            }
+
+            Node* fresh = make_node (key, level);
+            for (size_t i = 0; i < level_; ++i)
+            {
+                Link& link = update[i]->links()[i];
+                if (i < level)
+                {
+                    size_t skipped = pos - position[i];
+                    fresh->links()[i] = {link.next, link.width - skipped};
+                    link = {fresh, skipped + 1};
+                }
+                else
+                {
+                    link.width++;
+                }
+            }
+
+            size_++;
+
+            return true;
+        }
+
+        // Number of keys in [low, high]
+        size_t range_queries_solve (const T& low, const T& high) const
+        {
+            if (high < low)
+                return 0;
+
+            size_t upper = rank ([&](const T& key) { return high < key; });
+            size_t lower = rank ([&](const T& key) { return !(key < low); });
+
+            return upper - lower;
+        }
+    }; // class SkipList
+
+} // namespace rb
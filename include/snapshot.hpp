@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define RB_SNAPSHOT_HAS_MMAP 1
+#endif
+
+namespace rb::snapshot
+{
+    // On-disk layout of a tree snapshot:
+    //
+    //   Header (40 bytes, little-endian) | payload (payload_bytes)
+    //
+    // The payload holds the keys in ascending order. Integral keys are stored
+    // as varint deltas from the previous key (the first one zigzag-encoded),
+    // any other trivially copyable key is stored as raw sizeof(T) bytes.
+    // The checksum covers the payload followed by the header with its
+    // checksum field zeroed (version 1 covered the payload only).
+
+    constexpr char     MAGIC[4] = {'R', 'B', 'T', 'S'};
+    constexpr uint16_t VERSION  = 2;
+
+    enum class Encoding : uint8_t { RAW = 0, DELTA_VARINT = 1 };
+
+    struct Header
+    {
+        char     magic[4];
+        uint16_t version;
+        uint8_t  encoding;
+        uint8_t  reserved;
+        uint32_t elem_size;
+        uint32_t reserved2;
+        uint64_t count;
+        uint64_t payload_bytes;
+        uint64_t checksum;
+    };
+
+    static_assert (sizeof (Header) == 40, "snapshot header must be packed to 40 bytes");
+
+    template<typename T>
+    constexpr bool is_delta_encodable_v = std::is_integral_v<T> && !std::is_same_v<T, bool>;
+
+    template<typename T>
+    constexpr bool is_serializable_v = is_delta_encodable_v<T> || std::is_trivially_copyable_v<T>;
+
+    template<typename T>
+    constexpr Encoding encoding_for()
+    {
+        return is_delta_encodable_v<T> ? Encoding::DELTA_VARINT : Encoding::RAW;
+    }
+
+    // FNV-1a, fed incrementally while the payload is streamed
+    class Checksum
+    {
+    private:
+        uint64_t hash_ = 14695981039346656037ull;
+
+    public:
+        void update (const void* data, size_t len)
+        {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < len; ++i)
+            {
+                hash_ ^= bytes[i];
+                hash_ *= 1099511628211ull;
+            }
+        }
+
+        uint64_t value() const { return hash_; }
+    };
+
+    // Folds header in after the payload, checksum field zeroed
+    inline void checksum_header (Checksum& checksum, Header header)
+    {
+        header.checksum = 0;
+        checksum.update (&header, sizeof (header));
+    }
+
+    inline size_t put_varint (uint64_t value, unsigned char* out)
+    {
+        size_t len = 0;
+        while (value >= 0x80)
+        {
+            out[len++] = static_cast<unsigned char>(value | 0x80);
+            value >>= 7;
+        }
+        out[len++] = static_cast<unsigned char>(value);
+
+        return len;
+    }
+
+    inline const unsigned char* get_varint (const unsigned char* in, const unsigned char* end,
+                                            uint64_t& value)
+    {
+        value = 0;
+        for (unsigned shift = 0; shift < 64 && in != end; shift += 7)
+        {
+            unsigned char byte = *in++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return in;
+        }
+
+        throw std::runtime_error ("snapshot: truncated or malformed varint");
+    }
+
+    inline uint64_t zigzag_encode (int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t zigzag_decode (uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // Turns a sorted key sequence into varint bytes; keeps the previous key
+    // so the caller can feed keys one at a time.
+    template<typename T>
+    class DeltaEncoder
+    {
+    private:
+        using U = std::make_unsigned_t<T>;
+
+        bool first_ = true;
+        U prev_ = 0;
+
+    public:
+        size_t encode (const T& key, unsigned char* out)
+        {
+            U curr = static_cast<U>(key);
+            size_t len = first_ ? put_varint (zigzag_encode (static_cast<int64_t>(key)), out)
+                                : put_varint (static_cast<uint64_t>(static_cast<U>(curr - prev_)), out);
+            first_ = false;
+            prev_ = curr;
+
+            return len;
+        }
+    };
+
+    template<typename T>
+    class DeltaDecoder
+    {
+    private:
+        using U = std::make_unsigned_t<T>;
+
+        bool first_ = true;
+        U prev_ = 0;
+
+    public:
+        const unsigned char* decode (const unsigned char* in, const unsigned char* end, T& key)
+        {
+            uint64_t raw = 0;
+            in = get_varint (in, end, raw);
+
+            U curr = first_ ? static_cast<U>(zigzag_decode (raw))
+                            : static_cast<U>(prev_ + static_cast<U>(raw));
+            first_ = false;
+            prev_ = curr;
+            key = static_cast<T>(curr);
+
+            return in;
+        }
+    };
+
+    struct NoCodec {};
+
+    template<typename T>
+    using encoder_t = std::conditional_t<is_delta_encodable_v<T>, DeltaEncoder<T>, NoCodec>;
+
+    template<typename T>
+    using decoder_t = std::conditional_t<is_delta_encodable_v<T>, DeltaDecoder<T>, NoCodec>;
+
+    inline void check_header (const Header& header, Encoding expected, size_t elem_size,
+                              const std::string& path)
+    {
+        if (std::memcmp (header.magic, MAGIC, sizeof (MAGIC)) != 0)
+            throw std::runtime_error ("snapshot: bad magic in " + path);
+
+        if (header.version != VERSION)
+            throw std::runtime_error ("snapshot: unsupported version in " + path);
+
+        if (header.encoding != static_cast<uint8_t>(expected) || header.elem_size != elem_size)
+            throw std::runtime_error ("snapshot: key type mismatch in " + path);
+
+        // divided rather than multiplied: count * elem_size may wrap; a
+        // varint key takes at least one byte
+        bool size_ok = (expected == Encoding::RAW)
+                           ? header.payload_bytes % elem_size == 0 && header.payload_bytes / elem_size == header.count
+                           : header.count <= header.payload_bytes;
+        if (!size_ok)
+            throw std::runtime_error ("snapshot: payload size mismatch in " + path);
+    }
+
+    // Read-only view of a whole snapshot file: mmap-ed where the platform
+    // allows it, otherwise read into a heap buffer.
+    class FileView
+    {
+    private:
+        const unsigned char* data_ = nullptr;
+        size_t size_ = 0;
+        std::vector<unsigned char> buffer_;
+        bool mapped_ = false;
+
+    public:
+        explicit FileView (const std::string& path)
+        {
+#ifdef RB_SNAPSHOT_HAS_MMAP
+            int fd = ::open (path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error ("snapshot: cannot open " + path);
+
+            struct stat st;
+            if (::fstat (fd, &st) != 0)
+            {
+                ::close (fd);
+                throw std::runtime_error ("snapshot: cannot stat " + path);
+            }
+
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ > 0)
+            {
+                void* addr = ::mmap (nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED)
+                {
+                    ::madvise (addr, size_, MADV_SEQUENTIAL);
+                    data_ = static_cast<const unsigned char*>(addr);
+                    mapped_ = true;
+                }
+            }
+            ::close (fd);
+
+            if (mapped_ || size_ == 0)
+                return;
+#endif
+            std::ifstream file (path, std::ios::binary);
+            if (!file)
+                throw std::runtime_error ("snapshot: cannot open " + path);
+
+            buffer_.assign (std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            data_ = buffer_.data();
+            size_ = buffer_.size();
+        }
+
+        ~FileView()
+        {
+#ifdef RB_SNAPSHOT_HAS_MMAP
+            if (mapped_)
+                ::munmap (const_cast<unsigned char*>(data_), size_);
+#endif
+        }
+
+        FileView (const FileView&) = delete;
+        FileView& operator= (const FileView&) = delete;
+
+        const unsigned char* data() const { return data_; }
+        size_t size() const { return size_; }
+    };
+
+} // namespace rb::snapshot
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+
+namespace rb
+{
+    // Frozen search tree over N unique keys, built by a constexpr
+    // constructor so a table declared constexpr is laid out at compile
+    // time and lives in .rodata, with no start-up inserts and no heap:
+    //
+    //   constexpr auto edges = rb::make_static_tree (std::array {10, 20, 50, 100});
+    //   static_assert (edges.range_queries_solve (15, 60) == 2);
+    //
+    // The nodes are a complete binary tree in one array in Eytzinger
+    // (breadth-first) order, children of slot i at 2i and 2i + 1, so it is
+    // balanced by construction and a descent needs no child pointers. That
+    // array is the only copy of the keys: the sorted position of a slot
+    // and the slot of a sorted position are both computed from the shape,
+    // and iterators walk sorted positions. A duplicate key throws, which
+    // fails compilation in a constant expression.
+    template<typename T, size_t N>
+    class StaticTree
+    {
+    private:
+        std::array<T, N + 1> nodes_ {};             // [1, N] in Eytzinger order, [0] unused
+
+        // Levels of the tree, and leaves present on the last one
+        static constexpr size_t height = std::bit_width (N);
+        static constexpr size_t last_leaves = N - ((size_t{1} << height) / 2 - 1);
+
+        // In-order position of slot among the 2^height - 1 slots of the
+        // perfect tree; the missing last-level leaves are the ones at
+        // even positions from 2 * last_leaves on
+        static constexpr size_t rank_of (size_t slot)
+        {
+            size_t depth = std::bit_width (slot) - 1;
+            size_t perfect = ((2 * (slot - (size_t{1} << depth)) + 1) << (height - 1 - depth)) - 1;
+            size_t before = (perfect + 1) / 2;
+
+            return perfect - (before > last_leaves ? before - last_leaves : 0);
+        }
+
+        static constexpr size_t slot_of (size_t rank)
+        {
+            size_t perfect = (rank < 2 * last_leaves) ? rank : 2 * rank - 2 * last_leaves + 1;
+            size_t below = std::countr_one (perfect);               // levels under the slot
+            size_t depth = height - 1 - below;
+
+            return (size_t{1} << depth) + (perfect >> (below + 1));
+        }
+
+        // In-order walk of the implicit tree hands out the sorted keys
+        constexpr void place (const std::array<T, N>& sorted, size_t slot, size_t& next)
+        {
+            if (slot > N)
+                return;
+
+            place (sorted, 2 * slot, next);
+            nodes_[slot] = sorted[next++];
+            place (sorted, 2 * slot + 1, next);
+        }
+
+        // Keys before the first one for which goes_left (key) holds. The
+        // descent steps right past every smaller node; the slot where it
+        // last went left is recovered from the trailing 1 bits of the path.
+        template<typename GoesLeft>
+        constexpr size_t rank (const GoesLeft& goes_left) const
+        {
+            size_t slot = 1;
+            while (slot <= N)
+                slot = 2 * slot + (goes_left (nodes_[slot]) ? 0 : 1);
+
+            slot >>= std::countr_one (slot) + 1;
+
+            return slot == 0 ? N : rank_of (slot);
+        }
+
+    public:
+        // A sorted position; dereferencing maps it to its slot
+        class Iterator
+        {
+        private:
+            const StaticTree* tree_ = nullptr;
+            size_t rank_ = 0;
+
+            constexpr Iterator (const StaticTree* tree, size_t rank)
+                : tree_(tree), rank_(rank) {}
+
+        public:
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using reference = const T&;
+            using pointer = const T*;
+            using iterator_category = std::random_access_iterator_tag;
+
+            constexpr Iterator() = default;
+
+            constexpr reference operator*() const { return tree_->nodes_[slot_of (rank_)]; }
+            constexpr pointer operator->() const { return &**this; }
+            constexpr reference operator[] (difference_type offset) const { return *(*this + offset); }
+
+            constexpr Iterator& operator++() { ++rank_; return *this; }
+            constexpr Iterator& operator--() { --rank_; return *this; }
+            constexpr Iterator operator++ (int) { Iterator dumb = *this; ++rank_; return dumb; }
+            constexpr Iterator operator-- (int) { Iterator dumb = *this; --rank_; return dumb; }
+
+            constexpr Iterator& operator+= (difference_type offset)
+            {
+                rank_ = static_cast<size_t>(static_cast<difference_type>(rank_) + offset);
+                return *this;
+            }
+
+            constexpr Iterator& operator-= (difference_type offset) { return *this += -offset; }
+
+            friend constexpr Iterator operator+ (Iterator it, difference_type offset) { return it += offset; }
+            friend constexpr Iterator operator+ (difference_type offset, Iterator it) { return it += offset; }
+            friend constexpr Iterator operator- (Iterator it, difference_type offset) { return it -= offset; }
+
+            friend constexpr difference_type operator- (const Iterator& lht_sd, const Iterator& rht_sd)
+            {
+                return static_cast<difference_type>(lht_sd.rank_) - static_cast<difference_type>(rht_sd.rank_);
+            }
+
+            constexpr bool operator== (const Iterator& rht_sd) const { return rank_ == rht_sd.rank_; }
+            constexpr auto operator<=> (const Iterator& rht_sd) const { return rank_ <=> rht_sd.rank_; }
+
+            friend class StaticTree;
+        }; // class Iterator
+
+        using value_type = T;
+        using const_iterator = Iterator;
+        using iterator = const_iterator;
+
+        constexpr explicit StaticTree (std::array<T, N> keys)
+        {
+            std::sort (keys.begin(), keys.end());
+            for (size_t i = 1; i < N; ++i)
+                if (!(keys[i - 1] < keys[i]))
+                    throw std::invalid_argument ("static tree: duplicate key");
+
+            size_t next = 0;
+            place (keys, 1, next);
+        }
+
+        constexpr Iterator begin() const noexcept { return Iterator (this, 0); }
+        constexpr Iterator end() const noexcept { return Iterator (this, N); }
+
+        constexpr size_t size() const noexcept { return N; }
+        constexpr bool empty() const noexcept { return N == 0; }
+
+        // Key at position index of the sorted order
+        constexpr const T& nth (size_t index) const { return nodes_[slot_of (index)]; }
+
+        constexpr Iterator lower_bound (const T& key) const
+        {
+            return begin() + static_cast<std::ptrdiff_t>(rank ([&](const T& node) { return !(node < key); }));
+        }
+
+        constexpr Iterator upper_bound (const T& key) const
+        {
+            return begin() + static_cast<std::ptrdiff_t>(rank ([&](const T& node) { return key < node; }));
+        }
+
+        constexpr bool contains (const T& key) const
+        {
+            Iterator bound = lower_bound (key);
+            return bound != end() && !(key < *bound);
+        }
+
+        // Number of keys in [low, high]
+        constexpr size_t range_queries_solve (const T& low, const T& high) const
+        {
+            if (high < low)
+                return 0;
+
+            return static_cast<size_t>(upper_bound (high) - lower_bound (low));
+        }
+    }; // class StaticTree
+
+    // Preferred to deducing StaticTree's arguments from the constructor:
+    // GCC 12 puts a constexpr object declared that way in .data
+    template<typename T, size_t N>
+    constexpr StaticTree<T, N> make_static_tree (const std::array<T, N>& keys)
+    {
+        return StaticTree<T, N> (keys);
+    }
+
+} // namespace rb
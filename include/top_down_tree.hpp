@@ -0,0 +1,420 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+
+namespace rb
+{
+    // Red-black tree of unique keys without parent pointers, for the
+    // insert-and-count workload of the driver. Insertion is the single
+    // top-down pass of Guibas and Sedgewick: on the way down a node with
+    // two red children is recoloured and a red parent-child pair is fixed
+    // by rotating at the grandparent, so nothing is walked back up. The
+    // subtree sizes of the path are incremented on the way down as well,
+    // and decremented again if the key turns out to be present. A node is
+    // the key, two links, the size and a colour, 8 bytes less than
+    // rb::Tree's. An iterator is the current node and the root, O(log n)
+    // per increment; the for_each walks keep the path on a stack.
+    template<typename T>
+    class TopDownTree
+    {
+    private:
+        // 2 log2 (n + 1) stays below this for any n that fits in memory
+        static constexpr size_t max_depth = 96;
+
+        struct Node
+        {
+            T data_;
+            bool red_;
+            Node* link_[2];         // [0] left, [1] right
+            size_t size_;
+        };
+
+        Node* root_ = nullptr;
+        size_t size_ = 0;
+
+        static bool is_red (const Node* node) { return node != nullptr && node->red_; }
+        static size_t size_of (const Node* node) { return node ? node->size_ : 0; }
+
+        static void resize (Node* node)
+        {
+            node->size_ = 1 + size_of (node->link_[0]) + size_of (node->link_[1]);
+        }
+
+        // Elements before the lower (upper) bound of key
+        template<bool Upper>
+        size_t rank (const T& key) const
+        {
+            size_t count = 0;
+            for (const Node* node = root_; node != nullptr; )
+            {
+                bool right = Upper ? !(key < node->data_) : node->data_ < key;
+                count += right ? 1 + size_of (node->link_[0]) : 0;
+                node = node->link_[right];
+            }
+
+            return count;
+        }
+
+    public:
+        // Holds the current node and the root, 16 bytes. Without parent
+        // links the successor of a node with no right subtree is found by a
+        // descent from the root, the last node it leaves to the left, so an
+        // increment costs O(log n) and a full scan O(n log n); for_each and
+        // for_each_in_range walk in O(n) instead.
+        class Iterator
+        {
+        private:
+            const Node* root_ = nullptr;
+            const Node* node_ = nullptr;        // nullptr is end()
+
+            Iterator (const Node* root, const Node* node)
+                : root_(root), node_(node) {}
+
+        public:
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using reference = const T&;
+            using pointer = const T*;
+            using iterator_category = std::forward_iterator_tag;
+
+            Iterator() = default;
+
+            reference operator*() const { return node_->data_; }
+            pointer operator->() const { return &node_->data_; }
+
+            Iterator& operator++()
+            {
+                if (const Node* next = node_->link_[1]; next != nullptr)
+                {
+                    while (next->link_[0] != nullptr)
+                        next = next->link_[0];
+                    node_ = next;
+
+                    return *this;
+                }
+
+                const Node* successor = nullptr;
+                for (const Node* node = root_; node != node_; )
+                {
+                    bool right = node->data_ < node_->data_;
+                    if (!right)
+                        successor = node;
+                    node = node->link_[right];
+                }
+                node_ = successor;
+
+                return *this;
+            }
+
+            Iterator operator++ (int)
+            {
+                Iterator dumb = *this;
+                ++(*this);
+
+                return dumb;
+            }
+
+            bool operator== (const Iterator& rht_sd) const { return node_ == rht_sd.node_; }
+            bool operator!= (const Iterator& rht_sd) const { return !(*this == rht_sd); }
+
+            friend class TopDownTree;
+        }; // class Iterator
+
+        using iterator = Iterator;
+        using const_iterator = Iterator;
+        using value_type = T;
+
+        TopDownTree() = default;
+
+        TopDownTree (const TopDownTree&) = delete;
+        TopDownTree& operator= (const TopDownTree&) = delete;
+
+        ~TopDownTree() { clear(); }
+
+        // Frees the nodes without a stack by rotating every left child up
+        // until the leftmost node has none
+        void clear() noexcept
+        {
+            Node* node = root_;
+            while (node != nullptr)
+            {
+                if (Node* left = node->link_[0]; left != nullptr)
+                {
+                    node->link_[0] = left->link_[1];
+                    left->link_[1] = node;
+                    node = left;
+                }
+                else
+                {
+                    Node* next = node->link_[1];
+                    delete node;
+                    node = next;
+                }
+            }
+
+            root_ = nullptr;
+            size_ = 0;
+        }
+
+        // Returns false when key is already present
+        bool insert (const T& key)
+        {
+            if (root_ == nullptr)
+            {
+                root_ = new Node {key, false, {nullptr, nullptr}, 1};
+                size_ = 1;
+                return true;
+            }
+
+            // path[i] is an ancestor of q and dirs[i] the side its successor
+            // on the path hangs from; every ancestor's size already counts
+            // the key, q's does not until the key goes below it
+            Node* path[max_depth];
+            bool dirs[max_depth];
+            size_t depth = 0;
+
+            Node* q = root_;
+            bool inserted = false;
+
+            while (true)
+            {
+                if (q == nullptr)
+                {
+                    q = new Node {key, true, {nullptr, nullptr}, 1};
+                    path[depth - 1]->link_[dirs[depth - 1]] = q;
+                    inserted = true;
+                }
+                else if (is_red (q->link_[0]) && is_red (q->link_[1]))
+                {
+                    q->red_ = true;
+                    q->link_[0]->red_ = false;
+                    q->link_[1]->red_ = false;
+                }
+
+                // The parent's sibling is black: a grandparent with two red
+                // children was recoloured above. A parent at the root may be
+                // red after that recolouring; it has no grandparent to
+                // rotate at, so it is skipped and blackened at the end.
+                if (q->red_ && depth >= 2 && path[depth - 1]->red_)
+                {
+                    Node* p = path[depth - 1];
+                    Node* g = path[depth - 2];
+                    bool last = dirs[depth - 2];
+                    bool dir = dirs[depth - 1];
+                    size_t pending = inserted ? 0 : 1;
+                    Node* top;
+
+                    if (dir == last)
+                    {
+                        g->link_[last] = p->link_[!last];
+                        p->link_[!last] = g;
+                        g->red_ = true;
+                        p->red_ = false;
+
+                        resize (g);
+                        resize (p);
+                        p->size_ += pending;
+
+                        top = p;
+                    }
+                    else
+                    {
+                        p->link_[dir] = q->link_[last];
+                        g->link_[last] = q->link_[dir];
+                        q->link_[last] = p;
+                        q->link_[dir] = g;
+                        g->red_ = true;
+                        q->red_ = false;
+
+                        // q is the current node again, the key has not
+                        // gone below it yet
+                        resize (p);
+                        resize (g);
+                        resize (q);
+
+                        top = q;
+                    }
+
+                    depth -= 2;
+                    if (depth == 0)
+                        root_ = top;
+                    else
+                        path[depth - 1]->link_[dirs[depth - 1]] = top;
+
+                    if (top == p)
+                    {
+                        path[depth] = p;
+                        dirs[depth] = dir;
+                        depth++;
+                    }
+                }
+
+                if (inserted)
+                    break;
+
+                if (!(key < q->data_) && !(q->data_ < key))
+                {
+                    for (size_t i = 0; i < depth; ++i)
+                        path[i]->size_--;
+
+                    root_->red_ = false;
+                    return false;
+                }
+
+                bool dir = q->data_ < key;
+                q->size_++;
+                path[depth] = q;
+                dirs[depth] = dir;
+                depth++;
+                q = q->link_[dir];
+            }
+
+            root_->red_ = false;
+            size_++;
+
+            return true;
+        }
+
+        bool contains (const T& key) const
+        {
+            const Node* node = root_;
+            while (node != nullptr && (key < node->data_ || node->data_ < key))
+                node = node->link_[node->data_ < key];
+
+            return node != nullptr;
+        }
+
+        Iterator begin() const
+        {
+            const Node* node = root_;
+            while (node != nullptr && node->link_[0] != nullptr)
+                node = node->link_[0];
+
+            return Iterator (root_, node);
+        }
+
+        Iterator end() const { return Iterator (root_, nullptr); }
+
+        Iterator lower_bound (const T& key) const
+        {
+            const Node* bound = nullptr;
+            for (const Node* node = root_; node != nullptr; )
+            {
+                bool right = node->data_ < key;
+                if (!right)
+                    bound = node;
+                node = node->link_[right];
+            }
+
+            return Iterator (root_, bound);
+        }
+
+        Iterator upper_bound (const T& key) const
+        {
+            const Node* bound = nullptr;
+            for (const Node* node = root_; node != nullptr; )
+            {
+                bool right = !(key < node->data_);
+                if (!right)
+                    bound = node;
+                node = node->link_[right];
+            }
+
+            return Iterator (root_, bound);
+        }
+
+        // Calls fn (key) for every key in [low, high] in ascending order. One
+        // descent to low, then an in-order walk on a stack of the path, so a
+        // scan is O(log n + k) where stepping iterators costs O(log n) each.
+        template<typename Fn>
+        void for_each_in_range (const T& low, const T& high, Fn fn) const
+        {
+            const Node* stack[max_depth];
+            size_t depth = 0;
+
+            for (const Node* node = root_; node != nullptr; )
+            {
+                bool right = node->data_ < low;
+                if (!right)
+                    stack[depth++] = node;
+                node = node->link_[right];
+            }
+
+            while (depth > 0)
+            {
+                const Node* node = stack[--depth];
+                if (high < node->data_)
+                    return;
+
+                fn (node->data_);
+                for (node = node->link_[1]; node != nullptr; node = node->link_[0])
+                    stack[depth++] = node;
+            }
+        }
+
+        // Every key in ascending order, see for_each_in_range
+        template<typename Fn>
+        void for_each (Fn fn) const
+        {
+            const Node* stack[max_depth];
+            size_t depth = 0;
+
+            for (const Node* node = root_; node != nullptr; node = node->link_[0])
+                stack[depth++] = node;
+
+            while (depth > 0)
+            {
+                const Node* node = stack[--depth];
+                fn (node->data_);
+                for (node = node->link_[1]; node != nullptr; node = node->link_[0])
+                    stack[depth++] = node;
+            }
+        }
+
+        // Number of keys in [low, high]
+        size_t range_queries_solve (const T& low, const T& high) const
+        {
+            if (high < low)
+                return 0;
+
+            return rank<true> (high) - rank<false> (low);
+        }
+
+        size_t size() const noexcept { return size_; }
+        bool empty() const noexcept { return size_ == 0; }
+
+        // Order, colours, black heights and subtree sizes, for tests
+        bool verify() const
+        {
+            if (is_red (root_) || size_of (root_) != size_)
+                return false;
+
+            struct Walk
+            {
+                static int black_height (const Node* node, const T* low, const T* high)
+                {
+                    if (node == nullptr)
+                        return 1;
+
+                    if ((low != nullptr && !(*low < node->data_)) || (high != nullptr && !(node->data_ < *high)))
+                        return -1;
+                    if (node->red_ && (is_red (node->link_[0]) || is_red (node->link_[1])))
+                        return -1;
+                    if (node->size_ != 1 + size_of (node->link_[0]) + size_of (node->link_[1]))
+                        return -1;
+
+                    int left = black_height (node->link_[0], low, &node->data_);
+                    int right = black_height (node->link_[1], &node->data_, high);
+                    if (left < 0 || left != right)
+                        return -1;
+
+                    return left + (node->red_ ? 0 : 1);
+                }
+            };
+
+            return Walk::black_height (root_, nullptr, nullptr) > 0;
+        }
+    }; // class TopDownTree
+
+} // namespace rb
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace rb
+{
+    struct VerifyResult
+    {
+        bool ok = true;
+        std::string error;          // first violation found, empty when ok
+        size_t nodes_checked = 0;
+
+        explicit operator bool() const noexcept { return ok; }
+    };
+
+    struct VerifyOptions
+    {
+        size_t threads = 0;                     // 0 = std::thread::hardware_concurrency()
+        size_t parallel_threshold = 1 << 16;    // smaller trees are checked on the caller thread
+    };
+
+} // namespace rb
@@ -0,0 +1,519 @@
+#pragma once
+
+#include "rbtree.hpp"
+#include "snapshot.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <exception>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <ostream>
+#include <streambuf>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace rb_app
+{
+    struct DurabilityOptions
+    {
+        std::string dir;                                        // WAL segments + checkpoints
+        size_t group_commit = 4096;                             // keys per log batch
+        std::chrono::milliseconds flush_interval {10};          // max age of an unflushed key
+        size_t fsync_every = 1;                                 // batches per fsync, 0 = never
+        size_t checkpoint_every = 1 << 20;                      // inserts per checkpoint, 0 = never
+
+        // Test hook, called with "synced", "renamed" and "published" as a
+        // checkpoint reaches each durable step; may throw to simulate a crash
+        std::function<void (const std::string&)> on_checkpoint_step;
+    };
+
+    // Seekable output stream buffer over a file descriptor, so a snapshot
+    // can be written where it can be fsync-ed
+    class FdStreamBuf : public std::streambuf
+    {
+    private:
+        int fd_;
+        char buffer_[1 << 16];
+
+        bool drain()
+        {
+            const char* bytes = pbase();
+            size_t len = static_cast<size_t>(pptr() - pbase());
+            while (len > 0)
+            {
+                ssize_t n = ::write (fd_, bytes, len);
+                if (n < 0)
+                    return false;
+
+                bytes += n;
+                len -= static_cast<size_t>(n);
+            }
+
+            setp (buffer_, buffer_ + sizeof (buffer_));
+            return true;
+        }
+
+    protected:
+        int_type overflow (int_type ch) override
+        {
+            if (!drain())
+                return traits_type::eof();
+
+            if (!traits_type::eq_int_type (ch, traits_type::eof()))
+            {
+                *pptr() = traits_type::to_char_type (ch);
+                pbump (1);
+            }
+
+            return traits_type::not_eof (ch);
+        }
+
+        int sync() override { return drain() ? 0 : -1; }
+
+        pos_type seekoff (off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override
+        {
+            if (!drain())
+                return pos_type (off_type (-1));
+
+            int whence = (dir == std::ios_base::beg) ? SEEK_SET : (dir == std::ios_base::cur) ? SEEK_CUR : SEEK_END;
+            return pos_type (static_cast<off_type>(::lseek (fd_, off, whence)));
+        }
+
+        pos_type seekpos (pos_type pos, std::ios_base::openmode which) override
+        {
+            return seekoff (off_type (pos), std::ios_base::beg, which);
+        }
+
+    public:
+        explicit FdStreamBuf (int fd) : fd_(fd)
+        {
+            setp (buffer_, buffer_ + sizeof (buffer_));
+        }
+    }; // class FdStreamBuf
+
+    // Append-only log of inserted keys.
+    //
+    // Appends go to the front buffer under a short lock; a background thread
+    // swaps it with the back buffer and writes the back one out as a single
+    // batch record, so the caller never waits on write()/fsync(). A batch is
+    //
+    //   uint32 count | uint64 FNV-1a of keys | int32 keys[count]
+    //
+    // and replay stops at the first torn or corrupted batch.
+    class WriteAheadLog
+    {
+    private:
+        struct BatchHeader
+        {
+            uint32_t count;
+            uint32_t reserved;
+            uint64_t checksum;
+        };
+
+        DurabilityOptions opts_;
+        int fd_ = -1;
+        uint64_t segment_ = 0;
+
+        std::vector<int> front_;
+        std::vector<int> back_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable drained_;
+        bool stop_ = false;
+        bool flush_requested_ = false;
+        size_t batches_since_sync_ = 0;
+        uint64_t appended_ = 0;
+        uint64_t written_ = 0;
+        std::exception_ptr error_;
+
+        std::thread flusher_;
+
+    public:
+        WriteAheadLog (const DurabilityOptions& opts, uint64_t segment)
+            : opts_(opts)
+        {
+            front_.reserve (opts_.group_commit);
+            back_.reserve (opts_.group_commit);
+            open_segment (segment);
+            flusher_ = std::thread ([this] { flush_loop(); });
+        }
+
+        ~WriteAheadLog()
+        {
+            {
+                std::lock_guard<std::mutex> lock (mutex_);
+                stop_ = true;
+            }
+            wake_.notify_one();
+            flusher_.join();
+
+            if (fd_ >= 0)
+            {
+                ::fsync (fd_);
+                ::close (fd_);
+            }
+        }
+
+        WriteAheadLog (const WriteAheadLog&) = delete;
+        WriteAheadLog& operator= (const WriteAheadLog&) = delete;
+
+        void append (int key)
+        {
+            bool full = false;
+            {
+                std::lock_guard<std::mutex> lock (mutex_);
+                if (error_)
+                    std::rethrow_exception (error_);
+
+                front_.push_back (key);
+                ++appended_;
+                full = front_.size() >= opts_.group_commit;
+            }
+
+            if (full)
+                wake_.notify_one();
+        }
+
+        // Blocks until everything appended so far is written (and fsync-ed
+        // when the fsync cadence is enabled)
+        void flush()
+        {
+            std::unique_lock<std::mutex> lock (mutex_);
+            uint64_t target = appended_;
+            flush_requested_ = true;
+            wake_.notify_one();
+            drained_.wait (lock, [&] { return written_ >= target || error_; });
+
+            if (error_)
+                std::rethrow_exception (error_);
+        }
+
+        // Starts a new segment; everything before it is flushed and synced
+        void rotate (uint64_t segment)
+        {
+            flush();
+
+            std::lock_guard<std::mutex> lock (mutex_);
+            ::fsync (fd_);
+            ::close (fd_);
+            open_segment (segment);
+        }
+
+        uint64_t segment() const noexcept { return segment_; }
+
+        static std::string segment_path (const std::string& dir, uint64_t segment)
+        {
+            return dir + "/wal-" + std::to_string (segment) + ".log";
+        }
+
+        // Feeds every intact key of a segment to fn, in log order
+        template<typename Fn>
+        static void replay (const std::string& path, Fn&& fn)
+        {
+            std::ifstream file (path, std::ios::binary | std::ios::ate);
+            uint64_t left = file ? static_cast<uint64_t>(file.tellg()) : 0;
+            file.seekg (0);
+
+            BatchHeader header;
+            std::vector<int> keys;
+
+            while (file.read (reinterpret_cast<char*>(&header), sizeof (header)))
+            {
+                // a torn header may claim any count: stop instead of allocating it
+                left -= sizeof (header);
+                if (uint64_t{header.count} * sizeof (int) > left)
+                    break;
+                left -= uint64_t{header.count} * sizeof (int);
+
+                keys.resize (header.count);
+                if (!file.read (reinterpret_cast<char*>(keys.data()),
+                                static_cast<std::streamsize>(keys.size() * sizeof (int))))
+                    break;
+
+                rb::snapshot::Checksum checksum;
+                checksum.update (keys.data(), keys.size() * sizeof (int));
+                if (checksum.value() != header.checksum)
+                    break;
+
+                for (int key : keys)
+                    fn (key);
+            }
+        }
+
+    private:
+        void open_segment (uint64_t segment)
+        {
+            std::string path = segment_path (opts_.dir, segment);
+            fd_ = ::open (path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd_ < 0)
+                throw std::runtime_error ("wal: cannot open " + path);
+
+            segment_ = segment;
+        }
+
+        void flush_loop()
+        {
+            std::unique_lock<std::mutex> lock (mutex_);
+
+            while (true)
+            {
+                wake_.wait_for (lock, opts_.flush_interval, [&]
+                {
+                    return stop_ || flush_requested_ || front_.size() >= opts_.group_commit;
+                });
+
+                bool stopping = stop_;
+                flush_requested_ = false;
+                std::swap (front_, back_);
+                size_t count = back_.size();
+
+                lock.unlock();
+                std::exception_ptr error;
+                try
+                {
+                    write_batch (back_);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                back_.clear();
+                lock.lock();
+
+                if (error)
+                {
+                    error_ = error;
+                    drained_.notify_all();
+                    return;
+                }
+
+                written_ += count;
+                drained_.notify_all();
+
+                if (stopping && front_.empty())
+                    return;
+            }
+        }
+
+        void write_batch (const std::vector<int>& keys)
+        {
+            if (keys.empty())
+                return;
+
+            BatchHeader header {};
+            header.count = static_cast<uint32_t>(keys.size());
+
+            rb::snapshot::Checksum checksum;
+            checksum.update (keys.data(), keys.size() * sizeof (int));
+            header.checksum = checksum.value();
+
+            write_all (&header, sizeof (header));
+            write_all (keys.data(), keys.size() * sizeof (int));
+
+            if (opts_.fsync_every != 0 && ++batches_since_sync_ >= opts_.fsync_every)
+            {
+                ::fsync (fd_);
+                batches_since_sync_ = 0;
+            }
+        }
+
+        void write_all (const void* data, size_t len)
+        {
+            const char* bytes = static_cast<const char*>(data);
+            while (len > 0)
+            {
+                ssize_t n = ::write (fd_, bytes, len);
+                if (n < 0)
+                    throw std::runtime_error ("wal: write failed");
+
+                bytes += n;
+                len -= static_cast<size_t>(n);
+            }
+        }
+    }; // class WriteAheadLog
+
+    // Checkpoint + WAL pair. A checkpoint named checkpoint-<N>.rbts holds
+    // every key logged in segments below N, so recovery loads the newest
+    // checkpoint and replays only segments N, N+1, ...
+    class Durability
+    {
+    private:
+        DurabilityOptions opts_;
+        uint64_t checkpoint_seq_ = 0;
+        std::unique_ptr<WriteAheadLog> wal_;
+        size_t since_checkpoint_ = 0;
+
+    public:
+        explicit Durability (const DurabilityOptions& opts) : opts_(opts)
+        {
+            std::filesystem::create_directories (opts_.dir);
+        }
+
+        // Restores the tree from disk and opens a fresh WAL segment
+        void recover (rb::Tree<int>& tree)
+        {
+            namespace fs = std::filesystem;
+
+            std::vector<uint64_t> checkpoints;
+            std::vector<uint64_t> segments;
+
+            for (const auto& entry : fs::directory_iterator (opts_.dir))
+            {
+                std::string name = entry.path().filename().string();
+                uint64_t seq = 0;
+
+                if (parse_seq (name, "checkpoint-", ".rbts", seq))
+                    checkpoints.push_back (seq);
+                else if (parse_seq (name, "wal-", ".log", seq))
+                    segments.push_back (seq);
+            }
+
+            std::sort (segments.begin(), segments.end());
+
+            if (!checkpoints.empty())
+            {
+                checkpoint_seq_ = *std::max_element (checkpoints.begin(), checkpoints.end());
+                tree.load (checkpoint_path (checkpoint_seq_));
+            }
+
+            uint64_t next_segment = checkpoint_seq_;
+            for (uint64_t seg : segments)
+            {
+                if (seg < checkpoint_seq_)
+                    continue;
+
+                WriteAheadLog::replay (WriteAheadLog::segment_path (opts_.dir, seg),
+                                       [&tree](int key) { tree.insert (key); });
+                next_segment = seg + 1;
+            }
+
+            wal_ = std::make_unique<WriteAheadLog> (opts_, next_segment);
+        }
+
+        void log_insert (int key)
+        {
+            wal_->append (key);
+            ++since_checkpoint_;
+        }
+
+        bool checkpoint_due() const
+        {
+            return opts_.checkpoint_every != 0 && since_checkpoint_ >= opts_.checkpoint_every;
+        }
+
+        void maybe_checkpoint (const rb::Tree<int>& tree)
+        {
+            if (checkpoint_due())
+                checkpoint (tree);
+        }
+
+        // Dumps the tree and drops the log segments and checkpoint it
+        // supersedes. The old files go only once the new checkpoint is
+        // durable: its data is fsync-ed before the rename, and the directory
+        // after it, so a crash at any point leaves a checkpoint and the log
+        // that follows it.
+        void checkpoint (const rb::Tree<int>& tree)
+        {
+            uint64_t seq = wal_->segment() + 1;
+            wal_->rotate (seq);
+
+            std::string tmp = checkpoint_path (seq) + ".tmp";
+            write_synced (tree, tmp);
+            step ("synced");
+
+            std::filesystem::rename (tmp, checkpoint_path (seq));
+            sync_directory();
+            step ("renamed");
+
+            for (uint64_t seg = checkpoint_seq_; seg < seq; ++seg)
+                std::filesystem::remove (WriteAheadLog::segment_path (opts_.dir, seg));
+
+            if (checkpoint_seq_ != 0)
+                std::filesystem::remove (checkpoint_path (checkpoint_seq_));
+
+            checkpoint_seq_ = seq;
+            since_checkpoint_ = 0;
+            step ("published");
+        }
+
+        void flush() { wal_->flush(); }
+
+    private:
+        void step (const std::string& name) const
+        {
+            if (opts_.on_checkpoint_step)
+                opts_.on_checkpoint_step (name);
+        }
+
+        static void write_synced (const rb::Tree<int>& tree, const std::string& path)
+        {
+            int fd = ::open (path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)
+                throw std::runtime_error ("wal: cannot create " + path);
+
+            try
+            {
+                FdStreamBuf buffer (fd);
+                std::ostream out (&buffer);
+                tree.save (out, path);
+
+                if (::fsync (fd) != 0)
+                    throw std::runtime_error ("wal: fsync failed for " + path);
+            }
+            catch (...)
+            {
+                ::close (fd);
+                throw;
+            }
+
+            ::close (fd);
+        }
+
+        void sync_directory() const
+        {
+            int fd = ::open (opts_.dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error ("wal: cannot open " + opts_.dir);
+
+            int result = ::fsync (fd);
+            ::close (fd);
+            if (result != 0)
+                throw std::runtime_error ("wal: fsync failed for " + opts_.dir);
+        }
+
+        std::string checkpoint_path (uint64_t seq) const
+        {
+            return opts_.dir + "/checkpoint-" + std::to_string (seq) + ".rbts";
+        }
+
+        static bool parse_seq (const std::string& name, const std::string& prefix,
+                               const std::string& suffix, uint64_t& seq)
+        {
+            if (name.size() <= prefix.size() + suffix.size() ||
+                name.compare (0, prefix.size(), prefix) != 0 ||
+                name.compare (name.size() - suffix.size(), suffix.size(), suffix) != 0)
+                return false;
+
+            std::string digits = name.substr (prefix.size(), name.size() - prefix.size() - suffix.size());
+            if (digits.find_first_not_of ("0123456789") != std::string::npos)
+                return false;
+
+            seq = std::stoull (digits);
+            return true;
+        }
+    }; // class Durability
+
+} // namespace rb_app
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace rb
+{
+    // Small sorted buffer of recent inserts in front of one tree. Keys are
+    // absorbed with a binary search and a short move inside a cache-resident
+    // array, and reach the tree in ascending batches through hinted inserts,
+    // so each batch walks the tree once from left to right instead of
+    // descending from the root per key:
+    //
+    //   rb::WriteBuffer<rb::Tree<int>> buffer (1024);
+    //   buffer.insert (tree, key);
+    //   buffer.range_queries_solve (tree, low, high);
+    //
+    // The buffer flushes when full. With unique keys a buffered key may
+    // already be in the tree, so a query first merges the buffered keys of
+    // its range; in multiset mode every copy counts, and the buffer's share
+    // is added by binary search without merging.
+    template<typename TreeT>
+    class WriteBuffer
+    {
+    private:
+        using key_type = typename TreeT::value_type;
+
+        std::vector<key_type> keys_;        // ascending; distinct unless multiset
+        size_t capacity_;
+
+        template<typename It>
+        static void merge_into (TreeT& tree, It first, It last)
+        {
+            auto hint = tree.end();
+            for (; first != last; ++first)
+                hint = tree.insert (hint, *first);
+        }
+
+    public:
+        explicit WriteBuffer (size_t capacity = 1024)
+            : capacity_(std::max<size_t> (capacity, 1))
+        {
+            keys_.reserve (capacity_);
+        }
+
+        void insert (TreeT& tree, const key_type& key)
+        {
+            auto pos = std::upper_bound (keys_.begin(), keys_.end(), key);
+            if constexpr (!TreeT::is_multiset)
+            {
+                if (pos != keys_.begin() && !(*(pos - 1) < key))
+                    return;
+            }
+
+            keys_.insert (pos, key);
+            if (keys_.size() >= capacity_)
+                flush (tree);
+        }
+
+        // Moves every buffered key into tree
+        void flush (TreeT& tree)
+        {
+            merge_into (tree, keys_.begin(), keys_.end());
+            keys_.clear();
+        }
+
+        // Moves the buffered keys in [low, high] into tree
+        void flush_range (TreeT& tree, const key_type& low, const key_type& high)
+        {
+            if (high < low)
+                return;
+
+            auto first = std::lower_bound (keys_.begin(), keys_.end(), low);
+            auto last = std::upper_bound (first, keys_.end(), high);
+            if (first == last)
+                return;
+
+            merge_into (tree, first, last);
+            keys_.erase (first, last);
+        }
+
+        // Exact count of [low, high] over the tree and the buffer
+        size_t range_queries_solve (TreeT& tree, const key_type& low, const key_type& high)
+        {
+            if (high < low)
+                return 0;
+
+            if constexpr (TreeT::is_multiset)
+            {
+                auto first = std::lower_bound (keys_.begin(), keys_.end(), low);
+                auto last = std::upper_bound (first, keys_.end(), high);
+
+                return tree.range_queries_solve (low, high) + static_cast<size_t>(last - first);
+            }
+            else
+            {
+                flush_range (tree, low, high);
+                return tree.range_queries_solve (low, high);
+            }
+        }
+
+        bool contains (const TreeT& tree, const key_type& key) const
+        {
+            return std::binary_search (keys_.begin(), keys_.end(), key) || tree.contains (key);
+        }
+
+        size_t size() const noexcept { return keys_.size(); }
+        bool empty() const noexcept { return keys_.empty(); }
+        size_t capacity() const noexcept { return capacity_; }
+    }; // class WriteBuffer
+
+} // namespace rb
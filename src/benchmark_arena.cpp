@@ -0,0 +1,121 @@
+#include "rbtree.hpp"
+#include "arena.hpp"
+#include "benchmark.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Node placement: the default heap against rb::NodeArena on 4 KB pages,
+// transparent huge pages and explicit huge pages, timing inserts and
+// lower_bound descents and counting dTLB misses during the descents.
+// Usage: arena_bench [keys] [queries]
+
+namespace
+{
+    struct Result
+    {
+        long long insert_us;
+        long long lookup_us;
+        benchmark::TlbCounters tlb;
+        size_t checksum = 0;
+    };
+
+    template<typename Tree>
+    void run (Tree& tree, const std::vector<int>& keys, const std::vector<int>& queries, Result& result)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int key : keys)
+            tree.insert (key);
+        auto inserted = std::chrono::high_resolution_clock::now();
+
+        result.tlb.start();
+        for (int query : queries)
+            result.checksum += (tree.lower_bound (query) != tree.end());
+        result.tlb.stop();
+        auto looked_up = std::chrono::high_resolution_clock::now();
+
+        result.insert_us = std::chrono::duration_cast<std::chrono::microseconds>(inserted - start).count();
+        result.lookup_us = std::chrono::duration_cast<std::chrono::microseconds>(looked_up - inserted).count();
+    }
+
+    void report (const std::string& name, const Result& result, const std::string& placement)
+    {
+        std::cout << std::left << std::setw (18) << name << std::right
+                  << std::setw (10) << result.insert_us / 1000 << " ms"
+                  << std::setw (10) << result.lookup_us / 1000 << " ms";
+
+        if (result.tlb.available())
+            std::cout << std::setw (10) << std::fixed << std::setprecision (2) << result.tlb.miss_rate() * 100.0 << " %";
+        else
+            std::cout << std::setw (12) << "n/a";
+
+        std::cout << "   " << placement << std::endl;
+    }
+
+    std::string describe (const rb::ArenaStats& stats)
+    {
+        return std::to_string (stats.chunks) + " chunks, " + std::to_string (stats.thp_chunks) + " thp, " +
+               std::to_string (stats.hugetlb_chunks) + " hugetlb";
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    size_t n_keys    = (argc > 1) ? std::stoul (argv[1]) : 4000000;
+    size_t n_queries = (argc > 2) ? std::stoul (argv[2]) : 4000000;
+
+    std::mt19937 rng (40);
+    std::vector<int> keys (n_keys);
+    for (auto& key : keys)
+        key = static_cast<int>(rng() >> 1);
+
+    std::vector<int> queries (n_queries);
+    for (auto& query : queries)
+        query = static_cast<int>(rng() >> 1);
+
+    std::cout << std::left << std::setw (18) << "placement" << std::right
+              << std::setw (13) << "insert" << std::setw (13) << "lower_bound"
+              << std::setw (12) << "dTLB miss" << std::endl;
+
+    Result heap;
+    {
+        rb::Tree<int> tree;
+        run (tree, keys, queries, heap);
+    }
+    report ("std::allocator", heap, "");
+
+    using ArenaTree = rb::Tree<int, rb::NoAggregate, rb::UniqueKeys, rb::ArenaAllocator<int>>;
+
+    const std::pair<const char*, rb::HugePages> modes[] = {
+        {"arena 4K", rb::HugePages::NONE},
+        {"arena THP", rb::HugePages::TRANSPARENT},
+        {"arena hugetlb", rb::HugePages::EXPLICIT},
+    };
+
+    bool match = true;
+    for (const auto& [name, pages] : modes)
+    {
+        rb::ArenaOptions opts;
+        opts.huge_pages = pages;
+
+        rb::NodeArena arena (opts);
+        Result result;
+        {
+            ArenaTree tree (arena);
+            run (tree, keys, queries, result);
+        }
+
+        report (name, result, describe (arena.stats()));
+        match = match && (result.checksum == heap.checksum);
+    }
+
+    if (!match)
+        std::cout << "answers differ!" << std::endl;
+
+    return match ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+#include "rbtree.hpp"
+#include "skip_list.hpp"
+#include "benchmark.hpp"
+
+#include <iostream>
+#include <string>
+
+// The same command stream through every balancing policy of rb::Tree and
+// through the skip list. Prints the times in microseconds on one line:
+//   red-black avl wavl treap skip-list
+
+namespace
+{
+    template<typename Container>
+    long long time_one (const std::vector<benchmark::Command>& commands)
+    {
+        benchmark::RBTreeAdapter<Container> adapter;
+        return benchmark::run_benchmark (commands, adapter);
+    }
+}
+
+int main ()
+{
+    std::string input_line;
+    std::getline (std::cin, input_line);
+
+    auto commands = benchmark::parse_commands (input_line);
+
+    std::cout << time_one<rb::Tree<int>> (commands) << ' '
+              << time_one<rb::AvlTree<int>> (commands) << ' '
+              << time_one<rb::WavlTree<int>> (commands) << ' '
+              << time_one<rb::TreapTree<int>> (commands) << ' '
+              << time_one<rb::SkipList<int>> (commands) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "interval_tree.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Overlap counting: rb::IntervalTree vs filtering a vector of intervals.
+// Usage: interval_bench [intervals] [queries] [max_length]
+
+int main (int argc, char* argv[])
+{
+    size_t n_intervals = (argc > 1) ? std::stoul (argv[1]) : 200000;
+    size_t n_queries   = (argc > 2) ? std::stoul (argv[2]) : 20000;
+    int max_length     = (argc > 3) ? std::stoi  (argv[3]) : 1000;
+
+    std::mt19937 rng (42);
+    std::uniform_int_distribution<int> point (0, 100000000);
+    std::uniform_int_distribution<int> length (0, max_length);
+
+    std::vector<rb::Interval<int>> intervals;
+    for (size_t i = 0; i < n_intervals; ++i)
+    {
+        int start = point (rng);
+        intervals.push_back ({start, start + length (rng)});
+    }
+
+    std::vector<std::pair<int, int>> queries;
+    for (size_t i = 0; i < n_queries; ++i)
+    {
+        int low = point (rng);
+        queries.push_back ({low, low + length (rng)});
+    }
+
+    rb::IntervalTree<int> tree;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const auto& interval : intervals)
+        tree.insert (interval.start, interval.end);
+    auto built = std::chrono::high_resolution_clock::now();
+
+    size_t tree_total = 0;
+    for (const auto& [low, high] : queries)
+        tree_total += tree.overlap_count (low, high);
+    auto tree_done = std::chrono::high_resolution_clock::now();
+
+    size_t scan_total = 0;
+    for (const auto& [low, high] : queries)
+        for (const auto& interval : intervals)
+            scan_total += interval.overlaps (low, high);
+    auto scan_done = std::chrono::high_resolution_clock::now();
+
+    auto mcs = [](auto from, auto to)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+    };
+
+    std::cout << "build:          " << mcs (start, built) << " us\n"
+              << "interval tree:  " << mcs (built, tree_done) << " us\n"
+              << "linear scan:    " << mcs (tree_done, scan_done) << " us\n"
+              << "answers match:  " << (tree_total == scan_total ? "yes" : "NO") << std::endl;
+
+    return tree_total == scan_total ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#include "rbtree.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Lookup cost of the arithmetic-key fast path (branchless descent) against
+// the generic path, taken by wrapping the same int64_t keys in a struct.
+// Usage: keys_bench [keys] [queries]
+
+namespace
+{
+    struct BoxedKey
+    {
+        int64_t value;
+
+        bool operator< (const BoxedKey& rhs) const { return value < rhs.value; }
+        bool operator> (const BoxedKey& rhs) const { return rhs.value < value; }
+        bool operator<= (const BoxedKey& rhs) const { return !(rhs.value < value); }
+    };
+
+    template<typename Key>
+    long long run (const std::vector<int64_t>& keys, const std::vector<int64_t>& queries, size_t& checksum)
+    {
+        rb::Tree<Key> tree;
+        for (int64_t key : keys)
+            tree.insert (Key {key});
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        for (size_t i = 0; i + 1 < queries.size(); i += 2)
+        {
+            Key low {queries[i]};
+            Key high {queries[i] + (queries[i + 1] & 0xFFFF)};
+
+            checksum += tree.range_queries_solve (low, high);
+            checksum += (tree.lower_bound (low) != tree.end());
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    size_t n_keys    = (argc > 1) ? std::stoul (argv[1]) : 1000000;
+    size_t n_queries = (argc > 2) ? std::stoul (argv[2]) : 2000000;
+
+    std::mt19937_64 rng (42);
+    std::vector<int64_t> keys (n_keys);
+    for (auto& key : keys)
+        key = static_cast<int64_t>(rng() >> 20);
+
+    std::vector<int64_t> queries (n_queries);
+    for (auto& query : queries)
+        query = static_cast<int64_t>(rng() >> 20);
+
+    size_t fast_sum = 0;
+    size_t generic_sum = 0;
+
+    long long fast = run<int64_t> (keys, queries, fast_sum);
+    long long generic = run<BoxedKey> (keys, queries, generic_sum);
+
+    std::cout << "int64_t (branchless): " << fast << " us\n"
+              << "boxed   (generic):    " << generic << " us\n"
+              << "answers match:        " << (fast_sum == generic_sum ? "yes" : "NO") << std::endl;
+
+    return fast_sum == generic_sum ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+#include "offline.hpp"
+#include "benchmark.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main ()
+{
+    std::string input_line;
+    std::getline (std::cin, input_line);
+
+    auto parsed = benchmark::parse_commands (input_line);
+
+    std::vector<rb_app::Command> commands;
+    commands.reserve (parsed.size());
+    for (const auto& cmd : parsed)
+        commands.push_back ({cmd.first, cmd.second.first, cmd.second.second});
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    auto results = rb_app::solve_offline (commands);
+    volatile size_t answers = results.size();
+    (void) answers;
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::cout << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << std::endl;
+
+    return 0;
+}
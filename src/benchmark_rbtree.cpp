@@ -1,21 +1,33 @@
 #include "rbtree.hpp"
+#include "top_down_tree.hpp"
 #include "benchmark.hpp"
 
 #include <iostream>
 #include <string>
 
-int main ()
+// --top-down runs rb::TopDownTree, the layout without parent pointers,
+// on the same commands
+int main (int argc, char* argv[])
 {
+    bool top_down = (argc > 1 && std::string (argv[1]) == "--top-down");
+
     std::string input_line;
     std::getline (std::cin, input_line);
 
     auto commands = benchmark::parse_commands (input_line);
 
     benchmark::RBTreeAdapter<rb::Tree<int>> adapter;
+    benchmark::RBTreeAdapter<rb::TopDownTree<int>> top_down_adapter;
 
-    long long time_mcs = benchmark::run_benchmark (commands, adapter);
+    benchmark::TlbCounters tlb;
+    long long time_mcs = top_down ? benchmark::run_benchmark (commands, top_down_adapter, &tlb)
+                                  : benchmark::run_benchmark (commands, adapter, &tlb);
 
     std::cout << time_mcs << std::endl;
 
+    if (tlb.available())
+        std::cerr << "dTLB miss rate: " << tlb.miss_rate() * 100.0 << "% ("
+                  << tlb.misses() << " / " << tlb.accesses() << ")" << std::endl;
+
     return 0;
 }
@@ -1,15 +1,82 @@
 #include "rbtree.hpp"
 #include "processor.hpp"
+#include "pipeline.hpp"
+#include "offline.hpp"
 #include <iostream>
+#include <string>
 
-int main ()
+int main (int argc, char* argv[])
 {
-    std::string input_line;
-    std::getline (std::cin, input_line);
+    rb_app::ProcessorOptions options;
+    rb_app::DurabilityOptions& durability = options.durability;
+    bool pipelined = false;
+    bool offline = false;
 
-    auto results = rb_app::process_input (input_line);
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
 
-    rb_app::print_results (results);
+        if (arg == "--wal" && has_value)
+            durability.dir = argv[++i];
+        else if (arg == "--group-commit" && has_value)
+            durability.group_commit = std::stoul (argv[++i]);
+        else if (arg == "--flush-ms" && has_value)
+            durability.flush_interval = std::chrono::milliseconds (std::stoul (argv[++i]));
+        else if (arg == "--fsync-every" && has_value)
+            durability.fsync_every = std::stoul (argv[++i]);
+        else if (arg == "--checkpoint-every" && has_value)
+            durability.checkpoint_every = std::stoul (argv[++i]);
+        else if (arg == "--cache" && has_value)
+            options.cache_entries = std::stoul (argv[++i]);
+        else if (arg == "--write-buffer" && has_value)
+            options.write_buffer = std::stoul (argv[++i]);
+        else if (arg == "--approx-error" && has_value)
+            options.approx_error = std::stod (argv[++i]);
+        else if (arg == "--pipeline")
+            pipelined = true;
+        else if (arg == "--offline")
+            offline = true;
+        else
+        {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (offline && (pipelined || options.cache_entries != 0 || options.write_buffer != 0 || !durability.dir.empty()))
+    {
+        std::cerr << "--offline takes no other options but --approx-error" << std::endl;
+        return 1;
+    }
+
+    rb::CacheStats cache_stats;
+
+    if (offline)
+    {
+        std::string input_line;
+        std::getline (std::cin, input_line);
+
+        rb_app::print_results (rb_app::process_offline (input_line, options.approx_error));
+    }
+    else if (pipelined)
+    {
+        std::ios::sync_with_stdio (false);
+        rb_app::process_pipelined (std::cin, std::cout, options, &cache_stats);
+    }
+    else
+    {
+        std::string input_line;
+        std::getline (std::cin, input_line);
+
+        auto results = rb_app::process_input (input_line, options, &cache_stats);
+
+        rb_app::print_results (results);
+    }
+
+    if (options.cache_entries != 0)
+        std::cerr << "[query cache]: " << cache_stats.hits << " hits, " << cache_stats.misses
+                  << " misses, hit rate " << cache_stats.hit_rate() * 100.0 << "%" << std::endl;
 
     return 0;
 }
@@ -0,0 +1,140 @@
+#include "server.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Drives rbtree_server from several connections, each keeping up to
+// --depth queries in flight, and reports throughput and query latency
+// percentiles
+int main (int argc, char* argv[])
+{
+    std::string unix_path;
+    uint16_t port = 0;
+    size_t connections = 4;
+    size_t requests = 100000;           // per connection
+    size_t depth = 64;                  // outstanding queries per connection
+    double insert_ratio = 0.5;
+    int key_range = 1000000;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if (arg == "--unix" && has_value)
+            unix_path = argv[++i];
+        else if (arg == "--port" && has_value)
+            port = static_cast<uint16_t>(std::stoul (argv[++i]));
+        else if (arg == "--connections" && has_value)
+            connections = std::stoul (argv[++i]);
+        else if (arg == "--requests" && has_value)
+            requests = std::stoul (argv[++i]);
+        else if (arg == "--depth" && has_value)
+            depth = std::max<size_t> (std::stoul (argv[++i]), 1);
+        else if (arg == "--insert-ratio" && has_value)
+            insert_ratio = std::stod (argv[++i]);
+        else if (arg == "--key-range" && has_value)
+            key_range = std::stoi (argv[++i]);
+        else
+        {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (unix_path.empty() && port == 0)
+    {
+        std::cerr << "usage: " << argv[0] << " (--unix PATH | --port N) [--connections N] [--requests N]"
+                  << " [--depth N] [--insert-ratio R] [--key-range N]" << std::endl;
+        return 1;
+    }
+
+    using clock = std::chrono::steady_clock;
+
+    std::vector<std::vector<double>> latencies (connections);
+    std::vector<std::thread> threads;
+    auto start = clock::now();
+
+    for (size_t c = 0; c < connections; ++c)
+    {
+        threads.emplace_back ([&, c]
+        {
+            auto client = unix_path.empty() ? rb_app::Client::connect_tcp (port)
+                                            : rb_app::Client::connect_unix (unix_path);
+
+            std::mt19937 rng (static_cast<unsigned>(c) + 1);
+            std::uniform_int_distribution<int> key (0, key_range);
+            std::uniform_real_distribution<double> coin (0.0, 1.0);
+
+            std::deque<clock::time_point> in_flight;
+            std::string batch;
+
+            auto receive = [&]
+            {
+                client.read_count();
+                latencies[c].push_back (std::chrono::duration<double, std::micro>(
+                                            clock::now() - in_flight.front()).count());
+                in_flight.pop_front();
+            };
+
+            for (size_t sent = 0; sent < requests; )
+            {
+                // fill the window, then wait for the oldest answer
+                batch.clear();
+                while (sent < requests && in_flight.size() < depth)
+                {
+                    int low = key (rng);
+                    if (coin (rng) < insert_ratio)
+                    {
+                        batch += "k " + std::to_string (low) + "\n";
+                    }
+                    else
+                    {
+                        batch += "q " + std::to_string (low) + " " + std::to_string (low + key_range / 100) + "\n";
+                        in_flight.push_back (clock::now());
+                    }
+                    ++sent;
+                }
+                client.send (batch);
+
+                if (in_flight.size() == depth)
+                    receive();
+            }
+
+            // a last query makes sure the trailing inserts were applied too
+            client.send ("q 0 0\n");
+            in_flight.push_back (clock::now());
+            while (!in_flight.empty())
+                receive();
+        });
+    }
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::vector<double> all;
+    for (const auto& part : latencies)
+        all.insert (all.end(), part.begin(), part.end());
+    std::sort (all.begin(), all.end());
+
+    auto percentile = [&](double p)
+    {
+        return all.empty() ? 0.0 : all[std::min (all.size() - 1, static_cast<size_t>(p * all.size()))];
+    };
+
+    std::cout << "requests:   " << connections * requests << " over " << connections << " connections\n"
+              << "throughput: " << static_cast<size_t>(connections * requests / seconds) << " req/s\n"
+              << "query p50:  " << percentile (0.50) << " us\n"
+              << "query p99:  " << percentile (0.99) << " us\n"
+              << "query p999: " << percentile (0.999) << " us" << std::endl;
+
+    return 0;
+}
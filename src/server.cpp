@@ -0,0 +1,61 @@
+#include "server.hpp"
+
+#include <csignal>
+#include <iostream>
+#include <string>
+
+#include <pthread.h>
+
+int main (int argc, char* argv[])
+{
+    rb_app::ServerOptions options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if (arg == "--unix" && has_value)
+            options.unix_path = argv[++i];
+        else if (arg == "--port" && has_value)
+            options.port = static_cast<uint16_t>(std::stoul (argv[++i]));
+        else if (arg == "--threads" && has_value)
+            options.threads = std::stoul (argv[++i]);
+        else
+        {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    // Workers inherit the mask, so only sigwait below sees the signals
+    sigset_t signals;
+    sigemptyset (&signals);
+    sigaddset (&signals, SIGINT);
+    sigaddset (&signals, SIGTERM);
+    pthread_sigmask (SIG_BLOCK, &signals, nullptr);
+
+    try
+    {
+        rb_app::Server server (options);
+        server.start();
+
+        if (options.unix_path.empty())
+            std::cout << "[listening]: 127.0.0.1:" << server.port() << std::endl;
+        else
+            std::cout << "[listening]: " << options.unix_path << std::endl;
+
+        int received = 0;
+        sigwait (&signals, &received);
+
+        server.stop();
+        std::cout << "[stopped]: " << server.size() << " keys" << std::endl;
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
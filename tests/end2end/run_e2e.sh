@@ -9,12 +9,13 @@ NC='\033[0m'
 
 if [ $# -eq 0 ]; then
     echo -e "${RED}ERROR: Please provide path to binary${NC}"
-    echo "Usage: $0 <path_to_binary>"
-    echo "Example: $0 ./rbtree_app"
+    echo "Usage: $0 <path_to_binary> [binary options...]"
+    echo "Example: $0 ./rbtree_app --pipeline"
     exit 1
 fi
 
 PROGRAM_BIN="$1"
+PROGRAM_ARGS=("${@:2}")
 PASSED=0
 FAILED=0
 
@@ -35,7 +36,7 @@ for dat_file in *.dat; do
         continue
     fi
 
-    actual_output=$("$PROGRAM_BIN" < "$dat_file" 2>/dev/null)
+    actual_output=$("$PROGRAM_BIN" "${PROGRAM_ARGS[@]}" < "$dat_file" 2>/dev/null)
     expected_output=$(cat "$ans_file")
 
     if [ "$actual_output" == "$expected_output" ]; then
@@ -1,6 +1,8 @@
 #!/bin/bash
 
-# Performance benchmark: rb::Tree vs std::set
+# Performance benchmark: rb::Tree vs std::set, with the parent-pointer-free top-down
+# layout and the offline engine for reference,
+# then the balancing policies and the skip list head to head
 
 RED='\033[0;31m'
 GREEN='\033[0;32m'
@@ -8,14 +10,16 @@ YELLOW='\033[1;33m'
 CYAN='\033[0;36m'
 NC='\033[0m'
 
-if [ $# -ne 2 ]; then
-    echo -e "${RED}ERROR: Please provide paths to both benchmark binaries${NC}"
-    echo "Usage: $0 <rbtree_bench> <stdset_bench>"
+if [ $# -ne 4 ]; then
+    echo -e "${RED}ERROR: Please provide paths to all four benchmark binaries${NC}"
+    echo "Usage: $0 <rbtree_bench> <stdset_bench> <offline_bench> <balance_bench>"
     exit 1
 fi
 
 RBTREE_BIN="$1"
 STDSET_BIN="$2"
+OFFLINE_BIN="$3"
+BALANCE_BIN="$4"
 
 if [ ! -f "$RBTREE_BIN" ]; then
     echo -e "${RED}ERROR: $RBTREE_BIN not found!${NC}"
@@ -27,6 +31,16 @@ if [ ! -f "$STDSET_BIN" ]; then
     exit 1
 fi
 
+if [ ! -f "$OFFLINE_BIN" ]; then
+    echo -e "${RED}ERROR: $OFFLINE_BIN not found!${NC}"
+    exit 1
+fi
+
+if [ ! -f "$BALANCE_BIN" ]; then
+    echo -e "${RED}ERROR: $BALANCE_BIN not found!${NC}"
+    exit 1
+fi
+
 E2E_DIR="../end2end"
 
 if [ ! -d "$E2E_DIR" ]; then
@@ -35,15 +49,17 @@ if [ ! -d "$E2E_DIR" ]; then
 fi
 
 echo -e "${CYAN}Performance Benchmark: rb::Tree vs std::set${NC}"
-echo "========================================================"
-printf "%-10s %12s %12s %10s\n" "Test" "rb::Tree" "std::set" "Ratio"
-echo "--------------------------------------------------------"
+echo "===================================================================================="
+printf "%-10s %12s %12s %12s %12s %10s\n" "Test" "rb::Tree" "top-down" "std::set" "offline" "Ratio"
+echo "------------------------------------------------------------------------------------"
 
 for dat_file in "$E2E_DIR"/*.dat; do
     test_id=$(basename "$dat_file" .dat)
 
     rb_time=$("$RBTREE_BIN" < "$dat_file" 2>/dev/null)
+    top_down_time=$("$RBTREE_BIN" --top-down < "$dat_file" 2>/dev/null)
     std_time=$("$STDSET_BIN" < "$dat_file" 2>/dev/null)
+    offline_time=$("$OFFLINE_BIN" < "$dat_file" 2>/dev/null)
 
     if [ "$std_time" -gt 0 ] 2>/dev/null; then
         ratio=$(awk -v rb="$rb_time" -v std="$std_time" 'BEGIN {printf "%.2f", rb/std}')
@@ -58,8 +74,27 @@ for dat_file in "$E2E_DIR"/*.dat; do
         color=$YELLOW
     fi
 
-    printf "%-10s %10s μs %10s μs ${color}%9sx${NC}\n" "$test_id" "$rb_time" "$std_time" "$ratio"
+    printf "%-10s %10s μs %10s μs %10s μs %10s μs ${color}%9sx${NC}\n" \
+           "$test_id" "$rb_time" "$top_down_time" "$std_time" "$offline_time" "$ratio"
+done
+
+echo "===================================================================================="
+echo -e "${CYAN}Ratio = rb::Tree / std::set. Legend: ${GREEN}< 1.2x = Excellent${NC} | ${YELLOW}1.2-2.0x = Good${NC} | ${RED}> 2.0x = Slow${NC}"
+
+echo
+echo -e "${CYAN}Balancing policies: rb::Tree<int, ..., Balance> and rb::SkipList<int>${NC}"
+echo "======================================================================"
+printf "%-10s %10s %10s %10s %10s %10s\n" "Test" "red-black" "avl" "wavl" "treap" "skip-list"
+echo "----------------------------------------------------------------------"
+
+for dat_file in "$E2E_DIR"/*.dat; do
+    test_id=$(basename "$dat_file" .dat)
+
+    read -r rb_time avl_time wavl_time treap_time skip_time < <("$BALANCE_BIN" < "$dat_file" 2>/dev/null)
+
+    printf "%-10s %10s %10s %10s %10s %10s\n" \
+           "$test_id" "$rb_time" "$avl_time" "$wavl_time" "$treap_time" "$skip_time"
 done
 
-echo "========================================================"
-echo -e "${CYAN}Legend: ${GREEN}< 1.2x = Excellent${NC} | ${YELLOW}1.2-2.0x = Good${NC} | ${RED}> 2.0x = Slow${NC}"
+echo "======================================================================"
+echo -e "${CYAN}Times in μs, lower is better${NC}"
@@ -0,0 +1,156 @@
+#include "approx_counter.hpp"
+#include "processor.hpp"
+#include "pipeline.hpp"
+#include "offline.hpp"
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    size_t distance (size_t a, size_t b)
+    {
+        return a > b ? a - b : b - a;
+    }
+
+    size_t allowed_error (double error, size_t size)
+    {
+        return std::max<size_t> (2, static_cast<size_t>(error * static_cast<double>(size)));
+    }
+}
+
+TEST (ApproxCounterTest, EmptyAndReversedRanges)
+{
+    rb::Tree<int> tree;
+    rb::ApproxCounter<rb::Tree<int>> approx;
+    approx.rebuild (tree);
+
+    ASSERT_EQ (approx.range_queries_solve (0, 100), 0u);
+
+    tree.insert (5);
+    approx.add (tree, 5);
+    ASSERT_EQ (approx.range_queries_solve (0, 100), 1u);
+    ASSERT_EQ (approx.range_queries_solve (100, 0), 0u);
+
+    ASSERT_THROW (rb::ApproxCounter<rb::Tree<int>> (0.0), std::invalid_argument);
+    ASSERT_THROW (rb::ApproxCounter<rb::Tree<int>> (1.5), std::invalid_argument);
+}
+
+TEST (ApproxCounterTest, StaysWithinErrorWhileGrowing)
+{
+    for (double error : {0.1, 0.01})
+    {
+        std::mt19937 rng (47);
+        std::uniform_int_distribution<int> key (-1000000, 1000000);
+
+        rb::Tree<int> tree;
+        rb::ApproxCounter<rb::Tree<int>> approx (error);
+        approx.rebuild (tree);
+
+        for (int i = 0; i < 50000; ++i)
+        {
+            // clustered keys too, so buckets split unevenly
+            int k = (i % 3 == 0) ? key (rng) % 1000 : key (rng);
+            size_t before = tree.size();
+            tree.insert (k);
+            if (tree.size() != before)
+                approx.add (tree, k);
+            ASSERT_LE (approx.buckets(), static_cast<size_t>(8 / error)) << i;
+
+            if (i % 13 == 0)
+            {
+                int low = key (rng);
+                int high = low + static_cast<int>(rng() % 400000);
+                size_t exact = tree.range_queries_solve (low, high);
+                ASSERT_LE (distance (approx.range_queries_solve (low, high), exact),
+                           allowed_error (error, tree.size())) << low << " " << high;
+            }
+        }
+
+        ASSERT_EQ (approx.size(), tree.size());
+        ASSERT_EQ (approx.range_queries_solve (-2000000, 2000000), tree.size());
+    }
+}
+
+TEST (ApproxCounterTest, ExactOnSmallTrees)
+{
+    rb::Tree<int> tree;
+    rb::ApproxCounter<rb::Tree<int>> approx (0.01);
+    approx.rebuild (tree);
+
+    for (int k = 0; k < 100; k += 3)
+    {
+        tree.insert (k);
+        approx.add (tree, k);
+    }
+
+    // below 4 / error keys every bucket holds just its first key
+    for (int low = -2; low < 102; ++low)
+        for (int high = low; high < 102; high += 7)
+            ASSERT_EQ (approx.range_queries_solve (low, high), tree.range_queries_solve (low, high));
+}
+
+TEST (ApproxCounterTest, RebuildResynchronises)
+{
+    rb::Tree<int> tree;
+    for (int k = 0; k < 10000; ++k)
+        tree.insert (k);
+
+    rb::ApproxCounter<rb::Tree<int>> approx (0.01);
+    approx.rebuild (tree);
+    ASSERT_EQ (approx.size(), 10000u);
+    ASSERT_LE (distance (approx.range_queries_solve (2500, 7499), 5000), 100u);
+
+    for (int k = 0; k < 5000; ++k)
+        tree.erase (k);
+    approx.rebuild (tree);
+    ASSERT_EQ (approx.range_queries_solve (0, 4999), 0u);
+    ASSERT_EQ (approx.range_queries_solve (0, 20000), 5000u);
+}
+
+TEST (ApproxCounterTest, ProcessorCommand)
+{
+    std::string line;
+    for (int k = 0; k < 20000; ++k)
+        line += "k " + std::to_string ((k * 7919) % 20000) + " ";
+    line += "a 0 9999 q 0 9999 a 5000 5000 a 9 1 ";
+    for (int k = 20000; k < 40000; ++k)
+        line += "k " + std::to_string (k) + " ";
+    line += "a 0 39999 a 10000 29999";
+
+    auto results = rb_app::process_input (line);
+    ASSERT_EQ (results.size(), 6u);
+    ASSERT_LE (distance (results[0], 10000), 200u);
+    ASSERT_EQ (results[1], 10000u);
+    ASSERT_LE (results[2], 2u);
+    ASSERT_EQ (results[3], 0u);
+    ASSERT_EQ (results[4], 40000u);
+    ASSERT_LE (distance (results[5], 20000), 400u);
+
+    // the error target reaches the counter; the buffer is merged first
+    rb_app::ProcessorOptions opts;
+    opts.approx_error = 0.001;
+    opts.write_buffer = 64;
+    auto tight = rb_app::process_input (line, opts);
+    ASSERT_EQ (tight.size(), 6u);
+    ASSERT_LE (distance (tight[0], 10000), 20u);
+    ASSERT_EQ (tight[4], 40000u);
+    ASSERT_LE (distance (tight[5], 20000), 40u);
+
+    std::istringstream in (line);
+    std::ostringstream out;
+    rb_app::process_pipelined (in, out, opts);
+
+    std::ostringstream expected;
+    for (size_t i = 0; i < tight.size(); ++i)
+        expected << tight[i] << (i + 1 < tight.size() ? " " : "\n");
+    ASSERT_EQ (out.str(), expected.str());
+
+    // offline builds the same counter at the same point of the stream
+    ASSERT_EQ (rb_app::process_offline (line), results);
+    ASSERT_EQ (rb_app::process_offline (line, opts.approx_error), tight);
+}
@@ -0,0 +1,109 @@
+#include "arena.hpp"
+#include "rbtree.hpp"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <string>
+
+namespace
+{
+    using ArenaTree = rb::Tree<int, rb::NoAggregate, rb::UniqueKeys, rb::ArenaAllocator<int>>;
+}
+
+TEST (NodeArenaTest, TreeMatchesHeapTree)
+{
+    rb::ArenaOptions opts;
+    opts.chunk_size = 1 << 20;              // rounded up to one 2 MB chunk
+    rb::NodeArena arena (opts);
+
+    ArenaTree tree (arena);
+    rb::Tree<int> reference;
+
+    std::mt19937 rng (40);
+    std::uniform_int_distribution<int> key (0, 100000);
+    for (int i = 0; i < 50000; ++i)
+    {
+        int k = key (rng);
+        if (i % 3 == 0)
+        {
+            tree.erase (k);
+            reference.erase (k);
+        }
+        else
+        {
+            tree.insert (k);
+            reference.insert (k);
+        }
+    }
+
+    ASSERT_EQ (tree.size(), reference.size());
+    ASSERT_TRUE (std::equal (tree.begin(), tree.end(), reference.begin(), reference.end()));
+    ASSERT_TRUE (tree.verify());
+
+    ASSERT_GE (arena.stats().chunks, 1);
+    ASSERT_EQ (arena.stats().bytes_mapped % (2 << 20), 0);
+    ASSERT_EQ (&tree.get_allocator().arena(), &arena);
+}
+
+TEST (NodeArenaTest, FreedNodesAreReused)
+{
+    // one 2 MB chunk holds a round's 10000 nodes but not 20 rounds' worth
+    rb::ArenaOptions opts;
+    opts.chunk_size = 1 << 20;
+    rb::NodeArena arena (opts);
+    ArenaTree tree (arena);
+
+    for (int round = 0; round < 20; ++round)
+    {
+        for (int k = 0; k < 10000; ++k)
+            tree.insert (k);
+        for (int k = 0; k < 10000; ++k)
+            tree.erase (k);
+    }
+
+    ASSERT_TRUE (tree.empty());
+    ASSERT_EQ (arena.stats().chunks, 1);
+}
+
+TEST (NodeArenaTest, CopiesAndSnapshotsStayInTheArena)
+{
+    rb::NodeArena arena;
+    ArenaTree tree (arena);
+    for (int k = 0; k < 1000; ++k)
+        tree.insert (k * 3);
+
+    ArenaTree copy (tree);
+    ASSERT_EQ (copy.range_queries_solve (0, 300), 101);
+
+    const std::string path = ::testing::TempDir() + "rbtree_arena_snapshot.bin";
+    tree.save (path);
+
+    ArenaTree loaded (arena);
+    loaded.load (path);
+    ASSERT_EQ (loaded.size(), 1000);
+    ASSERT_TRUE (loaded.verify());
+
+    ArenaTree moved (std::move (loaded));
+    ASSERT_EQ (moved.size(), 1000);
+    ASSERT_EQ (arena.stats().chunks, 1);
+}
+
+TEST (NodeArenaTest, UnavailablePlacementFallsBack)
+{
+    // Neither an explicit huge page pool nor NUMA is needed: whatever the
+    // kernel refuses, allocation still succeeds from regular pages
+    rb::ArenaOptions opts;
+    opts.huge_pages = rb::HugePages::EXPLICIT;
+    opts.numa = rb::NumaPolicy::INTERLEAVE;
+    opts.numa_nodes = 1;
+    rb::NodeArena arena (opts);
+
+    ArenaTree tree (arena);
+    for (int k = 0; k < 1000; ++k)
+        tree.insert (k);
+
+    ASSERT_EQ (tree.size(), 1000);
+    ASSERT_EQ (arena.stats().chunks, 1);
+    ASSERT_LE (arena.stats().hugetlb_chunks + arena.stats().thp_chunks, 1);
+}
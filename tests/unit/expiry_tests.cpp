@@ -0,0 +1,153 @@
+#include "expiry.hpp"
+#include "rbtree.hpp"
+
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+#include <vector>
+
+TEST (TimingWheelTest, FiresInDeadlineOrderAcrossLevels)
+{
+    std::mt19937_64 rng (46);
+    rb::TimingWheel<int> wheel (1000);
+
+    std::multimap<uint64_t, int> expected;
+    for (int i = 0; i < 5000; ++i)
+    {
+        uint64_t deadline = 1001 + rng() % (uint64_t{1} << (rng() % 40));
+        ASSERT_TRUE (wheel.schedule (i, deadline));
+        expected.insert ({deadline, i});
+    }
+    ASSERT_FALSE (wheel.schedule (-1, 1000));
+
+    std::vector<std::pair<uint64_t, int>> fired;
+    uint64_t now = 1000;
+    while (wheel.size() != 0)
+    {
+        now += 1 + rng() % (uint64_t{1} << (rng() % 36));
+        wheel.advance (now, [&](int item, uint64_t deadline)
+        {
+            ASSERT_LE (deadline, now);
+            fired.push_back ({deadline, item});
+        });
+
+        for (auto it = expected.begin(); it != expected.end() && it->first <= now; it = expected.erase (it))
+            ;
+        if (!expected.empty())
+        {
+            ASSERT_GT (expected.begin()->first, now);
+        }
+    }
+
+    ASSERT_EQ (fired.size(), 5000);
+    ASSERT_TRUE (std::is_sorted (fired.begin(), fired.end(), [](const auto& lhs, const auto& rhs)
+    {
+        return lhs.first < rhs.first;
+    }));
+}
+
+TEST (ExpiringTreeTest, QueriesNeverCountExpiredKeys)
+{
+    rb::ExpiringTree<rb::Tree<int>> tree;
+
+    tree.insert (1, 0, 10);
+    tree.insert (2, 0, 20);
+    tree.insert (3, 5);                 // never expires
+    tree.insert (4, 5, 5);              // already due: not inserted
+
+    ASSERT_EQ (tree.range_queries_solve (0, 10, 9), 3);
+    ASSERT_EQ (tree.range_queries_solve (0, 10, 10), 2);
+    ASSERT_FALSE (tree.contains (1, 10));
+
+    tree.insert (2, 15, 100);           // refresh: the old timer must not remove it
+    ASSERT_EQ (tree.range_queries_solve (0, 10, 50), 2);
+    ASSERT_EQ (tree.range_queries_solve (0, 10, 100), 1);
+    ASSERT_EQ (tree.stats().expired, 2);
+
+    tree.insert (3, 100, 100);          // refresh into the past expires the key
+    ASSERT_FALSE (tree.contains (3, 100));
+    ASSERT_EQ (tree.size(), 0);
+    ASSERT_EQ (tree.stats().expired, 3);
+    ASSERT_TRUE (tree.tree().verify());
+}
+
+TEST (ExpiringTreeTest, CapacityEvictsOldestOrSmallest)
+{
+    rb::ExpiringTree<rb::Tree<int>> oldest ({.capacity = 3, .eviction = rb::Eviction::OLDEST});
+    for (int key : {50, 10, 40, 20})
+        oldest.insert (key, 0);
+    ASSERT_FALSE (oldest.contains (50, 0));
+    oldest.insert (10, 1);              // re-insert makes 10 the newest
+    oldest.insert (30, 1);
+    ASSERT_TRUE (oldest.contains (10, 1));
+    ASSERT_FALSE (oldest.contains (40, 1));
+
+    rb::ExpiringTree<rb::Tree<int>> smallest ({.capacity = 3, .eviction = rb::Eviction::SMALLEST_KEY});
+    for (int key : {50, 10, 40, 20})
+        smallest.insert (key, 0);
+    ASSERT_EQ (smallest.range_queries_solve (0, 100, 0), 3);
+    ASSERT_FALSE (smallest.contains (10, 0));
+    ASSERT_EQ (smallest.stats().evicted, 1);
+}
+
+TEST (ExpiringTreeTest, SlidingWindowStaysBounded)
+{
+    rb::ExpiringTree<rb::Tree<int>> tree;
+    std::mt19937 rng (47);
+
+    for (uint64_t now = 0; now < 200000; ++now)
+    {
+        tree.insert (static_cast<int>(rng() % 100000), now, now + 1000 + rng() % 500);
+        if (now % 10000 == 9999)
+        {
+            ASSERT_LE (tree.size(), 1500);
+            ASSERT_LE (tree.timers(), 1500);
+            ASSERT_EQ (tree.arrivals(), 0);     // no capacity, no insertion order
+        }
+    }
+
+    ASSERT_EQ (tree.range_queries_solve (0, 100000, 300000), 0);
+    ASSERT_EQ (tree.timers(), 0);
+
+    // with OLDEST eviction the queue is kept, and stays bounded
+    rb::ExpiringTree<rb::Tree<int>> capped ({.capacity = 2000, .eviction = rb::Eviction::OLDEST});
+    for (uint64_t now = 0; now < 100000; ++now)
+    {
+        capped.insert (static_cast<int>(rng() % 100000), now, now + 1000 + rng() % 500);
+        if (now % 10000 == 9999)
+        {
+            ASSERT_LE (capped.arrivals(), 2 * 1500 + 64);
+        }
+    }
+    ASSERT_EQ (capped.range_queries_solve (0, 100000, 200000), 0);
+    ASSERT_LE (capped.arrivals(), 64);
+
+    rb::ExpiringTree<rb::Tree<int>> smallest ({.capacity = 10, .eviction = rb::Eviction::SMALLEST_KEY});
+    for (int key = 0; key < 100; ++key)
+        smallest.insert (key, 0);
+    ASSERT_EQ (smallest.arrivals(), 0);
+}
+
+TEST (ExpiringTreeTest, RefreshedKeysDoNotPileUpTimers)
+{
+    rb::ExpiringTree<rb::Tree<int>> tree;
+
+    // each refresh supersedes the last timer, which would otherwise wait
+    // out the whole TTL in the wheel
+    for (uint64_t now = 0; now < 100000; ++now)
+    {
+        tree.insert (7, now, now + 1000000);
+        ASSERT_LE (tree.timers(), 2 * tree.size() + 64);
+    }
+
+    ASSERT_EQ (tree.size(), 1);
+    ASSERT_TRUE (tree.contains (7, 1099998));
+    ASSERT_FALSE (tree.contains (7, 1099999));
+    ASSERT_EQ (tree.timers(), 0);
+
+    for (int key = 0; key < 1000; ++key)
+        tree.insert (key, 1100000, 5000000);
+    for (int key = 0; key < 1000; ++key)
+        tree.erase (key);
+    ASSERT_LE (tree.timers(), 64);
+}
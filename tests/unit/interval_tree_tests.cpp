@@ -0,0 +1,92 @@
+#include "interval_tree.hpp"
+#include "processor.hpp"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+TEST (IntervalTreeTest, StabAndOverlap)
+{
+    rb::IntervalTree<int> tree;
+    tree.insert (1, 5);
+    tree.insert (3, 9);
+    tree.insert (10, 12);
+    tree.insert (11, 11);
+    tree.insert (7, 6);             // empty, ignored
+
+    ASSERT_EQ (tree.size(), 4);
+
+    ASSERT_EQ (tree.stab_count (4), 2);
+    ASSERT_EQ (tree.stab_count (11), 2);
+    ASSERT_EQ (tree.stab_count (0), 0);
+
+    auto stabbed = tree.stab (9);
+    ASSERT_EQ (stabbed.size(), 1);
+    ASSERT_EQ (stabbed[0], (rb::Interval<int>{3, 9}));
+
+    ASSERT_EQ (tree.overlap_count (5, 10), 3);
+    ASSERT_EQ (tree.overlap_count (13, 20), 0);
+    ASSERT_EQ (tree.overlap_count (10, 5), 0);
+
+    // an identical interval is a second interval
+    tree.insert (3, 9);
+    ASSERT_EQ (tree.size(), 5);
+    ASSERT_EQ (tree.stab_count (4), 3);
+    ASSERT_EQ (tree.stab (9).size(), 2);
+}
+
+TEST (IntervalTreeTest, MatchesLinearScan)
+{
+    std::mt19937 rng (7);
+    std::uniform_int_distribution<int> point (0, 10000);
+    std::uniform_int_distribution<int> length (0, 300);
+
+    rb::IntervalTree<int> tree;
+    std::vector<rb::Interval<int>> all;
+
+    for (int i = 0; i < 3000; ++i)
+    {
+        int start = point (rng);
+        int end = start + length (rng);
+        tree.insert (start, end);
+        all.push_back ({start, end});
+    }
+
+    // short lengths and a narrow range make repeated intervals common
+    for (int i = 0; i < 500; ++i)
+    {
+        int start = static_cast<int>(rng() % 50);
+        int end = start + static_cast<int>(rng() % 3);
+        tree.insert (start, end);
+        all.push_back ({start, end});
+    }
+
+    std::sort (all.begin(), all.end());
+    ASSERT_NE (std::adjacent_find (all.begin(), all.end()), all.end());
+    ASSERT_EQ (tree.size(), all.size());
+    ASSERT_TRUE (tree.tree().verify());
+
+    for (int q = 0; q < 300; ++q)
+    {
+        int low = point (rng);
+        int high = low + length (rng);
+
+        std::vector<rb::Interval<int>> expected;
+        for (const auto& interval : all)
+            if (interval.overlaps (low, high))
+                expected.push_back (interval);
+
+        ASSERT_EQ (tree.overlap_count (low, high), expected.size());
+
+        auto found = tree.overlaps (low, high);
+        std::sort (found.begin(), found.end());
+        ASSERT_EQ (found, expected);
+    }
+}
+
+TEST (IntervalTreeTest, ProcessorCommands)
+{
+    auto results = rb_app::process_input ("i 1 5 i 3 9 k 4 q 0 10 s 4 o 6 20 i 8 8 o 6 20");
+    ASSERT_EQ (results, std::vector<size_t>({1, 2, 1, 2}));
+}
@@ -0,0 +1,96 @@
+#include "mapped_tree.hpp"
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::string fresh_path (const std::string& name)
+    {
+        std::string path = ::testing::TempDir() + name;
+        std::remove (path.c_str());
+
+        return path;
+    }
+}
+
+TEST (MappedTreeTest, InsertQueryAndIterate)
+{
+    rb::MappedTree<int> tree (fresh_path ("mapped_basic.rbtm"));
+
+    ASSERT_TRUE (tree.empty());
+
+    ASSERT_TRUE (tree.insert (35));
+    ASSERT_TRUE (tree.insert (17));
+    ASSERT_TRUE (tree.insert (23));
+    ASSERT_FALSE (tree.insert (17));        // duplicate
+
+    ASSERT_EQ (tree.size(), 3);
+    ASSERT_TRUE (tree.contains (23));
+    ASSERT_FALSE (tree.contains (24));
+    ASSERT_EQ (tree.count (17), 1);
+    ASSERT_EQ (tree.count (36), 0);
+
+    std::vector<int> values (tree.begin(), tree.end());
+    std::vector<int> expected = {17, 23, 35};
+    ASSERT_EQ (values, expected);
+
+    ASSERT_EQ (*tree.lower_bound (18), 23);
+    ASSERT_EQ (*tree.upper_bound (23), 35);
+    ASSERT_EQ (tree.upper_bound (35), tree.end());
+
+    ASSERT_EQ (tree.range_queries_solve (17, 35), 3);
+    ASSERT_EQ (tree.range_queries_solve (18, 34), 1);
+    ASSERT_EQ (tree.range_queries_solve (35, 17), 0);
+}
+
+TEST (MappedTreeTest, GrowsAndReopens)
+{
+    const std::string path = fresh_path ("mapped_reopen.rbtm");
+    const int N = 20000;
+
+    {
+        rb::MappedTree<int> tree (path);
+        for (int i = 0; i < N; ++i)
+            tree.insert ((i * 7919) % N);
+
+        tree.sync();
+    }
+
+    rb::MappedTree<int> reopened (path);
+    ASSERT_EQ (reopened.size(), N);
+    ASSERT_EQ (reopened.range_queries_solve (100, 199), 100);
+
+    int expected = 0;
+    for (int val : reopened)
+        ASSERT_EQ (val, expected++);
+
+    reopened.insert (N + 5);
+    ASSERT_EQ (reopened.size(), N + 1);
+}
+
+TEST (MappedTreeTest, RejectsForeignFile)
+{
+    const std::string path = fresh_path ("mapped_foreign.rbtm");
+
+    {
+        rb::MappedTree<int> tree (path);
+        tree.insert (1);
+    }
+
+    // a rejected file leaves no descriptor or mapping behind
+    auto open_fds = [] {
+        return std::distance (std::filesystem::directory_iterator ("/proc/self/fd"),
+                              std::filesystem::directory_iterator());
+    };
+    auto before = open_fds();
+
+    for (int i = 0; i < 10; ++i)
+        ASSERT_THROW (rb::MappedTree<double> wrong (path), std::runtime_error);
+
+    ASSERT_EQ (open_fds(), before);
+}
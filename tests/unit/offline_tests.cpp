@@ -0,0 +1,52 @@
+#include "offline.hpp"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+
+TEST (OfflineTest, FenwickPrefixes)
+{
+    rb_app::FenwickTree tree (10);
+    tree.add (0);
+    tree.add (3);
+    tree.add (9);
+
+    ASSERT_EQ (tree.prefix (0), 0);
+    ASSERT_EQ (tree.prefix (1), 1);
+    ASSERT_EQ (tree.prefix (4), 2);
+    ASSERT_EQ (tree.prefix (9), 2);
+    ASSERT_EQ (tree.prefix (10), 3);
+}
+
+TEST (OfflineTest, MatchesOnlineProcessor)
+{
+    std::mt19937 rng (38);
+    std::uniform_int_distribution<int> key (-2000, 2000);
+    std::uniform_int_distribution<int> op (0, 9);
+
+    std::string line;
+    for (int i = 0; i < 30000; ++i)
+    {
+        int a = key (rng);
+        int b = key (rng);
+        int kind = op (rng);
+
+        if (kind < 5)
+            line += "k " + std::to_string (a) + " ";
+        else if (kind < 8)
+            line += "q " + std::to_string (a) + " " + std::to_string (b) + " ";
+        else if (kind == 8)
+            line += "i " + std::to_string (a) + " " + std::to_string (a + b / 8) + " ";
+        else if (i % 2 == 0)
+            line += "o " + std::to_string (a) + " " + std::to_string (b) + " ";
+        else
+            line += "a " + std::to_string (a) + " " + std::to_string (b) + " ";
+    }
+
+    ASSERT_EQ (rb_app::process_offline (line), rb_app::process_input (line));
+
+    for (const std::string edge : {"", "q 1 0", "k 5 k 5 q 5 5 q 6 4", "k 1 q 0 x q 0 10",
+                                   "q -2147483648 2147483647 k 2147483647 q 0 2147483647",
+                                   "a 0 10 k 3 k 4 a 9 1 k 3 a 0 10 q 0 10"})
+        ASSERT_EQ (rb_app::process_offline (edge), rb_app::process_input (edge)) << edge;
+}
@@ -0,0 +1,70 @@
+#include "pipeline.hpp"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace
+{
+    std::string serial_output (const std::string& line)
+    {
+        std::ostringstream out;
+        auto results = rb_app::process_input (line);
+        for (size_t i = 0; i < results.size(); ++i)
+            out << (i ? " " : "") << results[i];
+        out << "\n";
+
+        return out.str();
+    }
+
+    std::string pipelined_output (const std::string& input, size_t batch_size)
+    {
+        std::istringstream in (input);
+        std::ostringstream out;
+
+        rb_app::PipelineOptions opts;
+        opts.batch_size = batch_size;
+        opts.output_buffer = 64;
+        rb_app::process_pipelined (in, out, {}, nullptr, opts);
+
+        return out.str();
+    }
+}
+
+TEST (PipelineTest, MatchesSerialOnRandomCommands)
+{
+    std::mt19937 rng (37);
+    std::uniform_int_distribution<int> key (-500, 500);
+    std::uniform_int_distribution<int> op (0, 4);
+
+    std::string line;
+    for (int i = 0; i < 20000; ++i)
+    {
+        int a = key (rng);
+        int b = key (rng);
+        switch (op (rng))
+        {
+            case 0: line += "k " + std::to_string (a) + " "; break;
+            case 1: line += "q " + std::to_string (a) + " " + std::to_string (b) + " "; break;
+            case 2: line += "i " + std::to_string (a) + " " + std::to_string (a + b / 4) + " "; break;
+            case 3: line += "o " + std::to_string (a) + "\t" + std::to_string (b) + " "; break;
+            case 4: line += "s " + std::to_string (b) + "  "; break;
+        }
+    }
+
+    for (size_t batch_size : {1, 7, 4096})
+        ASSERT_EQ (pipelined_output (line + "\nk 1 q 0 10\n", batch_size), serial_output (line));
+}
+
+TEST (PipelineTest, ParsesLikeOperatorShift)
+{
+    for (const std::string line : {"", "q 1 2", "k 5 x k 7 q 0 10",
+                                   "k 12q 0 20 q +3 +20",       // number followed by a token
+                                   "k 1 k 2 q 0 x q 0 10",      // a bad number ends the input
+                                   "k 99999999999 q 0 10",      // so does an overflow
+                                   "kk 3 q -5 5 k -3 q -5 5", "k 1 q 0 1 s"})
+    {
+        ASSERT_EQ (pipelined_output (line, 2), serial_output (line)) << line;
+    }
+}
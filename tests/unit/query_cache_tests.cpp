@@ -0,0 +1,92 @@
+#include "query_cache.hpp"
+#include "processor.hpp"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+TEST (RangeCacheTest, RepeatedQueriesHit)
+{
+    rb::Tree<int> tree;
+    for (int key : {10, 20, 30, 40, 50})
+        tree.insert (key);
+
+    rb::RangeCache<rb::Tree<int>> cache (64);
+
+    ASSERT_EQ (cache.range_queries_solve (tree, 15, 45), 3);
+    ASSERT_EQ (cache.range_queries_solve (tree, 15, 45), 3);
+    ASSERT_EQ (cache.range_queries_solve (tree, 0, 100), 5);
+    ASSERT_EQ (cache.range_queries_solve (tree, 15, 45), 3);
+    ASSERT_EQ (cache.range_queries_solve (tree, 45, 15), 0);
+
+    ASSERT_EQ (cache.stats().hits, 2);
+    ASSERT_EQ (cache.stats().misses, 3);
+    ASSERT_DOUBLE_EQ (cache.stats().hit_rate(), 0.4);
+}
+
+TEST (RangeCacheTest, ChangesInvalidate)
+{
+    rb::Tree<int> tree;
+    tree.insert (10);
+    tree.insert (20);
+
+    rb::RangeCache<rb::Tree<int>> cache (16);
+    ASSERT_EQ (cache.range_queries_solve (tree, 0, 100), 2);
+
+    uint64_t version = tree.version();
+    tree.insert (20);                   // duplicate, nothing changes
+    ASSERT_EQ (tree.version(), version);
+    ASSERT_EQ (cache.range_queries_solve (tree, 0, 100), 2);
+    ASSERT_EQ (cache.stats().hits, 1);
+
+    tree.insert (30);
+    ASSERT_EQ (cache.range_queries_solve (tree, 0, 100), 3);
+
+    tree.erase (10);
+    ASSERT_EQ (cache.range_queries_solve (tree, 0, 100), 2);
+
+    tree.clear();
+    ASSERT_EQ (cache.range_queries_solve (tree, 0, 100), 0);
+
+    ASSERT_EQ (cache.stats().hits, 1);
+    ASSERT_EQ (cache.stats().misses, 4);
+}
+
+TEST (RangeCacheTest, MatchesTreeUnderEviction)
+{
+    std::mt19937 rng (35);
+    std::uniform_int_distribution<int> key (0, 1000);
+    std::uniform_int_distribution<int> hot (0, 40);
+
+    rb::MultiTree<int> tree;
+    rb::RangeCache<rb::MultiTree<int>> cache (32);
+    ASSERT_EQ (cache.capacity(), 32);
+
+    for (int step = 0; step < 20000; ++step)
+    {
+        if (step % 50 == 0)
+            tree.insert (key (rng));
+
+        int low = hot (rng) * 25;
+        int high = low + hot (rng) * 10;
+        ASSERT_EQ (cache.range_queries_solve (tree, low, high), tree.range_queries_solve (low, high));
+    }
+
+    ASSERT_GT (cache.stats().hits, 0);
+    ASSERT_GT (cache.stats().misses, 0);
+}
+
+TEST (RangeCacheTest, ProcessorOption)
+{
+    const std::string input = "k 1 k 5 q 0 10 q 0 10 k 7 q 0 10 q 2 6 q 0 10";
+
+    rb_app::ProcessorOptions opts;
+    opts.cache_entries = 8;
+
+    rb::CacheStats stats;
+    auto cached = rb_app::process_input (input, opts, &stats);
+
+    ASSERT_EQ (cached, rb_app::process_input (input));
+    ASSERT_EQ (stats.hits, 2);
+    ASSERT_EQ (stats.misses, 3);
+}
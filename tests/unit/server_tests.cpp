@@ -0,0 +1,190 @@
+#include "server.hpp"
+
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST (ServerTest, ParsesOnlyCompleteCommands)
+{
+    std::vector<rb_app::Command> commands;
+
+    ASSERT_EQ (rb_app::parse_requests ("k 5 q 1 1", false, commands), 3);   // "q 1 1" may go on
+    ASSERT_EQ (commands.size(), 1);
+
+    commands.clear();
+    ASSERT_EQ (rb_app::parse_requests ("q 1 10\n\tk 7\n", false, commands), 11);
+    ASSERT_EQ (commands.size(), 2);
+    ASSERT_EQ (commands[0].op, 'q');
+    ASSERT_EQ (commands[1].first, 7);
+
+    commands.clear();
+    ASSERT_EQ (rb_app::parse_requests ("k 5 q 1 1", true, commands), 9);
+    ASSERT_EQ (commands.size(), 2);
+
+    std::string_view error;
+    ASSERT_EQ (rb_app::parse_requests ("k 5x ", false, commands, &error), std::string_view::npos);
+    ASSERT_EQ (error, "malformed number");
+
+    // the driver's other commands are not served: answered with an error
+    commands.clear();
+    ASSERT_EQ (rb_app::parse_requests ("k 1 q 0 +9 a 0 5 ", false, commands, &error), std::string_view::npos);
+    ASSERT_EQ (error, "unknown command");
+    ASSERT_EQ (commands.size(), 2);
+    ASSERT_EQ (commands[1].second, 9);
+}
+
+TEST (ServerTest, PipelinedRequestsOverTcp)
+{
+    rb_app::ServerOptions opts;
+    opts.threads = 2;
+    rb_app::Server server (opts);
+    server.start();
+
+    auto client = rb_app::Client::connect_tcp (server.port());
+
+    // one request split across sends, answers come back in order
+    client.send ("k 10 k 20 k 3");
+    client.send ("0 q 5 2");
+    client.send ("5\nq 0 100 q 50 40\n");
+
+    ASSERT_EQ (client.read_count(), 2);
+    ASSERT_EQ (client.read_count(), 3);
+    ASSERT_EQ (client.read_count(), 0);
+
+    client.send ("k 1\n");
+    client.finish();
+    ASSERT_THROW (client.read_line(), std::runtime_error);
+
+    auto other = rb_app::Client::connect_tcp (server.port());
+    other.send ("q 0 100\n");
+    ASSERT_EQ (other.read_count(), 4);
+
+    other.send ("k oops\n");
+    ASSERT_EQ (other.read_line(), "error: malformed number");
+}
+
+TEST (ServerTest, ConcurrentClientsOverUnixSocket)
+{
+    rb_app::ServerOptions opts;
+    opts.unix_path = ::testing::TempDir() + "rbtree_server_test.sock";
+    opts.threads = 3;
+    rb_app::Server server (opts);
+    server.start();
+
+    const int clients = 4;
+    const int keys_per_client = 2000;
+
+    std::vector<std::thread> threads;
+    std::vector<size_t> last_counts (clients);
+    for (int c = 0; c < clients; ++c)
+    {
+        threads.emplace_back ([&, c]
+        {
+            auto client = rb_app::Client::connect_unix (opts.unix_path);
+
+            std::string requests;
+            for (int k = 0; k < keys_per_client; ++k)
+                requests += "k " + std::to_string (c * keys_per_client + k) + " q 0 1000000\n";
+            client.send (requests);
+
+            size_t previous = 0;
+            for (int k = 0; k < keys_per_client; ++k)
+            {
+                size_t count = client.read_count();
+                ASSERT_GE (count, previous);        // this client's own inserts are always visible
+                ASSERT_GE (count, static_cast<size_t>(k + 1));
+                previous = count;
+            }
+            last_counts[c] = previous;
+        });
+    }
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    ASSERT_EQ (server.size(), static_cast<size_t>(clients * keys_per_client));
+
+    auto client = rb_app::Client::connect_unix (opts.unix_path);
+    client.send ("q 0 1999 q 2000 7999\n");
+    ASSERT_EQ (client.read_count(), 2000);
+    ASSERT_EQ (client.read_count(), 6000);
+}
+
+TEST (ServerTest, LargeStreamIsReadAcrossWakeups)
+{
+    // tiny chunks and one read per wakeup: the rest of the stream must be
+    // picked up by later epoll_wait rounds
+    rb_app::ServerOptions opts;
+    opts.threads = 1;
+    opts.read_chunk = 64;
+    opts.reads_per_wakeup = 1;
+    rb_app::Server server (opts);
+    server.start();
+
+    auto busy = rb_app::Client::connect_tcp (server.port());
+    std::string requests;
+    for (int k = 0; k < 3000; ++k)
+        requests += "k " + std::to_string (k) + " q 0 " + std::to_string (k) + "\n";
+    busy.send (requests);
+
+    auto other = rb_app::Client::connect_tcp (server.port());
+    other.send ("q -1 -1\n");
+    ASSERT_EQ (other.read_count(), 0);
+
+    for (int k = 0; k < 3000; ++k)
+        ASSERT_EQ (busy.read_count(), static_cast<size_t>(k + 1));
+}
+
+TEST (ServerTest, RefusesUnknownCommandsAndOversizedRequests)
+{
+    rb_app::ServerOptions opts;
+    opts.threads = 1;
+    opts.max_request = 4096;
+    rb_app::Server server (opts);
+    server.start();
+
+    auto client = rb_app::Client::connect_tcp (server.port());
+    client.send ("k 1 q 0 5 s 1 q 0 5\n");
+    ASSERT_EQ (client.read_count(), 1);
+    ASSERT_EQ (client.read_line(), "error: unknown command");
+    ASSERT_THROW (client.read_line(), std::runtime_error);
+
+    // one endless word never parses, it must not be buffered for ever
+    auto flood = rb_app::Client::connect_tcp (server.port());
+    flood.send ("q 0 5 " + std::string (20000, '7'));
+    ASSERT_EQ (flood.read_count(), 1);
+    ASSERT_EQ (flood.read_line(), "error: request too large");
+    ASSERT_THROW (flood.read_line(), std::runtime_error);
+}
+
+TEST (ServerTest, PausesReadingWhileAnswersPileUp)
+{
+    // a client that sends everything before reading: the server stops
+    // reading once max_output bytes wait and resumes as they drain
+    rb_app::ServerOptions opts;
+    opts.threads = 1;
+    opts.read_chunk = 256;
+    opts.max_output = 64;
+    rb_app::Server server (opts);
+    server.start();
+
+    auto client = rb_app::Client::connect_tcp (server.port());
+    client.send ("k 1 k 2 k 3\n");
+
+    const int queries = 200000;
+    std::thread sender ([&]
+    {
+        std::string requests;
+        for (int i = 0; i < queries; ++i)
+            requests += "q 0 " + std::to_string (i % 4) + "\n";
+        client.send (requests);
+    });
+
+    // a blocked sender means the server stopped reading; answers keep coming
+    for (int i = 0; i < queries; ++i)
+        ASSERT_EQ (client.read_count(), static_cast<size_t>(std::min (i % 4, 3)));
+
+    sender.join();
+}
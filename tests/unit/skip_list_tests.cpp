@@ -0,0 +1,54 @@
+#include "skip_list.hpp"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+
+TEST (SkipListTest, MatchesStdSet)
+{
+    std::mt19937 rng (42);
+    std::uniform_int_distribution<int> key (-20000, 20000);
+
+    rb::SkipList<int> list;
+    std::set<int> model;
+
+    for (int i = 0; i < 30000; ++i)
+    {
+        int k = key (rng);
+        ASSERT_EQ (list.insert (k), model.insert (k).second);
+
+        if (i % 100 == 0)
+        {
+            int low = key (rng);
+            int high = low + static_cast<int>(rng() % 5000);
+            ASSERT_EQ (list.range_queries_solve (low, high),
+                       static_cast<size_t>(std::distance (model.lower_bound (low), model.upper_bound (high))));
+        }
+    }
+
+    ASSERT_EQ (list.size(), model.size());
+    ASSERT_TRUE (std::equal (list.begin(), list.end(), model.begin(), model.end()));
+
+    for (int k = -20000; k <= 20000; k += 101)
+        ASSERT_EQ (list.contains (k), model.contains (k));
+}
+
+TEST (SkipListTest, EdgeRanges)
+{
+    rb::SkipList<int> list;
+    ASSERT_TRUE (list.empty());
+    ASSERT_EQ (list.range_queries_solve (0, 10), 0);
+    ASSERT_FALSE (list.contains (0));
+
+    for (int i = 0; i < 100; ++i)
+        list.insert (i * 2);
+
+    ASSERT_EQ (list.range_queries_solve (0, 198), 100);
+    ASSERT_EQ (list.range_queries_solve (1, 1), 0);
+    ASSERT_EQ (list.range_queries_solve (10, 5), 0);
+    ASSERT_EQ (list.range_queries_solve (-100, 0), 1);
+    ASSERT_EQ (list.range_queries_solve (198, 1000), 1);
+    ASSERT_FALSE (list.insert (50));
+}
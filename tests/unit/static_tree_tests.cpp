@@ -0,0 +1,87 @@
+#include "static_tree.hpp"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // Built entirely at compile time; a duplicate in this list would not compile
+    constexpr auto edges = rb::make_static_tree (std::array {100, 10, 50, 20, 75, -5, 0});
+
+    static_assert (edges.size() == 7);
+    static_assert (*edges.begin() == -5 && edges.nth (6) == 100);
+    static_assert (*edges.lower_bound (11) == 20);
+    static_assert (*edges.lower_bound (20) == 20);
+    static_assert (*edges.upper_bound (20) == 50);
+    static_assert (edges.lower_bound (101) == edges.end());
+    static_assert (edges.upper_bound (-6) == edges.begin());
+    static_assert (edges.range_queries_solve (15, 60) == 2);
+    static_assert (edges.range_queries_solve (-5, 100) == 7);
+    static_assert (edges.range_queries_solve (60, 15) == 0);
+    static_assert (edges.contains (75) && !edges.contains (74));
+    static_assert (std::random_access_iterator<decltype (edges.begin())>);
+
+    // the keys are stored once, in the Eytzinger array
+    static_assert (sizeof (rb::StaticTree<int, 1000>) == 1001 * sizeof (int));
+
+    constexpr rb::StaticTree<int, 0> nothing (std::array<int, 0> {});
+    static_assert (nothing.range_queries_solve (0, 10) == 0 && nothing.lower_bound (3) == nothing.end());
+
+    constexpr auto routes = rb::make_static_tree (std::array<std::string_view, 4> {"/b", "/a", "/d", "/c"});
+    static_assert (routes.range_queries_solve ("/a", "/c") == 3);
+    static_assert (*routes.upper_bound ("/b") == "/c");
+}
+
+TEST (StaticTreeTest, MatchesStdSetForEverySize)
+{
+    std::mt19937 rng (49);
+
+    // every shape of the last Eytzinger level, from 1 to 64 keys
+    auto check = [&]<size_t N>()
+    {
+        std::set<int> model;
+        while (model.size() < N)
+            model.insert (static_cast<int>(rng() % 1000));
+
+        std::array<int, N> keys {};
+        std::copy (model.begin(), model.end(), keys.begin());
+        std::shuffle (keys.begin(), keys.end(), rng);
+
+        rb::StaticTree<int, N> tree (keys);
+        ASSERT_TRUE (std::equal (tree.begin(), tree.end(), model.begin(), model.end()));
+        ASSERT_TRUE (std::equal (std::make_reverse_iterator (tree.end()), std::make_reverse_iterator (tree.begin()),
+                                 model.rbegin(), model.rend()));
+        for (size_t i = 0; i < N; ++i)
+            ASSERT_EQ (tree.nth (i), tree.begin()[static_cast<std::ptrdiff_t>(i)]);
+
+        for (int key = -1; key <= 1001; ++key)
+        {
+            ASSERT_EQ (tree.lower_bound (key) - tree.begin(), std::distance (model.begin(), model.lower_bound (key)));
+            ASSERT_EQ (tree.upper_bound (key) - tree.begin(), std::distance (model.begin(), model.upper_bound (key)));
+            ASSERT_EQ (tree.contains (key), model.count (key) == 1);
+        }
+
+        for (int low = -1; low <= 1001; low += 37)
+            ASSERT_EQ (tree.range_queries_solve (low, low + 250),
+                       static_cast<size_t>(std::distance (model.lower_bound (low), model.upper_bound (low + 250))));
+    };
+
+    [&]<size_t... Sizes> (std::index_sequence<Sizes...>)
+    {
+        (check.template operator()<Sizes + 1>(), ...);
+    } (std::make_index_sequence<64> {});
+}
+
+TEST (StaticTreeTest, DuplicateThrowsAtRunTime)
+{
+    std::array<int, 4> keys {3, 1, 3, 2};
+    ASSERT_THROW ((rb::StaticTree<int, 4> (keys)), std::invalid_argument);
+}
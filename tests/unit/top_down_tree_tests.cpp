@@ -0,0 +1,137 @@
+#include "top_down_tree.hpp"
+#include "rbtree.hpp"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+TEST (TopDownTreeTest, MatchesStdSet)
+{
+    std::mt19937 rng (48);
+    std::uniform_int_distribution<int> key (-20000, 20000);
+
+    rb::TopDownTree<int> tree;
+    std::set<int> model;
+
+    for (int i = 0; i < 30000; ++i)
+    {
+        int k = key (rng);
+        ASSERT_EQ (tree.insert (k), model.insert (k).second);
+        ASSERT_EQ (tree.size(), model.size());
+
+        if (i % 500 == 0)
+        {
+            ASSERT_TRUE (tree.verify()) << i;
+        }
+
+        if (i % 100 == 0)
+        {
+            int low = key (rng);
+            int high = low + static_cast<int>(rng() % 5000);
+            ASSERT_EQ (tree.range_queries_solve (low, high),
+                       static_cast<size_t>(std::distance (model.lower_bound (low), model.upper_bound (high))));
+            ASSERT_EQ (tree.contains (k), true);
+            ASSERT_EQ (tree.contains (low), model.count (low) == 1);
+        }
+    }
+
+    ASSERT_TRUE (tree.verify());
+    ASSERT_TRUE (std::equal (tree.begin(), tree.end(), model.begin(), model.end()));
+    ASSERT_EQ (tree.range_queries_solve (5, 1), 0u);
+
+    std::vector<int> all;
+    tree.for_each ([&](int k) { all.push_back (k); });
+    ASSERT_TRUE (std::equal (all.begin(), all.end(), model.begin(), model.end()));
+
+    for (int i = 0; i < 200; ++i)
+    {
+        int low = key (rng);
+        int high = low + static_cast<int>(rng() % 5000);
+        std::vector<int> walked;
+        tree.for_each_in_range (low, high, [&](int k) { walked.push_back (k); });
+        ASSERT_TRUE (std::equal (walked.begin(), walked.end(), model.lower_bound (low), model.upper_bound (high)));
+    }
+
+    std::vector<int> none;
+    tree.for_each_in_range (5, 1, [&](int k) { none.push_back (k); });
+    ASSERT_TRUE (none.empty());
+}
+
+TEST (TopDownTreeTest, SortedInputStaysBalanced)
+{
+    // ascending and descending runs hit the single rotations, zigzags the
+    // double ones; duplicates exercise the size rollback
+    rb::TopDownTree<int> tree;
+    std::set<int> model;
+    for (int k = 0; k < 5000; ++k)
+        ASSERT_TRUE (tree.insert (k) && model.insert (k).second);
+    for (int k = -1; k > -5000; --k)
+        ASSERT_TRUE (tree.insert (k) && model.insert (k).second);
+    for (int k = 0; k < 20000; k += 2)
+    {
+        int zigzag = (k % 4 == 0) ? 10000 + k : 10000 - k;
+        ASSERT_EQ (tree.insert (zigzag), model.insert (zigzag).second);
+    }
+    for (int k = -4999; k < 5000; k += 3)
+        ASSERT_FALSE (tree.insert (k));
+
+    ASSERT_TRUE (tree.verify());
+    ASSERT_EQ (tree.size(), model.size());
+    ASSERT_EQ (tree.range_queries_solve (-4999, 4999), 9999u);
+
+    tree.clear();
+    ASSERT_TRUE (tree.empty());
+    ASSERT_TRUE (tree.verify());
+    ASSERT_EQ (tree.begin(), tree.end());
+}
+
+TEST (TopDownTreeTest, BoundsAndIteration)
+{
+    rb::TopDownTree<int> tree;
+    for (int k = 0; k < 1000; k += 10)
+        tree.insert (k);
+
+    ASSERT_EQ (*tree.lower_bound (15), 20);
+    ASSERT_EQ (*tree.lower_bound (20), 20);
+    ASSERT_EQ (*tree.upper_bound (20), 30);
+    ASSERT_EQ (*tree.lower_bound (-5), 0);
+    ASSERT_EQ (tree.lower_bound (991), tree.end());
+    ASSERT_EQ (tree.upper_bound (990), tree.end());
+
+    // iteration from a bound visits the rest in order
+    auto it = tree.lower_bound (955);
+    std::vector<int> tail (it, tree.end());
+    ASSERT_EQ (tail, (std::vector<int> {960, 970, 980, 990}));
+
+    ASSERT_EQ (std::distance (tree.begin(), tree.end()), 100);
+
+    // no path stack: iterators stay cheap to copy
+    static_assert (sizeof (rb::TopDownTree<int>::iterator) == 2 * sizeof (void*));
+    auto copy = it;
+    ASSERT_EQ (*copy, 960);
+    ASSERT_EQ (*++it, 970);
+    ASSERT_EQ (*copy, 960);
+}
+
+TEST (TopDownTreeTest, MatchesParentPointerTree)
+{
+    std::mt19937 rng (480);
+    rb::TopDownTree<std::string> tree;
+    rb::Tree<std::string> reference;
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        std::string k = std::to_string (rng() % 3000);
+        size_t before = reference.size();
+        reference.insert (k);
+        ASSERT_EQ (tree.insert (k), reference.size() != before);
+    }
+
+    ASSERT_TRUE (tree.verify());
+    ASSERT_TRUE (std::equal (tree.begin(), tree.end(), reference.begin(), reference.end()));
+    ASSERT_EQ (tree.range_queries_solve ("1", "2"), reference.range_queries_solve ("1", "2"));
+}
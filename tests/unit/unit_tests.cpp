@@ -3,6 +3,13 @@
 #include <gtest/gtest.h>
 #include <vector>
 #include <algorithm>
+#include <limits>
+#include <fstream>
+#include <string>
+#include <set>
+#include <numeric>
+#include <random>
+#include <atomic>
 
 TEST (RBTreeTest, BasicInsertAndSize)
 {
@@ -299,4 +306,967 @@ TEST (RBTreeTest, BalanceAfterInserts)
         ASSERT_EQ (val, expected);
         expected++;
     }
+
+    ASSERT_TRUE (tree.verify());
+}
+
+TEST (RBTreeSnapshotTest, SaveLoadRoundTrip)
+{
+    rb::Tree<int> orig;
+    for (int i = -500; i <= 500; i += 7)
+        orig.insert (i * 1013);
+
+    orig.insert (std::numeric_limits<int>::min());
+    orig.insert (std::numeric_limits<int>::max());
+
+    const std::string path = ::testing::TempDir() + "rbtree_snapshot_int.bin";
+    orig.save (path);
+
+    rb::Tree<int> loaded;
+    loaded.insert (42);
+    loaded.load (path);
+
+    ASSERT_EQ (loaded.size(), orig.size());
+    ASSERT_TRUE (std::equal (orig.begin(), orig.end(), loaded.begin()));
+    ASSERT_EQ (loaded.range_queries_solve (-100000, 100000), orig.range_queries_solve (-100000, 100000));
+
+    loaded.insert (3);
+    ASSERT_EQ (loaded.size(), orig.size() + 1);
+    ASSERT_EQ (loaded.range_queries_solve (3, 3), 1);
+}
+
+TEST (RBTreeSnapshotTest, RawEncodingAndEmptyTree)
+{
+    rb::Tree<double> orig;
+    for (int i = 0; i < 100; ++i)
+        orig.insert (i * 0.5);
+
+    const std::string path = ::testing::TempDir() + "rbtree_snapshot_double.bin";
+    orig.save (path);
+
+    rb::Tree<double> loaded;
+    loaded.load (path);
+    ASSERT_EQ (loaded.size(), 100);
+    ASSERT_EQ (*loaded.lower_bound (10.2), 10.5);
+
+    rb::Tree<int> empty;
+    const std::string empty_path = ::testing::TempDir() + "rbtree_snapshot_empty.bin";
+    empty.save (empty_path);
+
+    rb::Tree<int> from_empty;
+    from_empty.insert (7);
+    from_empty.load (empty_path);
+    ASSERT_TRUE (from_empty.empty());
+    ASSERT_EQ (from_empty.begin(), from_empty.end());
+}
+
+TEST (RBTreeSnapshotTest, RejectsCorruptedFile)
+{
+    rb::Tree<int> orig;
+    for (int i = 0; i < 1000; ++i)
+        orig.insert (i);
+
+    const std::string path = ::testing::TempDir() + "rbtree_snapshot_corrupt.bin";
+    orig.save (path);
+
+    {
+        std::fstream file (path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp (100);
+        file.put ('\x7f');
+    }
+
+    rb::Tree<int> loaded;
+    ASSERT_THROW (loaded.load (path), std::runtime_error);
+
+    rb::Tree<long long> wrong_type;
+    orig.save (path);
+    ASSERT_THROW (wrong_type.load (path), std::runtime_error);
+}
+
+TEST (RBTreeSnapshotTest, HeaderIsCheckedAndChecksummed)
+{
+    rb::Tree<double> orig;
+    for (int i = 0; i < 100; ++i)
+        orig.insert (i * 0.5);
+
+    const std::string path = ::testing::TempDir() + "rbtree_snapshot_header.bin";
+    auto rewrite_header = [&](auto edit, bool fix_checksum)
+    {
+        orig.save (path);
+        std::fstream file (path, std::ios::binary | std::ios::in | std::ios::out);
+
+        rb::snapshot::Header header;
+        file.read (reinterpret_cast<char*>(&header), sizeof (header));
+        std::vector<char> payload (header.payload_bytes);
+        file.read (payload.data(), static_cast<std::streamsize>(payload.size()));
+
+        edit (header);
+        if (fix_checksum)
+        {
+            rb::snapshot::Checksum checksum;
+            checksum.update (payload.data(), payload.size());
+            rb::snapshot::checksum_header (checksum, header);
+            header.checksum = checksum.value();
+        }
+
+        file.seekp (0);
+        file.write (reinterpret_cast<const char*>(&header), sizeof (header));
+    };
+
+    rb::Tree<double> loaded;
+
+    // any header field is covered by the checksum
+    rewrite_header ([](rb::snapshot::Header& header) { header.reserved2 = 1; }, false);
+    ASSERT_THROW (loaded.load (path), std::runtime_error);
+
+    // a count whose size in bytes wraps to the payload size, with a valid
+    // checksum, must not make load read past the file
+    rewrite_header ([](rb::snapshot::Header& header) { header.count += uint64_t {1} << 61; }, true);
+    ASSERT_THROW (loaded.load (path), std::runtime_error);
+
+    rewrite_header ([](rb::snapshot::Header&) {}, true);
+    loaded.load (path);
+    ASSERT_EQ (loaded.size(), 100);
+}
+
+namespace
+{
+    std::string read_file (const std::string& path)
+    {
+        std::ifstream file (path);
+        return std::string (std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    size_t count_substr (const std::string& text, const std::string& needle)
+    {
+        size_t count = 0;
+        for (size_t pos = text.find (needle); pos != std::string::npos; pos = text.find (needle, pos + 1))
+            count++;
+
+        return count;
+    }
+}
+
+TEST (RBTreeDumpTest, ShapeStats)
+{
+    rb::Tree<int> tree;
+    for (int i = 1; i <= 1000; ++i)
+        tree.insert (i);
+
+    rb::ShapeStats stats = tree.shape_stats();
+
+    ASSERT_EQ (stats.size, 1000);
+    ASSERT_EQ (stats.nodes, 1000);
+    ASSERT_GE (stats.height, 10);
+    ASSERT_LE (stats.height, 20);                   // 2 * log2 (n + 1)
+    ASSERT_GE (stats.black_height, 5);
+
+    size_t total = 0;
+    for (size_t count : stats.nodes_per_depth)
+        total += count;
+    ASSERT_EQ (total, 1000);
+    ASSERT_EQ (stats.nodes_per_depth[0], 1);
+    ASSERT_EQ (stats.subtree_size_log2.size(), 10); // root size 1000 is in [2^9, 2^10)
+}
+
+TEST (RBTreeDumpTest, RangeAndDepthLimitedExport)
+{
+    rb::Tree<int> tree;
+    for (int i = 1; i <= 200; ++i)
+        tree.insert (i);
+
+    const std::string path = ::testing::TempDir() + "rbtree_dump.json";
+
+    rb::DumpOptions<int> opts;
+    opts.format = rb::DumpFormat::JSON;
+    opts.low = 50;
+    opts.high = 59;
+    tree.dump (path, opts);
+
+    std::string json = read_file (path);
+    size_t nodes = count_substr (json, "\"id\"");
+    size_t elided = count_substr (json, "\"elided\"");
+    ASSERT_EQ (nodes - elided, 10);
+
+    rb::DumpOptions<int> top;
+    top.max_depth = 2;
+    tree.dump (path, top);
+
+    std::string dot = read_file (path);
+    ASSERT_EQ (count_substr (dot, "fillcolor"), 7);
+    ASSERT_EQ (count_substr (dot, "shape=box"), 8);
+}
+
+TEST (RBTreeVerifyTest, ValidTreesPass)
+{
+    rb::Tree<int> tree;
+    ASSERT_TRUE (tree.verify());
+
+    for (int i = 0; i < 5000; ++i)
+        tree.insert ((i * 7919) % 10007);
+
+    rb::VerifyResult full = tree.verify();
+    ASSERT_TRUE (full.ok) << full.error;
+    ASSERT_EQ (full.nodes_checked, tree.size());
+
+    rb::VerifyOptions parallel;
+    parallel.threads = 4;
+    parallel.parallel_threshold = 0;
+    rb::VerifyResult split = tree.verify (parallel);
+    ASSERT_TRUE (split.ok) << split.error;
+    ASSERT_EQ (split.nodes_checked, tree.size());
+
+    rb::VerifyResult sampled = tree.verify_sampled (64, 42);
+    ASSERT_TRUE (sampled.ok) << sampled.error;
+    ASSERT_GE (sampled.nodes_checked, 64 * 10);
+}
+
+TEST (RBTreeVerifyTest, SnapshotLoadIsBalanced)
+{
+    rb::Tree<int> orig;
+    for (int n = 1; n <= 40; ++n)
+    {
+        orig.insert (n);
+
+        const std::string path = ::testing::TempDir() + "rbtree_verify_snapshot.bin";
+        orig.save (path);
+
+        rb::Tree<int> loaded;
+        loaded.load (path);
+
+        rb::VerifyResult result = loaded.verify();
+        ASSERT_TRUE (result.ok) << "n = " << n << ": " << result.error;
+    }
+}
+
+namespace
+{
+    bool reverse_order = false;
+
+    struct Flippable
+    {
+        int value;
+
+        bool operator< (const Flippable& rhs) const
+        {
+            return reverse_order ? rhs.value < value : value < rhs.value;
+        }
+
+        bool operator> (const Flippable& rhs) const { return rhs < *this; }
+        bool operator<= (const Flippable& rhs) const { return !(rhs < *this); }
+
+        friend std::ostream& operator<< (std::ostream& out, const Flippable& key)
+        {
+            return out << key.value;
+        }
+    };
+}
+
+TEST (RBTreeVerifyTest, DetectsOrderViolation)
+{
+    rb::Tree<Flippable> tree;
+    for (int i = 0; i < 100; ++i)
+        tree.insert ({i});
+
+    ASSERT_TRUE (tree.verify());
+
+    reverse_order = true;
+    rb::VerifyResult full = tree.verify();
+    rb::VerifyResult sampled = tree.verify_sampled (8, 1);
+    reverse_order = false;
+
+    ASSERT_FALSE (full.ok);
+    ASSERT_NE (full.error.find ("BST order"), std::string::npos);
+    ASSERT_FALSE (sampled.ok);
+}
+
+TEST (RBTreeAggregateTest, RangeSumMinMax)
+{
+    rb::Tree<long, rb::SumAggregate<long>> sums;
+    rb::Tree<int, rb::MinAggregate<int>> mins;
+    rb::Tree<int, rb::MaxAggregate<int>> maxs;
+
+    std::vector<int> keys;
+    for (int i = 0; i < 500; ++i)
+        keys.push_back ((i * 7919) % 1009 - 300);
+
+    for (int key : keys)
+    {
+        sums.insert (key);
+        mins.insert (key);
+        maxs.insert (key);
+    }
+
+    ASSERT_TRUE (sums.verify());
+    ASSERT_TRUE (mins.verify());
+
+    std::sort (keys.begin(), keys.end());
+    keys.erase (std::unique (keys.begin(), keys.end()), keys.end());
+
+    for (int low = -310; low < 720; low += 37)
+    {
+        for (int high = low - 5; high < 720; high += 53)
+        {
+            long sum = 0;
+            int lo = std::numeric_limits<int>::max();
+            int hi = std::numeric_limits<int>::lowest();
+            for (int key : keys)
+            {
+                if (key < low || key > high)
+                    continue;
+
+                sum += key;
+                lo = std::min (lo, key);
+                hi = std::max (hi, key);
+            }
+
+            ASSERT_EQ (sums.range_aggregate (low, high), sum);
+            ASSERT_EQ (mins.range_aggregate (low, high), lo);
+            ASSERT_EQ (maxs.range_aggregate (low, high), hi);
+        }
+    }
+
+    long total = 0;
+    for (int key : keys)
+        total += key;
+    ASSERT_EQ (sums.aggregate(), total);
+}
+
+namespace
+{
+    struct Event
+    {
+        int time;
+        int weight;
+
+        bool operator< (const Event& rhs) const { return time < rhs.time; }
+        bool operator> (const Event& rhs) const { return rhs < *this; }
+        bool operator<= (const Event& rhs) const { return !(rhs < *this); }
+    };
+
+    struct EventWeight
+    {
+        int operator() (const Event& event) const { return event.weight; }
+    };
+
+    // Non-commutative: concatenation of keys in order
+    struct Concat
+    {
+        using value_type = std::string;
+
+        static value_type identity() { return ""; }
+        static value_type lift (const char& key) { return std::string (1, key); }
+        static value_type combine (const value_type& lhs, const value_type& rhs) { return lhs + rhs; }
+    };
+}
+
+TEST (RBTreeAggregateTest, PayloadProjectionAndOrder)
+{
+    rb::Tree<Event, rb::SumAggregate<Event, EventWeight>> events;
+    for (int t = 0; t < 100; ++t)
+        events.insert ({t, t % 10});
+
+    ASSERT_EQ (events.range_aggregate ({10, 0}, {29, 0}), 90);
+    ASSERT_EQ (events.range_aggregate ({95, 0}, {200, 0}), 5 + 6 + 7 + 8 + 9);
+
+    rb::Tree<char, Concat> letters;
+    for (char c : std::string ("qwertyuiopasdfghjklzxcvbnm"))
+        letters.insert (c);
+
+    ASSERT_EQ (letters.aggregate(), "abcdefghijklmnopqrstuvwxyz");
+    ASSERT_EQ (letters.range_aggregate ('d', 'k'), "defghijk");
+
+    // The count-only tree pays nothing for the aggregate slot
+    struct CountOnlyNode { int data; int color; void* links[3]; size_t size; };
+    ASSERT_EQ (rb::Tree<int>::node_size(), sizeof (CountOnlyNode));
+    ASSERT_GT ((rb::Tree<int, rb::SumAggregate<int>>::node_size()), sizeof (CountOnlyNode));
+}
+
+TEST (RBTreeEraseTest, MatchesStdSet)
+{
+    rb::Tree<int> tree;
+    std::set<int> model;
+    std::mt19937 rng (11);
+    std::uniform_int_distribution<int> key (0, 500);
+
+    for (int step = 0; step < 20000; ++step)
+    {
+        int k = key (rng);
+        if (rng() % 3 == 0)
+        {
+            ASSERT_EQ (tree.erase (k), model.erase (k) == 1);
+        }
+        else
+        {
+            tree.insert (k);
+            model.insert (k);
+        }
+
+        if (step % 1000 == 0)
+        {
+            rb::VerifyResult result = tree.verify();
+            ASSERT_TRUE (result.ok) << result.error;
+        }
+    }
+
+    ASSERT_EQ (tree.size(), model.size());
+    ASSERT_TRUE (std::equal (tree.begin(), tree.end(), model.begin(), model.end()));
+    ASSERT_EQ (tree.range_queries_solve (100, 300),
+               static_cast<size_t>(std::distance (model.lower_bound (100), model.upper_bound (300))));
+
+    for (int k : model)
+        ASSERT_TRUE (tree.erase (k));
+
+    ASSERT_TRUE (tree.empty());
+    ASSERT_TRUE (tree.verify());
+    ASSERT_FALSE (tree.erase (1));
+}
+
+TEST (RBTreeEraseTest, DuplicateInsertKeepsInvariants)
+{
+    rb::Tree<int> tree;
+    for (int round = 0; round < 3; ++round)
+        for (int i = 0; i < 300; ++i)
+            tree.insert ((i * 37) % 300);
+
+    ASSERT_EQ (tree.size(), 300);
+    rb::VerifyResult result = tree.verify();
+    ASSERT_TRUE (result.ok) << result.error;
+}
+
+TEST (RBMultiTreeTest, CountsDuplicatesWithoutExtraNodes)
+{
+    rb::MultiTree<int> tree;
+    tree.insert (50);
+    tree.insert (50);
+    tree.insert (50);
+    tree.insert (20);
+    tree.insert (70);
+    tree.insert (70);
+
+    ASSERT_EQ (tree.size(), 6);
+    ASSERT_EQ (tree.count (50), 3);
+    ASSERT_EQ (tree.count (70), 2);
+    ASSERT_EQ (tree.count (60), 0);
+    ASSERT_EQ (tree.shape_stats().size, 6);
+    ASSERT_EQ (tree.shape_stats().nodes, 3);
+    ASSERT_EQ (tree.shape_stats().nodes_per_depth.size(), 2);   // three nodes only
+    ASSERT_DOUBLE_EQ (tree.shape_stats().avg_depth, 2.0 / 3);   // per node, not per copy
+
+    ASSERT_EQ (tree.range_queries_solve (40, 60), 3);
+    ASSERT_EQ (tree.range_queries_solve (0, 100), 6);
+    ASSERT_EQ (tree.range_queries_solve (50, 70), 5);
+
+    ASSERT_TRUE (tree.erase (50));
+    ASSERT_EQ (tree.count (50), 2);
+    ASSERT_EQ (tree.range_queries_solve (40, 60), 2);
+
+    ASSERT_EQ (tree.erase_all (50), 2);
+    ASSERT_FALSE (tree.contains (50));
+    ASSERT_EQ (tree.size(), 3);
+    ASSERT_TRUE (tree.verify());
+
+    rb::MultiTree<int, rb::SumAggregate<int>> sums;
+    sums.insert (5);
+    sums.insert (5);
+    sums.insert (7);
+    ASSERT_EQ (sums.range_aggregate (0, 6), 10);
+    ASSERT_EQ (sums.aggregate(), 17);
+}
+
+TEST (RBMultiTreeTest, MatchesStdMultisetAndSnapshot)
+{
+    rb::MultiTree<int> tree;
+    std::multiset<int> model;
+    std::mt19937 rng (5);
+    std::uniform_int_distribution<int> key (0, 60);
+
+    for (int step = 0; step < 5000; ++step)
+    {
+        int k = key (rng);
+        if (rng() % 4 == 0)
+        {
+            auto it = model.find (k);
+            ASSERT_EQ (tree.erase (k), it != model.end());
+            if (it != model.end())
+                model.erase (it);
+        }
+        else
+        {
+            tree.insert (k);
+            model.insert (k);
+        }
+    }
+
+    ASSERT_EQ (tree.size(), model.size());
+    for (int k = 0; k <= 60; ++k)
+        ASSERT_EQ (tree.count (k), model.count (k));
+
+    rb::VerifyResult result = tree.verify();
+    ASSERT_TRUE (result.ok) << result.error;
+
+    const std::string path = ::testing::TempDir() + "rbtree_snapshot_multi.bin";
+    tree.save (path);
+
+    rb::MultiTree<int> loaded;
+    loaded.load (path);
+    ASSERT_EQ (loaded.size(), model.size());
+    ASSERT_EQ (loaded.range_queries_solve (10, 30),
+               static_cast<size_t>(std::distance (model.lower_bound (10), model.upper_bound (30))));
+    ASSERT_TRUE (loaded.verify());
+
+    rb::Tree<int> unique;
+    ASSERT_THROW (unique.load (path), std::runtime_error);
+}
+
+// ==== Finger search and hinted insert ==== //
+
+TEST (RBTreeFingerTest, SortedAndNearlySortedInserts)
+{
+    std::mt19937 rng (36);
+
+    std::vector<int> keys (5000);
+    for (int i = 0; i < 5000; ++i)
+        keys[i] = i * 2;
+    for (size_t i = 0; i + 4 <= keys.size(); i += 4)
+        std::shuffle (keys.begin() + i, keys.begin() + i + 4, rng);
+
+    rb::Tree<int> tree;
+    for (int key : keys)
+        tree.insert (key);
+    tree.insert (100);                  // duplicate far behind the finger
+
+    ASSERT_EQ (tree.size(), keys.size());
+    ASSERT_TRUE (tree.verify());
+    ASSERT_EQ (*tree.begin(), 0);
+    ASSERT_EQ (*(--tree.end()), 9998);
+    ASSERT_EQ (tree.range_queries_solve (1000, 2000), 501);
+
+    rb::Tree<int> hinted;
+    auto hint = hinted.end();
+    for (int i = 0; i < 5000; ++i)
+        hint = hinted.insert (hint, 5000 - i);
+
+    ASSERT_EQ (*hint, 1);
+    ASSERT_EQ (*hinted.insert (hinted.begin(), 4000), 4000);
+    ASSERT_EQ (hinted.size(), 5000);
+    ASSERT_TRUE (hinted.verify());
+}
+
+TEST (RBTreeFingerTest, HintedBoundsMatchPlainBounds)
+{
+    std::mt19937 rng (37);
+    std::uniform_int_distribution<int> key (0, 3000);
+
+    rb::MultiTree<int> tree;
+    for (int i = 0; i < 2000; ++i)
+        tree.insert (key (rng));
+
+    for (int i = 0; i < 500; ++i)
+    {
+        auto hint = tree.lower_bound (key (rng));
+        int target = key (rng) - 100;
+
+        ASSERT_EQ (tree.lower_bound (hint, target), tree.lower_bound (target));
+        ASSERT_EQ (tree.upper_bound (hint, target), tree.upper_bound (target));
+        ASSERT_EQ (tree.lower_bound (tree.end(), target), tree.lower_bound (target));
+    }
+
+    // ascending scan, each search starting from the previous answer
+    auto it = tree.begin();
+    for (int low = 0; low <= 3100; low += 7)
+    {
+        it = tree.lower_bound (it, low);
+        ASSERT_EQ (it, tree.lower_bound (low));
+    }
+}
+
+TEST (RBTreeFingerTest, EndsSurviveErase)
+{
+    rb::Tree<int> tree;
+    for (int key = 1; key <= 100; ++key)
+        tree.insert (key);
+
+    tree.erase (1);
+    tree.erase (100);
+    tree.erase (99);
+    ASSERT_EQ (*tree.begin(), 2);
+    ASSERT_EQ (tree.lower_bound (tree.end(), 1000), tree.end());
+    ASSERT_EQ (*tree.lower_bound (tree.end(), -5), 2);
+
+    tree.insert (0);
+    tree.insert (500);
+    ASSERT_EQ (*tree.begin(), 0);
+    ASSERT_EQ (*(--tree.end()), 500);
+    ASSERT_TRUE (tree.verify());
+
+    rb::Tree<int> moved (std::move (tree));
+    ASSERT_EQ (*moved.begin(), 0);
+    ASSERT_EQ (tree.begin(), tree.end());
+
+    tree = moved;
+    for (int key = 0; key <= 500; ++key)
+        tree.erase (key);
+    ASSERT_TRUE (tree.empty());
+    ASSERT_EQ (tree.begin(), tree.end());
+
+    tree.insert (7);
+    ASSERT_EQ (*tree.begin(), 7);
+}
+
+// ==== Compaction ==== //
+
+TEST (RBTreeCompactTest, RelayoutKeepsContentsAndNodes)
+{
+    for (rb::Layout layout : {rb::Layout::VEB, rb::Layout::PREORDER})
+    {
+        std::mt19937 rng (41);
+        std::uniform_int_distribution<int> key (0, 20000);
+
+        rb::MultiTree<int, rb::SumAggregate<int>> tree;
+        std::multiset<int> model;
+        for (int i = 0; i < 10000; ++i)
+        {
+            int k = key (rng);
+            tree.insert (k);
+            model.insert (k);
+        }
+
+        std::set<const int*> nodes;
+        for (const int& k : tree)
+            nodes.insert (&k);
+
+        tree.compact (layout);
+
+        std::set<const int*> relaid;
+        for (const int& k : tree)
+            relaid.insert (&k);
+
+        ASSERT_EQ (nodes, relaid);          // same nodes, new contents
+        ASSERT_TRUE (tree.verify());
+        ASSERT_EQ (tree.size(), model.size());
+        ASSERT_EQ (tree.count (*model.begin()), model.count (*model.begin()));
+        ASSERT_EQ (tree.range_aggregate (0, 20000), std::accumulate (model.begin(), model.end(), 0));
+
+        for (int k = 0; k <= 20000; k += 97)
+            ASSERT_EQ (tree.range_queries_solve (0, k),
+                       static_cast<size_t>(std::distance (model.begin(), model.upper_bound (k))));
+
+        tree.insert (-1);
+        ASSERT_EQ (*tree.begin(), -1);
+        ASSERT_EQ (*(--tree.end()), *model.rbegin());
+    }
+}
+
+TEST (RBTreeCompactTest, StepsInterleaveWithUpdates)
+{
+    std::mt19937 rng (42);
+    std::uniform_int_distribution<int> key (0, 50000);
+
+    rb::Tree<int> tree;
+    std::set<int> model;
+    for (int i = 0; i < 20000; ++i)
+    {
+        int k = key (rng);
+        tree.insert (k);
+        model.insert (k);
+    }
+
+    size_t passes = 0;
+    for (int step = 0; step < 400; ++step)
+    {
+        if (!tree.compact_step (256))
+            ++passes;
+
+        for (int i = 0; i < 20; ++i)
+        {
+            int k = key (rng);
+            if (i % 2 == 0)
+            {
+                tree.insert (k);
+                model.insert (k);
+            }
+            else
+            {
+                tree.erase (k);
+                model.erase (k);
+            }
+        }
+    }
+
+    ASSERT_GE (passes, 2);
+    ASSERT_TRUE (tree.verify());
+    ASSERT_TRUE (std::equal (tree.begin(), tree.end(), model.begin(), model.end()));
+
+    rb::Tree<int> tiny;
+    ASSERT_FALSE (tiny.compact_step());
+    tiny.insert (1);
+    ASSERT_TRUE (tiny.compact_step());
+    ASSERT_FALSE (tiny.compact_step());
+    ASSERT_EQ (*tiny.begin(), 1);
+}
+
+// ==== Balancing policies ==== //
+
+template<typename TreeT>
+class RBTreeBalanceTest : public ::testing::Test {};
+
+using BalancedTrees = ::testing::Types<rb::Tree<int>, rb::AvlTree<int>, rb::WavlTree<int>, rb::TreapTree<int>,
+                                       rb::AvlTree<int, rb::NoAggregate, rb::MultiKeys>,
+                                       rb::WavlTree<int, rb::NoAggregate, rb::MultiKeys>>;
+TYPED_TEST_SUITE (RBTreeBalanceTest, BalancedTrees);
+
+TYPED_TEST (RBTreeBalanceTest, RandomUpdatesMatchModel)
+{
+    std::mt19937 rng (42);
+    std::uniform_int_distribution<int> key (0, 3000);
+
+    TypeParam tree;
+    std::multiset<int> model;
+
+    for (int i = 0; i < 30000; ++i)
+    {
+        int k = key (rng);
+        if (rng() % 3 != 0)
+        {
+            if (TypeParam::is_multiset || !model.contains (k))
+                model.insert (k);
+            tree.insert (k);
+        }
+        else if (tree.erase (k))
+        {
+            model.erase (model.find (k));
+        }
+
+        if (i % 1000 == 0)
+        {
+            ASSERT_TRUE (tree.verify()) << tree.verify().error;
+        }
+    }
+
+    ASSERT_TRUE (tree.verify()) << tree.verify().error;
+    std::set<int> distinct (model.begin(), model.end());
+    ASSERT_EQ (tree.size(), model.size());
+    ASSERT_TRUE (std::equal (tree.begin(), tree.end(), distinct.begin(), distinct.end()));
+
+    for (int low = 0; low < 3000; low += 37)
+        ASSERT_EQ (tree.range_queries_solve (low, low + 250),
+                   static_cast<size_t>(std::distance (model.lower_bound (low), model.upper_bound (low + 250))));
+
+    while (!model.empty())
+    {
+        ASSERT_EQ (tree.erase_all (*model.begin()), model.count (*model.begin()));
+        model.erase (*model.begin());
+    }
+    ASSERT_TRUE (tree.empty());
+    ASSERT_TRUE (tree.verify());
+}
+
+TYPED_TEST (RBTreeBalanceTest, SortedInputStaysShallow)
+{
+    TypeParam tree;
+    const int n = 1 << 15;
+    for (int i = 0; i < n; ++i)
+        tree.insert (i);
+
+    // 2 log n bounds the deterministic policies, the treap only with high probability
+    constexpr bool is_treap = std::is_same_v<typename TypeParam::balance_type, rb::Treap>;
+    ASSERT_TRUE (tree.verify()) << tree.verify().error;
+    ASSERT_LE (tree.shape_stats().height, is_treap ? 3 * 15 : 2 * 15);
+
+    for (int i = 0; i < n; i += 2)
+        tree.erase (i);
+
+    ASSERT_TRUE (tree.verify()) << tree.verify().error;
+    ASSERT_EQ (tree.range_queries_solve (0, n), static_cast<size_t>(n / 2));
+}
+
+TYPED_TEST (RBTreeBalanceTest, LoadCopyAndCompactKeepInvariants)
+{
+    TypeParam orig;
+    for (int i = 0; i < 5000; ++i)
+        orig.insert ((i * 7919) % 10007);
+
+    const std::string path = ::testing::TempDir() + "rbtree_balance_snapshot.bin";
+    orig.save (path);
+
+    TypeParam loaded;
+    loaded.load (path);
+    ASSERT_TRUE (loaded.verify()) << loaded.verify().error;
+
+    for (int i = 0; i < 2000; ++i)
+    {
+        loaded.insert (10007 + i);
+        loaded.erase (i * 3);
+    }
+    ASSERT_TRUE (loaded.verify()) << loaded.verify().error;
+
+    TypeParam copy (loaded);
+    copy.compact();
+    ASSERT_TRUE (copy.verify()) << copy.verify().error;
+    ASSERT_TRUE (std::equal (copy.begin(), copy.end(), loaded.begin(), loaded.end()));
+}
+
+// ==== Rank selection and parallel traversal ==== //
+
+TEST (RBTreeParallelTest, NthAndSplitRange)
+{
+    rb::MultiTree<int> tree;
+    std::vector<int> sorted;
+    for (int i = 0; i < 3000; ++i)
+    {
+        int k = (i * 7919) % 1009;
+        tree.insert (k);
+        sorted.push_back (k);
+    }
+    std::sort (sorted.begin(), sorted.end());
+
+    for (size_t i = 0; i < sorted.size(); i += 13)
+        ASSERT_EQ (*tree.nth (i), sorted[i]);
+    ASSERT_TRUE (tree.nth (sorted.size()) == tree.end());
+
+    for (size_t parts : {1, 3, 8, 5000})
+    {
+        auto ranges = tree.split_range (100, 900, parts);
+        ASSERT_LE (ranges.size(), parts);
+        ASSERT_TRUE (ranges.front().first == tree.lower_bound (100));
+        ASSERT_TRUE (ranges.back().second == tree.upper_bound (900));
+        for (size_t i = 1; i < ranges.size(); ++i)
+            ASSERT_TRUE (ranges[i - 1].second == ranges[i].first);
+    }
+
+    ASSERT_TRUE (tree.split_range (2000, 3000, 4).empty());
+    ASSERT_TRUE (tree.split_range (10, 5, 4).empty());
+}
+
+TEST (RBTreeParallelTest, ForEachAndReduceMatchSequential)
+{
+    rb::Tree<int> tree;
+    for (int i = 0; i < 50000; ++i)
+        tree.insert ((i * 7919) % 100003);
+
+    rb::ParallelOptions opts;
+    opts.threads = 4;
+    opts.min_partition = 1000;
+
+    std::atomic<long long> sum {0};
+    std::atomic<size_t> visited {0};
+    tree.parallel_for_each (1000, 90000, [&](int key)
+    {
+        sum += key;
+        visited++;
+    }, opts);
+
+    long long expected = 0;
+    for (auto it = tree.lower_bound (1000); it != tree.upper_bound (90000); ++it)
+        expected += *it;
+    ASSERT_EQ (sum.load(), expected);
+    ASSERT_EQ (visited.load(), tree.range_queries_solve (1000, 90000));
+
+    // concatenation is associative but not commutative: the order must hold
+    auto keys = tree.parallel_reduce (0, 100003, std::vector<int> {},
+                                      [](int key) { return std::vector<int> {key}; },
+                                      [](std::vector<int> lhs, std::vector<int> rhs)
+                                      {
+                                          lhs.insert (lhs.end(), rhs.begin(), rhs.end());
+                                          return lhs;
+                                      }, opts);
+    ASSERT_TRUE (std::equal (keys.begin(), keys.end(), tree.begin(), tree.end()));
+
+    // bool partials are written from several threads at once
+    auto any_of = [&](int wanted)
+    {
+        return tree.parallel_reduce (0, 100003, false, [=](int key) { return key == wanted; },
+                                     [](bool lhs, bool rhs) { return lhs || rhs; }, opts);
+    };
+    ASSERT_TRUE (any_of (*tree.nth (tree.size() - 1)));
+    ASSERT_TRUE (any_of (*tree.begin()));
+    ASSERT_FALSE (any_of (-1));
+
+    ASSERT_EQ (tree.parallel_reduce (5, 4, 7, [](int key) { return key; }, std::plus<int> {}), 7);
+    ASSERT_THROW (tree.parallel_for_each (0, 100003, [](int key)
+    {
+        if (key == 4242)
+            throw std::runtime_error ("stop");
+    }, opts), std::runtime_error);
+}
+
+// ==== Range extraction ==== //
+
+TEST (RBTreeRangeExtractTest, MatchesIteratorWalk)
+{
+    std::mt19937 rng (45);
+    std::uniform_int_distribution<int> key (-5000, 5000);
+
+    rb::Tree<int> tree;
+    for (int i = 0; i < 4000; ++i)
+        tree.insert (key (rng));
+
+    for (int i = 0; i < 200; ++i)
+    {
+        int low = key (rng);
+        int high = low + static_cast<int>(rng() % 3000);
+
+        std::vector<int> expected (tree.lower_bound (low), tree.upper_bound (high));
+        ASSERT_EQ (tree.extract_range (low, high), expected);
+
+        std::vector<int> copied (expected.size() + 1, 0);
+        auto end = tree.copy_range (low, high, copied.begin());
+        ASSERT_EQ (end - copied.begin(), static_cast<std::ptrdiff_t>(expected.size()));
+        ASSERT_TRUE (std::equal (expected.begin(), expected.end(), copied.begin()));
+    }
+
+    ASSERT_TRUE (tree.extract_range (10, 5).empty());
+    ASSERT_TRUE (tree.extract_range (6000, 7000).empty());
+    ASSERT_TRUE (rb::Tree<int> {}.extract_range (0, 10).empty());
+}
+
+TEST (RBTreeRangeExtractTest, MultisetCopiesAndForEach)
+{
+    rb::MultiTree<int> tree;
+    for (int k : {5, 1, 5, 3, 5, 9, 3})
+        tree.insert (k);
+
+    ASSERT_EQ (tree.extract_range (2, 6), std::vector<int>({3, 3, 5, 5, 5}));
+    ASSERT_EQ (tree.extract_range (2, 6).size(), tree.range_queries_solve (2, 6));
+
+    int sum = 0;
+    tree.for_each_in_range (0, 100, [&](int key) { sum += key; });
+    ASSERT_EQ (sum, 31);
+}
+
+TEST (RBTreeRangeExtractTest, MultisetTraversalsAgree)
+{
+    // every range traversal visits each copy, serial or parallel
+    rb::MultiTree<int> tree;
+    for (int i = 0; i < 20000; ++i)
+        tree.insert ((i * 7919) % 3001);
+
+    rb::ParallelOptions opts;
+    opts.threads = 4;
+    opts.min_partition = 500;
+
+    std::vector<int> serial;
+    tree.for_each_in_range (100, 2500, [&](int key) { serial.push_back (key); });
+    ASSERT_EQ (serial, tree.extract_range (100, 2500));
+    ASSERT_EQ (serial.size(), tree.range_queries_solve (100, 2500));
+
+    std::atomic<size_t> visited {0};
+    std::atomic<long long> sum {0};
+    tree.parallel_for_each (100, 2500, [&](int key)
+    {
+        visited++;
+        sum += key;
+    }, opts);
+    ASSERT_EQ (visited.load(), serial.size());
+    ASSERT_EQ (sum.load(), std::accumulate (serial.begin(), serial.end(), 0LL));
+
+    auto keys = tree.parallel_reduce (100, 2500, std::vector<int> {},
+                                      [](int key) { return std::vector<int> {key}; },
+                                      [](std::vector<int> lhs, std::vector<int> rhs)
+                                      {
+                                          lhs.insert (lhs.end(), rhs.begin(), rhs.end());
+                                          return lhs;
+                                      }, opts);
+    ASSERT_EQ (keys, serial);
 }
@@ -0,0 +1,139 @@
+#include "processor.hpp"
+
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    rb_app::DurabilityOptions fresh_options (const std::string& name)
+    {
+        rb_app::DurabilityOptions opts;
+        opts.dir = ::testing::TempDir() + name;
+        std::filesystem::remove_all (opts.dir);
+
+        opts.group_commit = 16;
+        opts.flush_interval = std::chrono::milliseconds (1);
+
+        return opts;
+    }
+}
+
+TEST (DurabilityTest, ReplaysLogAfterRestart)
+{
+    auto opts = fresh_options ("wal_replay");
+    opts.checkpoint_every = 0;
+
+    auto first = rb_app::process_input ("k 10 k 20 k 30 q 1 100", opts);
+    ASSERT_EQ (first, std::vector<size_t>({3}));
+
+    auto second = rb_app::process_input ("k 40 q 1 100 q 15 35", opts);
+    ASSERT_EQ (second, std::vector<size_t>({4, 2}));
+}
+
+TEST (DurabilityTest, CheckpointTruncatesLog)
+{
+    auto opts = fresh_options ("wal_checkpoint");
+    opts.checkpoint_every = 50;
+
+    std::string input;
+    for (int i = 0; i < 175; ++i)
+        input += "k " + std::to_string (i) + " ";
+
+    rb_app::process_input (input, opts);
+
+    size_t checkpoints = 0;
+    size_t segments = 0;
+    for (const auto& entry : std::filesystem::directory_iterator (opts.dir))
+    {
+        std::string name = entry.path().filename().string();
+        checkpoints += name.rfind ("checkpoint-", 0) == 0;
+        segments += name.rfind ("wal-", 0) == 0;
+    }
+
+    ASSERT_EQ (checkpoints, 1);
+    ASSERT_EQ (segments, 1);
+
+    auto restored = rb_app::process_input ("q 0 174 q 150 1000", opts);
+    ASSERT_EQ (restored, std::vector<size_t>({175, 25}));
+}
+
+TEST (DurabilityTest, CheckpointRemovesOldFilesOnlyAfterSync)
+{
+    auto opts = fresh_options ("wal_checkpoint_crash");
+    opts.checkpoint_every = 50;
+
+    auto count_files = [&](const std::string& prefix)
+    {
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator (opts.dir))
+            count += entry.path().filename().string().rfind (prefix, 0) == 0;
+        return count;
+    };
+
+    // the second checkpoint "crashes" once it is durable, before anything
+    // it supersedes is removed
+    std::vector<std::string> steps;
+    opts.on_checkpoint_step = [&](const std::string& step)
+    {
+        steps.push_back (step);
+        if (steps.size() == 5)
+        {
+            ASSERT_EQ (step, "renamed");
+            ASSERT_EQ (count_files ("checkpoint-"), 2u);
+            throw std::runtime_error ("crash");
+        }
+    };
+
+    std::string input;
+    for (int i = 0; i < 120; ++i)
+        input += "k " + std::to_string (i) + " ";
+
+    ASSERT_THROW (rb_app::process_input (input, opts), std::runtime_error);
+    ASSERT_EQ (steps, (std::vector<std::string> {"synced", "renamed", "published", "synced", "renamed"}));
+    ASSERT_EQ (count_files ("checkpoint-"), 2u);
+
+    opts.on_checkpoint_step = nullptr;
+    auto restored = rb_app::process_input ("q 0 1000", opts);
+    ASSERT_EQ (restored, std::vector<size_t>({100}));
+}
+
+TEST (DurabilityTest, IgnoresTornTail)
+{
+    auto opts = fresh_options ("wal_torn");
+    opts.checkpoint_every = 0;
+
+    rb_app::process_input ("k 1 k 2 k 3", opts);
+
+    {
+        std::ofstream log (rb_app::WriteAheadLog::segment_path (opts.dir, 0),
+                           std::ios::binary | std::ios::app);
+        log.write ("\x05\x00\x00", 3);
+    }
+
+    auto restored = rb_app::process_input ("q 0 10", opts);
+    ASSERT_EQ (restored, std::vector<size_t>({3}));
+}
+
+TEST (DurabilityTest, TornHeaderCountIsNotTrusted)
+{
+    auto opts = fresh_options ("wal_torn_count");
+    opts.checkpoint_every = 0;
+
+    rb_app::process_input ("k 1 k 2 k 3", opts);
+
+    {
+        // a whole batch header (count, reserved, checksum) whose count runs
+        // past the end of the file, about 16 GB of keys
+        const char header[16] = {'\xf0', '\xff', '\xff', '\xff'};
+        std::ofstream log (rb_app::WriteAheadLog::segment_path (opts.dir, 0),
+                           std::ios::binary | std::ios::app);
+        log.write (header, sizeof (header));
+        log.write ("\x07\x00\x00\x00", 4);
+    }
+
+    auto restored = rb_app::process_input ("q 0 10", opts);
+    ASSERT_EQ (restored, std::vector<size_t>({3}));
+}
@@ -0,0 +1,99 @@
+#include "write_buffer.hpp"
+#include "processor.hpp"
+
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <random>
+#include <string>
+
+namespace
+{
+    template<typename TreeT>
+    void check_against_plain_tree (size_t capacity)
+    {
+        std::mt19937 rng (43);
+        std::uniform_int_distribution<int> key (0, 5000);
+
+        TreeT plain;
+        TreeT tree;
+        rb::WriteBuffer<TreeT> buffer (capacity);
+
+        for (int i = 0; i < 20000; ++i)
+        {
+            int k = key (rng);
+            plain.insert (k);
+            buffer.insert (tree, k);
+            ASSERT_LT (buffer.size(), buffer.capacity());
+
+            if (i % 7 == 0)
+            {
+                int low = key (rng);
+                int high = low + static_cast<int>(rng() % 800);
+                ASSERT_EQ (buffer.range_queries_solve (tree, low, high), plain.range_queries_solve (low, high));
+                ASSERT_TRUE (buffer.contains (tree, k));
+            }
+        }
+
+        buffer.flush (tree);
+        ASSERT_TRUE (buffer.empty());
+        ASSERT_EQ (tree.size(), plain.size());
+        ASSERT_TRUE (std::equal (tree.begin(), tree.end(), plain.begin(), plain.end()));
+        ASSERT_TRUE (tree.verify());
+    }
+}
+
+TEST (WriteBufferTest, UniqueKeysMatchTree)
+{
+    check_against_plain_tree<rb::Tree<int>> (64);
+    check_against_plain_tree<rb::Tree<int>> (1);
+}
+
+TEST (WriteBufferTest, MultisetCountsBufferedCopies)
+{
+    check_against_plain_tree<rb::MultiTree<int>> (256);
+
+    rb::MultiTree<int> tree;
+    rb::WriteBuffer<rb::MultiTree<int>> buffer (16);
+    tree.insert (5);
+    buffer.insert (tree, 5);
+    buffer.insert (tree, 5);
+
+    ASSERT_EQ (buffer.range_queries_solve (tree, 5, 5), 3);
+    ASSERT_EQ (buffer.size(), 2);       // counted without merging
+}
+
+TEST (WriteBufferTest, ProcessorOption)
+{
+    std::string input;
+    for (int i = 0; i < 3000; ++i)
+    {
+        input += "k " + std::to_string ((i * 7919) % 4001) + " ";
+        if (i % 50 == 0)
+            input += "q " + std::to_string (i % 1000) + " " + std::to_string (i % 1000 + 500) + " ";
+    }
+
+    rb_app::ProcessorOptions opts;
+    opts.write_buffer = 128;
+    ASSERT_EQ (rb_app::process_input (input, opts), rb_app::process_input (input));
+
+    opts.cache_entries = 16;
+    ASSERT_EQ (rb_app::process_input (input + "q 0 100 k 50 q 0 100 q 0 100", opts),
+               rb_app::process_input (input + "q 0 100 k 50 q 0 100 q 0 100"));
+}
+
+TEST (WriteBufferTest, CheckpointsIncludeBufferedKeys)
+{
+    rb_app::ProcessorOptions opts;
+    opts.write_buffer = 64;
+    opts.durability.dir = ::testing::TempDir() + "write_buffer_wal";
+    opts.durability.checkpoint_every = 100;
+    opts.durability.flush_interval = std::chrono::milliseconds (1);
+    std::filesystem::remove_all (opts.durability.dir);
+
+    std::string input;
+    for (int i = 0; i < 250; ++i)
+        input += "k " + std::to_string (i) + " ";
+    rb_app::process_input (input, opts);
+
+    ASSERT_EQ (rb_app::process_input ("q 0 1000", opts), std::vector<size_t>({250}));
+}